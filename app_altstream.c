@@ -34,6 +34,9 @@
 
 /*** MODULEINFO
 	<use type="module">func_periodic_hook</use>
+	<use type="external">zlib</use>
+	<use type="external">curl</use>
+	<use type="module">res_curl</use>
 	<support_level>core</support_level>
  ***/
 
@@ -67,6 +70,47 @@
 #include "asterisk/pbx.h"
 #include "asterisk/http_websocket.h"
 #include "asterisk/tcptls.h"
+#include "asterisk/netsock2.h"
+#include "asterisk/unaligned.h"
+#include "asterisk/translate.h"
+#include "asterisk/bridge.h"
+#include "asterisk/core_unreal.h"
+#include "asterisk/json.h"
+#include "asterisk/uuid.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sched.h>
+#include <dirent.h>
+#include <arpa/inet.h>
+#include <math.h>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#ifdef HAVE_CURL
+#include <curl/curl.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ALTSTREAM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+/* glibc 2.34 and later can close descriptors in posix_spawn itself */
+#ifdef __GLIBC__
+#if __GLIBC_PREREQ(2, 34)
+#define ALTSTREAM_SPAWN_CLOSEFROM
+#endif
+#endif
 
 
 /*** DOCUMENTATION
@@ -78,6 +122,19 @@
 			<parameter name="wsserver" required="true" argsep=".">
 				<argument name="wsserver" required="true">
 					<para>the URL to the  websocket server you want to send the audio to. </para>
+					<para>A <literal>unix:/path/to/socket</literal> endpoint streams to a local
+					stream socket instead, see the description for its framing.</para>
+					<para>A <literal>shm:name</literal> endpoint writes the audio into a shared
+					memory ring that local processes can map, see the description for its layout.</para>
+					<para>A <literal>rtp://host:port</literal> endpoint sends the audio as RTP over UDP.
+					The payload type defaults to 96 and can be changed with a
+					<literal>?pt=N</literal> suffix.</para>
+					<para>An <literal>http://</literal> or <literal>https://</literal> endpoint cuts the
+					audio into utterances and posts each one as a WAV file, see the description.</para>
+					<para>Several endpoints separated by <literal>|</literal> are all fed from the
+					same capture, see the description.</para>
+					<para><literal>profile=name</literal> streams with a profile from
+					<filename>altstream.conf</filename>, see the description.</para>
 				</argument>
 				<argument name="extension" required="true" />
 			</parameter>
@@ -107,18 +164,103 @@
 						<para>Adjust both, <emphasis>heard and spoken</emphasis> volumes by a factor
 						of <replaceable>x</replaceable> (range <literal>-4</literal> to <literal>4</literal>)</para>
 						<argument name="x" required="true" />
+						<para>This is applied by the AltStream gain stage as <replaceable>x</replaceable>
+						times 6.02 dB, see the <replaceable>G</replaceable> option.</para>
+					</option>
+					<option name="G">
+						<argument name="dB" required="true" />
+						<para>Apply a gain of <replaceable>dB</replaceable> decibels (range
+						<literal>-48</literal> to <literal>24</literal>, fractions allowed) to the
+						streamed audio, on top of <replaceable>W</replaceable> and any automatic gain.</para>
+					</option>
+					<option name="s">
+						<argument name="rate" required="true" />
+						<para>Sample rate of the streamed audio: <literal>8000</literal> (the default),
+						<literal>16000</literal>, <literal>24000</literal>, <literal>32000</literal> or
+						<literal>48000</literal>. Audio is captured at the channel's own rate and converted
+						by the AltStream resampler.</para>
+					</option>
+					<option name="M">
+						<argument name="format" />
+						<para>Stream 80 bin log-mel features instead of PCM, computed the way Whisper
+						does (16 kHz, 25 ms Hann window, 10 ms hop, Slaney mel scale, log10 clamped to
+						8 below the running maximum and scaled as (x + 4) / 4). Implies <literal>s(16000)</literal>.
+						Each binary message carries one frame of 80 values per 10 ms of audio, as
+						native endian 16 bit integers in Q12 by default or 32 bit floats when
+						<replaceable>format</replaceable> is <literal>f32</literal>. A text message
+						describing the layout is sent on every connect. Frame windows are centered
+						like Whisper's with zeros, rather than reflected samples, before the
+						first one. Not available with the <literal>rtp://</literal> transport.</para>
+					</option>
+					<option name="q">
+						<argument name="interval" required="true" />
+						<para>Raise an <literal>AltStreamQuality</literal> manager event every
+						<replaceable>interval</replaceable> seconds with the audio levels of each
+						direction over that interval. Levels are always tracked and can be read with
+						the <literal>ALTSTREAM</literal> function.</para>
+					</option>
+					<option name="f">
+						<argument name="ms" required="true" />
+						<para>Milliseconds of audio in every frame taken from the channel and sent,
+						from <literal>10</literal> to <literal>100</literal>. Defaults to <literal>20</literal>.</para>
+					</option>
+					<option name="c">
+						<argument name="window" />
+						<para>Resume the server side session after a reconnect instead of starting a new
+						one. Only for websocket endpoints, see the description. Up to
+						<replaceable>window</replaceable> milliseconds of unacknowledged audio (default
+						<literal>5000</literal>) are kept to be sent again.</para>
+					</option>
+					<option name="d">
+						<argument name="interval" />
+						<para>Leave out frames of pure digital silence, as a muted AltStream produces
+						(see <literal>AltStreamMute</literal>), and send
+						<literal>{"event":"silence","ms":N}</literal> text messages in their place. A
+						marker goes out before the first audio after the silence and every
+						<replaceable>interval</replaceable> milliseconds (default <literal>1000</literal>)
+						while it lasts, <literal>N</literal> adding up to the audio left out. Not for
+						the tracks of <replaceable>e</replaceable>, and streams with an
+						<literal>rtp://</literal>, <literal>http://</literal> or <literal>https://</literal>
+						endpoint send their silence as audio instead.</para>
+					</option>
+					<option name="h">
+						<argument name="where" required="true" />
+						<para>Where the transcripts of an <literal>http://</literal> endpoint go:
+						<literal>ami</literal> (the default) raises an <literal>AltStreamTranscript</literal>
+						manager event for every utterance, <literal>var</literal> sets channel variables
+						instead and <literal>both</literal> does both. See the description.</para>
+					</option>
+					<option name="e">
+						<para>Only for streams started by <literal>AltStreamBridge</literal>: send every
+						participant as a separate track instead of the bridge mix, see the description
+						of <literal>AltStreamBridge</literal>.</para>
+					</option>
+					<option name="A">
+						<argument name="target" />
+						<para>Automatic gain control. Quiet audio is raised, and loud audio is lowered,
+						towards <replaceable>target</replaceable> dBFS RMS (default <literal>-20</literal>).
+						Audio below -55 dBFS does not change the gain, so background noise is not pumped up.</para>
 					</option>
 					<option name="r">
 						<argument name="file" required="true" />
 						<para>Use the specified file to record the <emphasis>receive</emphasis> audio feed.
 						Like with the basic filename argument, if an absolute path isn't given, it will create
-						the file in the configured monitoring directory.</para>
+						the file in the configured monitoring directory. The audio is recorded as captured,
+						at the channel's rate and before gain, resampling or features, whatever direction
+						is streamed. Files ending in <literal>.wav</literal> get a WAV header, anything
+						else is written as headerless 16 bit signed linear.</para>
+						<para>Recordings are written by a separate thread per file in large batches, so
+						a slow disk never holds up the stream. If the disk falls more than a few seconds
+						behind, audio is dropped from the recording rather than from the stream.</para>
 					</option>
 					<option name="t">
 						<argument name="file" required="true" />
-						<para>Use the specified file to record the <emphasis>transmit</emphasis> audio feed.
-						Like with the basic filename argument, if an absolute path isn't given, it will create
-						the file in the configured monitoring directory.</para>
+						<para>Use the specified file to record the <emphasis>transmit</emphasis> audio feed,
+						the same way as the <replaceable>r</replaceable> option.</para>
+					</option>
+					<option name="a">
+						<para>Append to the <replaceable>r</replaceable> and <replaceable>t</replaceable>
+						files instead of overwriting them.</para>
 					</option>
 					<option name="S">
 						<para>When combined with the <replaceable>r</replaceable> or <replaceable>t</replaceable>
@@ -144,15 +286,40 @@
 					<option name="R">
 						<para>Timeout for reconnections</para>
 					</option>
-					<option name="r">
+					<option name="n">
 						<para>Number of times to attempt reconnect before closing connections</para>
 					</option>
+					<option name="k">
+						<argument name="interval" required="true" />
+						<para>Seconds between keepalive pings on websocket connections. Defaults
+						to 5, <literal>0</literal> turns keepalives off.</para>
+					</option>
+					<option name="K">
+						<argument name="timeout" required="true" />
+						<para>Seconds to wait for the pong answering a keepalive ping before the
+						connection is considered dead and reconnected. Defaults to 5.</para>
+					</option>
+					<option name="z">
+						<argument name="level" required="true" />
+						<para>Offer deflate compression of the audio messages to the websocket server,
+						using the given zlib compression level (1 to 9).</para>
+					</option>
+					<option name="Z">
+						<para>When combined with the <replaceable>z</replaceable> option, compress every
+						message on its own instead of keeping the compression context between messages.</para>
+					</option>
 				</optionlist>
 			</parameter>
 			<parameter name="command">
 				<para>This is executed when the audio fork's hook finishes</para>
 				<para>Any strings matching <literal>^{X}</literal> will be unescaped to <variable>X</variable>.</para>
 				<para>All variables will be evaluated at the time AltStream is called.</para>
+				<para>Commands are queued when the stream ends and run by a small pool of
+				workers shared by every stream, so many streams ending at once do not fork at
+				once. Commands without shell syntax are started directly, anything else through
+				<literal>/bin/sh</literal>. The queue holds up to 1000 commands and starts at most
+				20 of them per second, commands beyond that are dropped with an error.
+				<literal>altstream jobs</literal> on the CLI shows how the queue is doing.</para>
 				<warning><para>Do not use untrusted strings such as <variable>CALLERID(num)</variable>
 				or <variable>CALLERID(name)</variable> as part of the command parameters.  You
 				risk a command injection attack executing arbitrary commands if the untrusted
@@ -165,10 +332,139 @@
 			<para>This application does not automatically answer and should be preceeded by
 			an application such as Answer or Progress().</para>
 			<note><para>AltStream runs as an audiohook.</para></note>
+			<para>When <replaceable>wsserver</replaceable> is a <literal>unix:</literal> endpoint
+			no WebSocket handshake, framing or masking takes place. Every message is sent as a
+			4 byte header in network byte order followed by the payload, where the upper 8 bits
+			of the header hold the WebSocket opcode of the message and the lower 24 bits hold
+			the payload length.</para>
+			<para>When <replaceable>wsserver</replaceable> is a <literal>shm:</literal> endpoint
+			the audio is written into a memfd backed ring and an eventfd is signalled after every
+			message. Both are announced with the <literal>AltStreamShm</literal> manager event and
+			can be opened by other processes through their <literal>/proc</literal> paths. The ring
+			starts with a 64 byte header (magic <literal>0x41535452</literal>, version, header size,
+			data size, sample rate, direction, write position, last sequence number, writer heartbeat
+			in monotonic milliseconds, writer pid and state) followed by the data area. Each message in
+			the data area is a 16 byte record header (sequence number, payload length, opcode,
+			direction) and the payload, padded to 16 bytes. A record with opcode 255 is padding up to
+			the end of the data area. All fields are in host byte order.</para>
+			<para>When <replaceable>wsserver</replaceable> is a <literal>rtp://</literal> endpoint
+			every frame is sent as one or more RTP packets carrying big endian 16 bit linear audio,
+			with a random SSRC for every stream. Packets that cannot be sent right away are dropped
+			and counted instead of stalling the stream.</para>
+			<para>When <replaceable>wsserver</replaceable> is an <literal>http://</literal> or
+			<literal>https://</literal> endpoint, for batch speech to text engines such as Whisper
+			behind LocalAI or an OpenAI compatible server, nothing is streamed. The audio is cut into
+			utterances on frame energy: a frame above -40 dBFS RMS starts one, along with the 300 ms
+			before it, and 700 ms below that level or 30 seconds of audio end it. Utterances with less
+			than 250 ms of speech are dropped. Each one is posted as
+			<literal>multipart/form-data</literal> with the utterance as a 16 bit mono WAV in the
+			<literal>file</literal> field, by a pool of 8 upload workers shared by every stream
+			that keep their connections open between requests, so the utterances of a call are
+			transcribed in parallel. The query string of the endpoint is sent as further form
+			fields, for example
+			<literal>http://localai:8080/v1/audio/transcriptions?model=whisper-1&amp;language=ja</literal>,
+			except for <literal>vad_level</literal> (dBFS), <literal>vad_silence</literal> and
+			<literal>vad_max</literal> (milliseconds) which change the thresholds above. The
+			<literal>text</literal> member of a JSON response, or else the whole response, is the
+			transcript. It is delivered as set by the <replaceable>h</replaceable> option, in the
+			<literal>AltStreamTranscript</literal> manager event or in the channel variable
+			<variable>ALTSTREAM_TRANSCRIPT_N</variable> for utterance <literal>N</literal>, counting
+			from 1, with <variable>ALTSTREAM_TRANSCRIPTS</variable> set to the highest utterance
+			transcribed so far. As uploads run in parallel, transcripts may arrive out of order.
+			Up to 500 utterances wait for a worker, more are dropped. Only available when
+			Asterisk was built with libcurl, <literal>altstream uploads</literal> on the CLI
+			shows how the workers are doing.</para>
+			<para>When <replaceable>wsserver</replaceable> lists several endpoints separated by
+			<literal>|</literal>, up to 8 of them, audio is captured, converted and processed once
+			and every message is queued to each endpoint. Each endpoint has its own connection and
+			sender thread, reconnects on its own and may fall up to one second behind, after which
+			its oldest queued messages are dropped. The stream keeps running as long as one
+			endpoint is still connected or reconnecting.</para>
+			<para>With the <replaceable>z</replaceable> option the websocket client offers the
+			<literal>altstream-deflate</literal> subprotocol, or
+			<literal>altstream-deflate-nct</literal> together with the <replaceable>Z</replaceable>
+			option, ahead of <literal>echo</literal>. If the server accepts it, every binary message
+			is compressed the way RFC 7692 permessage-deflate compresses a message: raw deflate
+			flushed with <literal>Z_SYNC_FLUSH</literal> and the trailing
+			<literal>0x00 0x00 0xff 0xff</literal> removed. The <literal>-nct</literal> variant resets
+			the compression context after every message. Text messages are never compressed.</para>
+			<para>With the <replaceable>c</replaceable> option every connect starts with a text message
+			<literal>{"event":"session","session":"ID","resume":false,"seq":N}</literal>. The ID stays
+			the same for the whole stream, <literal>resume</literal> is <literal>true</literal> on every
+			connect after the first and <literal>N</literal> is the sequence number of the binary message
+			that follows. Binary messages are numbered one after the other from 0, across reconnects.
+			The server acknowledges what it has with <literal>{"event":"ack","seq":N}</literal>, covering
+			every message up to <literal>N</literal>. After a reconnect every message not acknowledged yet
+			is sent again, so a server that keeps its decoder per session can carry on and drop the
+			messages it already has.</para>
+			<para>A websocket server can steer the stream with text messages of its own, to shed load
+			instead of letting the connection time out. <literal>{"event":"pause"}</literal> and
+			<literal>{"event":"resume"}</literal> stop and restart the audio to that endpoint, other
+			text messages and recordings carry on. <literal>{"event":"ptime","ptime":N}</literal> changes
+			the packet time as the <replaceable>f</replaceable> option does.
+			<literal>{"event":"codec","codec":"slin"}</literal> switches between <literal>slin</literal>,
+			<literal>mel-q12</literal> and <literal>mel-f32</literal>, answered by a
+			<literal>codec</literal> message (and a <literal>features</literal> message for log-mel)
+			before the first message in the new format. It is only honoured by streams to a single
+			endpoint that were not redirected, without tracks or RTP, and for log-mel only at 16000 Hz.
+			<literal>{"event":"redirect","redirect":"wsserver"}</literal> moves the stream as
+			<literal>AltStreamRedirect</literal> does. Servers may only do that with
+			<literal>server_redirects=yes</literal> in the <literal>[general]</literal> category of
+			<filename>altstream.conf</filename>, and only to a single <literal>ws://</literal> or
+			<literal>wss://</literal> endpoint.</para>
+			<para>Streams that share a setup can be described once as a profile in
+			<filename>altstream.conf</filename>, one category per profile, and started with
+			<literal>profile=name</literal> in place of <replaceable>wsserver</replaceable>. A profile
+			takes <literal>server</literal> (required), <literal>options</literal> (an option string as
+			above), <literal>command</literal> (used when AltStream is not given one),
+			<literal>codec</literal> (<literal>slin</literal>, <literal>mel</literal> or
+			<literal>mel-f32</literal>), <literal>ptime</literal>, <literal>rate</literal>,
+			<literal>direction</literal>, <literal>gain</literal>, <literal>agc</literal>,
+			<literal>tls</literal>, <literal>compression</literal>, <literal>reconnect_timeout</literal>,
+			<literal>reconnect_attempts</literal>, <literal>ping_interval</literal>,
+			<literal>pong_timeout</literal>, <literal>quality_interval</literal> and
+			<literal>silence_interval</literal>, each of which is
+			the matching option. Profiles are compiled when the module is loaded or reloaded, and
+			options given to AltStream are applied on top of the profile's. Streams keep the profile
+			they started with across a reload. <literal>altstream profiles</literal> on the CLI lists them.</para>
+			<para>The <literal>[general]</literal> category of <filename>altstream.conf</filename> is not
+			a profile, it says where stream threads run. Every <literal>cpuset</literal> line, a CPU
+			list such as <literal>0-7,16-23</literal>, is a set of CPUs a stream thread and its endpoint
+			senders can be pinned to, each new stream going to the set with the fewest streams. With
+			<literal>numa=yes</literal> a set on the NUMA node of the thread starting the stream comes
+			first, for the AltStream application the channel's own thread, and without any
+			<literal>cpuset</literal> lines every node is a set of its own. The stream allocates its
+			buffers once pinned, so they end up on that node too. Streams keep their set across a
+			reload. <literal>altstream cpusets</literal> on the CLI shows the sets and their load, as
+			does <literal>AltStreamUsage</literal>.</para>
+			<para><literal>[general]</literal> also caps what AltStream may take, each cap off when 0 or
+			left out: <literal>max_streams</literal> streams in all, <literal>max_streams_per_server</literal>
+			streams to the same endpoint, every endpoint of a fanned out stream counting on its own
+			and a redirected stream counting on its new endpoints, and <literal>max_buffered</literal>
+			bytes of audio held for endpoints, redirects, resumed sessions and utterances waiting to be
+			posted to <literal>http://</literal> endpoints. Past
+			<literal>max_buffered</literal> such audio is dropped and no new stream starts. A start past
+			a cap waits up to <literal>queue_timeout</literal> milliseconds for room and is refused
+			after that, except for <literal>AltStreamBulk</literal> starts, which are refused at once. The <literal>AltStreamUsage</literal> manager action reports the usage.</para>
+			<para>Profiles with the same <literal>tenant</literal> key share the limits of the category
+			of that name with <literal>type=tenant</literal>: <literal>max_streams</literal> streams at
+			once, and a token bucket of <literal>rate</literal> seconds of audio per second holding up to
+			<literal>burst</literal> seconds (default one second's worth). A start is refused while the
+			tenant is at <literal>max_streams</literal> or its bucket is empty, and audio that finds the
+			bucket empty is dropped. Tenants keep their counters across a reload, and
+			<literal>AltStreamUsage</literal> reports them.</para>
 			<variablelist>
 				<variable name="ALTSTREAM_WSSERVER">
 					<para>The URL of the websocket server.</para>
 				</variable>
+				<variable name="ALTSTREAM_STATUS">
+					<para>The outcome of starting the stream.</para>
+					<value name="STARTED" />
+					<value name="REFUSED">
+						A cap in <filename>altstream.conf</filename> was reached.
+					</value>
+					<value name="FAILED" />
+				</variable>
 			</variablelist>
 			<warning><para>Do not use untrusted strings such as <variable>CALLERID(num)</variable>
 			or <variable>CALLERID(name)</variable> as part of ANY of the application's
@@ -202,6 +498,191 @@
 			<ref type="application">AltStream</ref>
 		</see-also>
 	</application>
+	<application name="AltStreamBridge" language="en_US">
+		<synopsis>
+			Forks the audio of a whole bridge to a websocket server.
+		</synopsis>
+		<syntax>
+			<parameter name="bridge">
+				<para>Unique ID of the bridge to stream. Defaults to the bridge the calling
+				channel is in.</para>
+			</parameter>
+			<parameter name="wsserver" required="true">
+				<para>Endpoint or endpoints to stream to, as for <literal>AltStream</literal>.</para>
+			</parameter>
+			<parameter name="options">
+				<para>Options as for <literal>AltStream</literal>. The direction is always
+				<literal>in</literal>.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Adds a <literal>Recorder</literal> channel to the bridge and streams what it hears,
+			which is the mix of every participant, over one connection. This needs one
+			audiohook and one stream thread per bridge instead of one per participant.</para>
+			<para>With the <replaceable>e</replaceable> option every participant is sent as its
+			own track instead, still over the one connection and stream thread. Each binary
+			message then starts with a 4 byte track number in network byte order followed by
+			the participant's audio. A text message
+			<literal>{"event":"track","track":N,"state":"start","channel":"...","uniqueid":"..."}</literal>
+			is sent when a participant joins and one with <literal>"state":"stop"</literal> when
+			they leave. Participants are picked up within a second of joining. At most 32
+			participants are sent as tracks, anyone joining after that is left out and a
+			warning is logged. Gain and features are not applied to tracks.</para>
+			<para>The stream ends when the bridge is torn down or
+			<literal>StopAltStreamBridge</literal> is called for it.</para>
+		</description>
+		<see-also>
+			<ref type="application">AltStream</ref>
+			<ref type="application">StopAltStreamBridge</ref>
+		</see-also>
+	</application>
+	<application name="StopAltStreamBridge" language="en_US">
+		<synopsis>
+			Stops every AltStreamBridge fork of a bridge.
+		</synopsis>
+		<syntax>
+			<parameter name="bridge">
+				<para>Unique ID of the bridge. Defaults to the bridge the calling channel is in.</para>
+			</parameter>
+		</syntax>
+		<see-also>
+			<ref type="application">AltStreamBridge</ref>
+		</see-also>
+	</application>
+	<manager name="AltStreamBulk" language="en_US">
+		<synopsis>
+			Starts AltStream on many channels with one set of options.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="Channels">
+				<para>Comma separated names of the channels to stream.</para>
+			</parameter>
+			<parameter name="ChannelPattern">
+				<para>Extended regular expression, every channel whose name matches is streamed
+				as well.</para>
+			</parameter>
+			<parameter name="WsServer" required="true">
+				<para>Endpoint or endpoints to stream to.</para>
+			</parameter>
+			<parameter name="Options">
+				<para>Options as for the <literal>AltStream</literal> application, parsed once
+				for all channels. <literal>^{X}</literal> in the <replaceable>r</replaceable> and
+				<replaceable>t</replaceable> file names is evaluated per channel as
+				<variable>X</variable>.</para>
+			</parameter>
+			<parameter name="Command">
+				<para>Command to run when each stream ends, evaluated per channel as for the
+				<literal>AltStream</literal> application.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Answers with a single response. For the Nth channel it carries
+			<literal>ChannelN</literal> and either <literal>AltStreamIDN</literal> or
+			<literal>ErrorN</literal>, followed by the <literal>Started</literal> and
+			<literal>Failed</literal> counts.</para>
+		</description>
+	</manager>
+	<manager name="StopAltStreamBulk" language="en_US">
+		<synopsis>
+			Stops many AltStreams at once.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="AltStreamIDs">
+				<para>Comma separated IDs of the AltStreams to stop.</para>
+			</parameter>
+			<parameter name="Channels">
+				<para>Comma separated channel names, every AltStream on them is stopped.</para>
+			</parameter>
+			<parameter name="ChannelPattern">
+				<para>Extended regular expression, every AltStream on a matching channel is stopped.</para>
+			</parameter>
+			<parameter name="WsServer">
+				<para>Every AltStream to this server is stopped.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>Answers with a single response listing the stopped streams as
+			<literal>AltStreamIDN</literal> and their number as <literal>Stopped</literal>.</para>
+		</description>
+	</manager>
+	<manager name="AltStreamBridge" language="en_US">
+		<synopsis>
+			Forks the audio of a whole bridge to a websocket server.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="BridgeUniqueid" required="true">
+				<para>The bridge to stream.</para>
+			</parameter>
+			<parameter name="WsServer" required="true">
+				<para>Endpoint or endpoints to stream to.</para>
+			</parameter>
+			<parameter name="Options">
+				<para>Options as for the <literal>AltStreamBridge</literal> application.</para>
+			</parameter>
+		</syntax>
+	</manager>
+	<manager name="StopAltStreamBridge" language="en_US">
+		<synopsis>
+			Stops every AltStreamBridge fork of a bridge.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="BridgeUniqueid" required="true">
+				<para>The bridge to stop streaming.</para>
+			</parameter>
+		</syntax>
+	</manager>
+	<manager name="AltStreamRedirect" language="en_US">
+		<synopsis>
+			Moves a live AltStream to other endpoints without a gap in the audio.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+			<parameter name="AltStreamID" required="true">
+				<para>The AltStream to move.</para>
+			</parameter>
+			<parameter name="WsServer" required="true">
+				<para>The endpoint or endpoints to move to, as given to <literal>AltStream</literal>.
+				With <literal>profile=name</literal> only the server of the profile is used, the
+				stream keeps its options.</para>
+			</parameter>
+		</syntax>
+		<description>
+			<para>The new endpoints are connected in the background while the stream keeps
+			sending to the old ones. Everything sent from the moment the redirect is picked up
+			is also kept, up to 500 messages, and replayed to the new endpoints once they are
+			connected. When they have caught up the stream moves over on a message boundary
+			and the old endpoints are sent what they have queued and closed. If no new endpoint
+			can be connected the stream stays where it is. The outcome is reported with the
+			<literal>AltStreamRedirect</literal> event.</para>
+		</description>
+	</manager>
+	<manager name="AltStreamUsage" language="en_US">
+		<synopsis>
+			Reports how many AltStreams run and how much audio they hold against the caps.
+		</synopsis>
+		<syntax>
+			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
+		</syntax>
+		<description>
+			<para>The response carries <literal>Streams</literal>, <literal>Buffered</literal> (bytes)
+			and <literal>Waiting</literal> (starts waiting for room) with the caps from the
+			<literal>[general]</literal> category of <filename>altstream.conf</filename>,
+			<literal>Admitted</literal> and <literal>Refused</literal> starts and
+			<literal>OverBudget</literal> messages dropped since the module loaded, then
+			<literal>ServerN</literal> and <literal>ServerStreamsN</literal> for every server
+			with streams and the number of them in <literal>Servers</literal>. A cap of 0 is none.
+			The tenants follow, then <literal>CpusetN</literal> (its CPU list),
+			<literal>CpusetNodeN</literal> (-1 when it has no single NUMA node),
+			<literal>CpusetStreamsN</literal> and <literal>CpusetStartedN</literal> (since the last
+			reload) for every cpuset stream threads are pinned to, as
+			<literal>altstream cpusets</literal> shows them, and their number in
+			<literal>Cpusets</literal>.</para>
+		</description>
+	</manager>
 	<manager name="AltStreamMute" language="en_US">
 		<synopsis>
 			Mute / unMute a AltStream session.
@@ -209,7 +690,11 @@
 		<syntax>
 			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
 			<parameter name="Channel" required="true">
-				<para>Used to specify the channel to mute.</para>
+				<para>Used to specify the channel to mute. Not needed when
+				<replaceable>AltStreamID</replaceable> is given.</para>
+			</parameter>
+			<parameter name="AltStreamID" required="false">
+				<para>Mute only this AltStream instead of every AltStream on the channel.</para>
 			</parameter>
 			<parameter name="Direction">
 				<para>Which part of the audio fork to mute:  read, write or both (from channel, to channel or both channels).</para>
@@ -266,7 +751,8 @@
 		<syntax>
 			<xi:include xpointer="xpointer(/docs/manager[@name='Login']/syntax/parameter[@name='ActionID'])" />
 			<parameter name="Channel" required="true">
-				<para>The name of the channel monitored.</para>
+				<para>The name of the channel monitored. Not needed when
+				<replaceable>AltStreamID</replaceable> is given.</para>
 			</parameter>
 			<parameter name="AltStreamID" required="false">
 				<para>If a valid ID is provided, then this command will stop only that specific
@@ -278,6 +764,149 @@
 			action.</para>
 		</description>
 	</manager>
+	<managerEvent language="en_US" name="AltStreamShm">
+		<managerEventInstance class="EVENT_FLAG_CALL">
+			<synopsis>Raised when an AltStream shared memory ring has been created.</synopsis>
+			<syntax>
+				<parameter name="Channel">
+					<para>The channel being streamed.</para>
+				</parameter>
+				<parameter name="Name">
+					<para>The name given in the <literal>shm:</literal> endpoint.</para>
+				</parameter>
+				<parameter name="Direction">
+					<para>The audiohook direction being streamed: in, out or both.</para>
+				</parameter>
+				<parameter name="Pid">
+					<para>The process id holding the ring.</para>
+				</parameter>
+				<parameter name="MemFd">
+					<para>The file descriptor of the memfd holding the ring.</para>
+				</parameter>
+				<parameter name="EventFd">
+					<para>The file descriptor of the eventfd signalled after every write.</para>
+				</parameter>
+				<parameter name="MemPath">
+					<para>Path other processes can open to map the ring.</para>
+				</parameter>
+				<parameter name="EventPath">
+					<para>Path other processes can open to wait on the eventfd.</para>
+				</parameter>
+				<parameter name="Size">
+					<para>Total size of the mapping in bytes.</para>
+				</parameter>
+			</syntax>
+		</managerEventInstance>
+	</managerEvent>
+	<managerEvent language="en_US" name="AltStreamRedirect">
+		<managerEventInstance class="EVENT_FLAG_CALL">
+			<synopsis>Raised when an AltStreamRedirect has finished.</synopsis>
+			<syntax>
+				<parameter name="Channel">
+					<para>The channel being streamed.</para>
+				</parameter>
+				<parameter name="AltStreamID">
+					<para>The AltStream that was redirected.</para>
+				</parameter>
+				<parameter name="WsServer">
+					<para>The endpoints the stream was to move to.</para>
+				</parameter>
+				<parameter name="Status">
+					<enumlist>
+						<enum name="Switched"><para>The stream moved and the old endpoints are closed.</para></enum>
+						<enum name="Failed"><para>The stream stays on its old endpoints.</para></enum>
+					</enumlist>
+				</parameter>
+				<parameter name="Replayed">
+					<para>Messages sent to the new endpoints from the backlog.</para>
+				</parameter>
+				<parameter name="Dropped">
+					<para>Messages that did not fit in the backlog and never reached the new endpoints.</para>
+				</parameter>
+			</syntax>
+		</managerEventInstance>
+	</managerEvent>
+	<managerEvent language="en_US" name="AltStreamQuality">
+		<managerEventInstance class="EVENT_FLAG_CALL">
+			<synopsis>Raised periodically with the captured audio levels of an AltStream.</synopsis>
+			<syntax>
+				<parameter name="Channel">
+					<para>The channel being streamed.</para>
+				</parameter>
+				<parameter name="Direction">
+					<para>The audio measured: in (heard from the channel) or out (sent to it).</para>
+				</parameter>
+				<parameter name="Interval">
+					<para>Seconds of audio the figures cover.</para>
+				</parameter>
+				<parameter name="Rms">
+					<para>RMS level in dBFS.</para>
+				</parameter>
+				<parameter name="Peak">
+					<para>Peak level in dBFS.</para>
+				</parameter>
+				<parameter name="Clipped">
+					<para>Samples at or near full scale.</para>
+				</parameter>
+				<parameter name="Silence">
+					<para>Fraction of 20 ms frames below -50 dBFS.</para>
+				</parameter>
+				<parameter name="LongestSilence">
+					<para>Longest run of silent frames in seconds.</para>
+				</parameter>
+				<parameter name="Dc">
+					<para>Mean sample value as a fraction of full scale.</para>
+				</parameter>
+				<parameter name="Snr">
+					<para>Estimated signal to noise ratio in dB, from the level of non-silent
+					frames against the level of silent ones.</para>
+				</parameter>
+			</syntax>
+		</managerEventInstance>
+	</managerEvent>
+	<managerEvent language="en_US" name="AltStreamTranscript">
+		<managerEventInstance class="EVENT_FLAG_CALL">
+			<synopsis>Raised when an utterance posted to an http:// endpoint has been transcribed.</synopsis>
+			<syntax>
+				<parameter name="Channel">
+					<para>The channel being streamed.</para>
+				</parameter>
+				<parameter name="Uniqueid">
+					<para>The unique ID of the channel.</para>
+				</parameter>
+				<parameter name="AltStreamID">
+					<para>The AltStream the utterance came from.</para>
+				</parameter>
+				<parameter name="Endpoint">
+					<para>The URL the utterance was posted to.</para>
+				</parameter>
+				<parameter name="Segment">
+					<para>Number of the utterance within the stream, counting from 1.</para>
+				</parameter>
+				<parameter name="Start">
+					<para>Seconds into the stream the utterance starts.</para>
+				</parameter>
+				<parameter name="Duration">
+					<para>Length of the utterance in seconds.</para>
+				</parameter>
+				<parameter name="Status">
+					<enumlist>
+						<enum name="Success"><para>The server answered with a 2xx status.</para></enum>
+						<enum name="Failed"><para>The upload failed, <literal>Text</literal> is empty.</para></enum>
+					</enumlist>
+				</parameter>
+				<parameter name="HttpCode">
+					<para>The HTTP status of the response, 0 when there was none.</para>
+				</parameter>
+				<parameter name="Latency">
+					<para>Seconds from the end of the utterance to the transcript, queueing included.</para>
+				</parameter>
+				<parameter name="Text">
+					<para>The transcript, with line breaks turned into spaces.</para>
+				</parameter>
+			</syntax>
+		</managerEventInstance>
+	</managerEvent>
 	<function name="ALTSTREAM" language="en_US">
 		<synopsis>
 			Retrieve data pertaining to specific instances of AltStream on a channel.
@@ -291,6 +920,34 @@
 				<para>The piece of data to retrieve from the AltStream.</para>
 				<enumlist>
 					<enum name="filename" />
+					<enum name="frames_sent" />
+					<enum name="frames_dropped" />
+					<enum name="bytes_sent" />
+					<enum name="rtt"><para>Round trip time of the last keepalive in milliseconds.</para></enum>
+					<enum name="srtt"><para>Smoothed keepalive round trip time in milliseconds.</para></enum>
+					<enum name="pong_timeouts"><para>Keepalives that went unanswered.</para></enum>
+					<enum name="compression_ratio"><para>Uncompressed bytes divided by compressed bytes.</para></enum>
+					<enum name="compression_cpu"><para>Thread CPU time spent compressing, in milliseconds.</para></enum>
+					<enum name="destinations"><para>Number of endpoints being streamed to.</para></enum>
+					<enum name="destinations_failed"><para>Endpoints that could not be reconnected.</para></enum>
+					<enum name="recorded_bytes"><para>Bytes handed to the <replaceable>r</replaceable> and <replaceable>t</replaceable> recordings.</para></enum>
+					<enum name="record_dropped_bytes"><para>Bytes left out of the recordings because the disk fell behind or failed.</para></enum>
+					<enum name="resent"><para>Messages sent again after reconnecting with the <replaceable>c</replaceable> option.</para></enum>
+					<enum name="resume_dropped"><para>Messages that left the resume window before the server acknowledged them.</para></enum>
+					<enum name="frames_paused"><para>Audio frames left out while the server had the stream paused.</para></enum>
+					<enum name="frames_silent"><para>Silent audio frames replaced by silence markers with the <replaceable>d</replaceable> option.</para></enum>
+					<enum name="frames_throttled"><para>Audio frames dropped because the tenant of the stream's profile ran out of audio budget.</para></enum>
+					<enum name="segments"><para>Utterances handed to the upload workers of an <literal>http://</literal> endpoint.</para></enum>
+					<enum name="segments_dropped"><para>Utterances left out because the upload queue was full.</para></enum>
+					<enum name="rms_in"><para>RMS level in dBFS since the stream started.
+					Every level key also comes with an <literal>_out</literal> suffix for the
+					audio sent to the channel.</para></enum>
+					<enum name="peak_in"><para>Peak level in dBFS.</para></enum>
+					<enum name="clipped_in"><para>Samples at or near full scale.</para></enum>
+					<enum name="silence_in"><para>Fraction of frames below -50 dBFS.</para></enum>
+					<enum name="longest_silence_in"><para>Longest run of silence in seconds.</para></enum>
+					<enum name="dc_in"><para>Mean sample value as a fraction of full scale.</para></enum>
+					<enum name="snr_in"><para>Estimated signal to noise ratio in dB.</para></enum>
 				</enumlist>
 			</parameter>
 		</syntax>
@@ -298,18 +955,473 @@
 
  ***/
 
+/* 20 ms at 8 kHz, scaled up for other rates */
 #define SAMPLES_PER_FRAME 160
+#define ALTSTREAM_DEFAULT_RATE 8000
+#define ALTSTREAM_DEFAULT_PTIME 20
+#define ALTSTREAM_MAX_PTIME 100
+#define ALTSTREAM_UNIX_PREFIX "unix:"
+#define ALTSTREAM_UNIX_MAX_PAYLOAD 0xFFFFFF
+/* a consumer that stops reading for this long is treated as a failed connection */
+#define ALTSTREAM_UNIX_SEND_TIMEOUT 5
+#define ALTSTREAM_SHM_PREFIX "shm:"
+#define ALTSTREAM_SHM_MAGIC 0x41535452 /* "ASTR" */
+#define ALTSTREAM_SHM_VERSION 1
+#define ALTSTREAM_SHM_DATA_SIZE (1024 * 1024)
+#define ALTSTREAM_SHM_OPCODE_PAD 0xFF
+#define ALTSTREAM_SHM_ALIGN(x) (((x) + 15) & ~((uint64_t) 15))
+#define ALTSTREAM_RTP_PREFIX "rtp://"
+#define ALTSTREAM_RTP_DEFAULT_PT 96
+#define ALTSTREAM_RTP_HEADER_SIZE 12
+/* keep packets below a typical ethernet MTU */
+#define ALTSTREAM_RTP_MAX_PAYLOAD 1400
+#define ALTSTREAM_HTTP_PREFIX "http://"
+#define ALTSTREAM_HTTPS_PREFIX "https://"
+#define ALTSTREAM_HTTP_WORKERS 8
+#define ALTSTREAM_HTTP_QUEUE 500
+/* seconds one upload may take, connecting included */
+#define ALTSTREAM_HTTP_TIMEOUT 60
+/* seconds to reach the server, a dead one should not hold a worker for the whole upload timeout */
+#define ALTSTREAM_HTTP_CONNECT_TIMEOUT 5
+#define ALTSTREAM_HTTP_MAX_RESPONSE 65536
+/* a frame above this dBFS RMS is speech */
+#define ALTSTREAM_VAD_LEVEL -40.0
+/* milliseconds kept from before the speech, of silence ending an utterance, of speech it needs and at most */
+#define ALTSTREAM_VAD_PREROLL 300
+#define ALTSTREAM_VAD_SILENCE 700
+#define ALTSTREAM_VAD_MIN_SPEECH 250
+#define ALTSTREAM_VAD_MAX 30000
+#define ALTSTREAM_PING_INTERVAL 5
+#define ALTSTREAM_PONG_TIMEOUT 5
+/* how often the connection is checked for incoming messages and dead peers */
+#define ALTSTREAM_SERVICE_INTERVAL_US 100000
+#define ALTSTREAM_DEFLATE_PROTOCOL "altstream-deflate"
+#define ALTSTREAM_DEFLATE_NCT_PROTOCOL "altstream-deflate-nct"
+/* milliseconds a websocket frame may wait for room in the socket buffer */
+#define ALTSTREAM_WS_WRITE_TIMEOUT 1000
+/* milliseconds of unacknowledged audio kept for resending on a resumed session */
+#define ALTSTREAM_RESUME_WINDOW 5000
+/* messages the resume window has room for before it grows */
+#define ALTSTREAM_RESUME_SLOTS 64
+/* milliseconds between silence markers while nothing but silence comes in */
+#define ALTSTREAM_SILENCE_KEEPALIVE 1000
+/* gains are applied in Q11 fixed point, which tops out just under +24 dB */
+#define ALTSTREAM_GAIN_SHIFT 11
+#define ALTSTREAM_GAIN_UNITY (1 << ALTSTREAM_GAIN_SHIFT)
+#define ALTSTREAM_GAIN_MIN_DB -48.0f
+#define ALTSTREAM_GAIN_MAX_DB 24.0f
+#define ALTSTREAM_AGC_TARGET_DB -20.0f
+#define ALTSTREAM_AGC_GATE_DB -55.0f
+#define ALTSTREAM_AGC_MIN_GAIN 0.25f
+#define ALTSTREAM_AGC_MAX_GAIN 15.8f
+/* per frame smoothing, back off quickly on loud audio and creep up slowly */
+#define ALTSTREAM_AGC_ATTACK 0.5f
+#define ALTSTREAM_AGC_RELEASE 0.05f
+/* filter taps per output sample when upsampling, scaled up by the decimation factor */
+#define ALTSTREAM_RESAMPLE_TAPS 32
+/* passband edge as a fraction of the lower Nyquist frequency */
+#define ALTSTREAM_RESAMPLE_ROLLOFF 0.9
+#define ALTSTREAM_RESAMPLE_KAISER_BETA 7.0
+/* Whisper front end: 25 ms windows every 10 ms at 16 kHz into 80 mel bins */
+#define ALTSTREAM_MEL_RATE 16000
+#define ALTSTREAM_MEL_N_FFT 400
+#define ALTSTREAM_MEL_HOP 160
+#define ALTSTREAM_MEL_BINS 80
+#define ALTSTREAM_MEL_SPECTRUM (ALTSTREAM_MEL_N_FFT / 2 + 1)
+/* the real transform runs as a complex one of half the size */
+#define ALTSTREAM_MEL_FFT_SIZE (ALTSTREAM_MEL_N_FFT / 2)
+#define ALTSTREAM_MEL_FFT_STAGES 4
+#define ALTSTREAM_MEL_Q 12
+/* largest difference from a double precision DFT the log-mel bins may have, in log10 units */
+#define ALTSTREAM_MEL_TOLERANCE 1e-3
+/* separates the endpoints of a fanned out stream */
+#define ALTSTREAM_DEST_SEPARATOR "|"
+#define ALTSTREAM_MAX_DESTS 8
+/* messages an endpoint may fall behind by before the oldest are dropped, a second of audio */
+#define ALTSTREAM_DEST_QUEUE 50
+/* messages kept for the new endpoints while a redirect connects, 10 s of 20 ms frames */
+#define ALTSTREAM_REDIRECT_BACKLOG 500
+/* r() and t() recordings: buffers handed to the writer thread, and how often a partial one is */
+#define ALTSTREAM_RECORD_BUFFERS 8
+#define ALTSTREAM_RECORD_BUFFER_SIZE (64 * 1024)
+#define ALTSTREAM_RECORD_ALIGN 4096
+#define ALTSTREAM_RECORD_FLUSH_MS 1000
+#define ALTSTREAM_WAV_HEADER_SIZE 44
+/* buckets of the module wide index of live streams */
+#define ALTSTREAM_REGISTRY_BUCKETS 563
+
+#define ALTSTREAM_CONFIG "altstream.conf"
+#define ALTSTREAM_PROFILE_PREFIX "profile="
+#define ALTSTREAM_PROFILE_BUCKETS 17
+/* stream thread placement: [general] of altstream.conf and where the NUMA nodes are described */
+#define ALTSTREAM_GENERAL "general"
+#define ALTSTREAM_MAX_CPUSETS 64
+#define ALTSTREAM_NUMA_SYSFS "/sys/devices/system/node"
+/* admission caps: servers counted on their own, how often a waiting start looks again */
+#define ALTSTREAM_USAGE_BUCKETS 31
+#define ALTSTREAM_ADMISSION_POLL_MS 100
+#define ALTSTREAM_TENANT_BUCKETS 17
+/* post process commands: workers, queue depth and how many may start per second */
+#define ALTSTREAM_JOB_WORKERS 4
+#define ALTSTREAM_JOB_QUEUE 1000
+#define ALTSTREAM_JOB_RATE 20
+#define ALTSTREAM_JOB_MAX_ARGS 64
+#define ALTSTREAM_JOB_SHELL_CHARS "|&;<>()$`\\\"'*?[]{}~#!\n"
+/* bridge streams: participants sent as tracks, how often membership is checked */
+#define ALTSTREAM_MAX_TRACKS 32
+#define ALTSTREAM_TRACK_HEADER 4
+#define ALTSTREAM_TRACK_SCAN_MS 1000
+/* channel variable telling a stream on a Recorder channel which bridge it belongs to */
+#define ALTSTREAM_BRIDGE_VAR "ALTSTREAM_BRIDGE"
+/* and the uniqueid of its half in the bridge, which is not a participant */
+#define ALTSTREAM_BRIDGE_PEER_VAR "ALTSTREAM_BRIDGE_PEER"
+/* samples at or above this magnitude count as clipped */
+#define ALTSTREAM_CLIP_LEVEL 32700
+/* frames with an RMS below this, about -50 dBFS, count as silent */
+#define ALTSTREAM_SILENCE_LEVEL 104
 #define get_volfactor(x) x ? ((x > 0) ? (1 << x) : ((1 << abs(x)) * -1)) : 0
 
 static const char *const app = "AltStream";
 
 static const char *const stop_app = "StopAltStream";
+static const char *const bridge_app = "AltStreamBridge";
+static const char *const stop_bridge_app = "StopAltStreamBridge";
+static const char *const altstream_track_spy_type = "AltStreamTrack";
 
 static const char *const altstream_spy_type = "AltStream";
 
+struct altstream;
+
+/*! \brief Polyphase rational resampler state for one stream */
+struct altstream_resampler {
+	unsigned int in_rate;
+	unsigned int out_rate;
+	unsigned int up;
+	unsigned int down;
+	/*! coefficients per phase, a multiple of 16 */
+	unsigned int taps;
+	/*! taps - 1 samples of history followed by the current input */
+	int16_t *buf;
+	size_t buf_len;
+	/*! next output position in the upsampled domain, relative to the first new input sample */
+	unsigned int pos;
+	/*! up phases of taps Q15 coefficients, each reversed to line up with the input window */
+	int16_t coeffs[0];
+};
+
+enum altstream_features {
+	ALTSTREAM_FEATURES_NONE,
+	ALTSTREAM_FEATURES_Q12,
+	ALTSTREAM_FEATURES_F32,
+};
+
+/*! \brief Log-mel front end state for one stream */
+struct altstream_mel {
+	enum altstream_features format;
+	/*! the last N_FFT samples, the next frame is due once it is full */
+	float samples[ALTSTREAM_MEL_N_FFT];
+	unsigned int fill;
+	/*! running maximum of log10 energy, Whisper clamps 8 below it */
+	float max;
+	float re[ALTSTREAM_MEL_FFT_SIZE];
+	float im[ALTSTREAM_MEL_FFT_SIZE];
+	float tmp_re[ALTSTREAM_MEL_FFT_SIZE];
+	float tmp_im[ALTSTREAM_MEL_FFT_SIZE];
+	float power[ALTSTREAM_MEL_SPECTRUM];
+	/*! encoded feature frames for the current chunk of audio */
+	char *out;
+	size_t out_len;
+};
+
+/*! \brief A message queued to every endpoint of a fanned out stream, reference counted */
+struct altstream_msg {
+	enum ast_websocket_opcode opcode;
+	uint64_t len;
+	char data[0];
+};
+
+/*! \brief A message kept for a resumed session, and how much audio it carries */
+struct altstream_resume_slot {
+	struct altstream_msg *msg;
+	unsigned int ms;
+};
+
+/*! \brief One endpoint of a fanned out stream */
+struct altstream_dest {
+	/*! connection to the endpoint, an altstream carrying transport state only */
+	struct altstream *conn;
+	pthread_t thread;
+	int started;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! ring of messages waiting to be sent */
+	struct altstream_msg *queue[ALTSTREAM_DEST_QUEUE];
+	unsigned int head;
+	unsigned int count;
+	int stop;
+	/*! gave up reconnecting */
+	int failed;
+	/*! connected before the sender started, by a redirect */
+	int connected;
+	unsigned int sent;
+	unsigned int dropped;
+	/*! audio left out while the server had the endpoint paused */
+	unsigned int skipped;
+};
+
+enum altstream_redirect_state {
+	/*! connecting to the new endpoints and replaying the backlog to them */
+	ALTSTREAM_REDIRECT_CONNECTING,
+	/*! caught up, the stream moves over with its next message */
+	ALTSTREAM_REDIRECT_READY,
+	/*! moved over, the old endpoints are being closed */
+	ALTSTREAM_REDIRECT_SWITCHED,
+	ALTSTREAM_REDIRECT_DONE,
+	ALTSTREAM_REDIRECT_FAILED,
+};
+
+/*! \brief A live stream moving to other endpoints, see AltStreamRedirect */
+struct altstream_redirect {
+	/*! the endpoints moved to, and once switched the ones moved away from */
+	char *wsserver;
+	/*! the new endpoints, connected and caught up by the redirect thread */
+	struct altstream_dest *dests[ALTSTREAM_MAX_DESTS];
+	int num_dests;
+	/*! the endpoints switched away from, closed by the redirect thread */
+	struct altstream_dest *old_dests[ALTSTREAM_MAX_DESTS];
+	int num_old_dests;
+	/*! the stream's own connection was switched away from */
+	int close_own;
+	pthread_t thread;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! ring of messages since the cut point, waiting to be replayed */
+	struct altstream_msg *backlog[ALTSTREAM_REDIRECT_BACKLOG];
+	unsigned int head;
+	unsigned int count;
+	unsigned int replayed;
+	unsigned int dropped;
+	enum altstream_redirect_state state;
+	int stop;
+};
+
+/*! \brief A local recording of one direction, written to disk by its own thread */
+struct altstream_recorder {
+	char *filename;
+	int fd;
+	int wav;
+	unsigned int rate;
+	/*! where the next batch goes, only touched by the writer */
+	off_t offset;
+	off_t data_start;
+	pthread_t thread;
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/*! ring of page aligned buffers, the stream thread fills the one after the full ones */
+	struct {
+		char *data;
+		size_t len;
+	} bufs[ALTSTREAM_RECORD_BUFFERS];
+	unsigned int head;
+	/*! full buffers, including the batch being written */
+	unsigned int count;
+	int stop;
+	/*! a write failed, the rest of the audio is dropped */
+	int failed;
+};
+
+/*! \brief One participant of a bridge stream sent as its own track */
+struct altstream_track {
+	unsigned int id;
+	struct ast_audiohook audiohook;
+	struct ast_channel *chan;
+	char uniqueid[AST_MAX_UNIQUEID];
+	/*! still in the bridge at the last scan */
+	int seen;
+};
+
+/*! \brief Level summary of one frame */
+struct altstream_levels {
+	uint64_t energy;
+	int64_t sum;
+	unsigned int peak;
+	unsigned int clipped;
+};
+
+/*! \brief Running audio quality figures of one direction */
+struct altstream_quality {
+	uint64_t samples;
+	uint64_t energy;
+	int64_t sum;
+	unsigned int peak;
+	uint64_t clipped;
+	unsigned int frames;
+	unsigned int silent_frames;
+	unsigned int silence_ms;
+	unsigned int longest_silence_ms;
+	/* energy of silent and of active frames, for the SNR estimate */
+	uint64_t noise_energy;
+	uint64_t noise_samples;
+	uint64_t active_energy;
+	uint64_t active_samples;
+};
+
+/*! \brief Header at the start of a shared memory ring, 64 bytes */
+struct altstream_shm_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t data_size;
+	uint32_t sample_rate;
+	uint32_t direction;
+	/*! total bytes ever written, the ring offset is write_pos % data_size */
+	uint64_t write_pos;
+	/*! sequence number of the last complete record */
+	uint64_t seq;
+	/*! CLOCK_MONOTONIC milliseconds of the last write */
+	uint64_t heartbeat;
+	uint32_t writer_pid;
+	/*! 1 while the writer is running, 0 once it has gone away */
+	uint32_t state;
+	uint32_t reserved[2];
+};
+
+/*! \brief Header of every record in the shared memory ring, 16 bytes */
+struct altstream_shm_record {
+	uint64_t seq;
+	uint32_t len;
+	uint16_t opcode;
+	uint16_t direction;
+};
+
+/*! \brief A way of getting frames from AltStream to the consumer */
+struct altstream_transport {
+	/*! name used in log messages */
+	const char *name;
+	/*! endpoint prefix selecting this transport, NULL for the default */
+	const char *prefix;
+	/*! open the connection, 0 on success */
+	int (*connect)(struct altstream *altstream);
+	/*! send a single message, 0 on success */
+	int (*write)(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len);
+	/*! close the connection if it is open */
+	int (*close)(struct altstream *altstream);
+	/*! optional, handle incoming messages and keepalives, non-zero if the peer is gone */
+	int (*service)(struct altstream *altstream);
+	/*! only 16 bit PCM gets through, no features, tracks or text messages */
+	int pcm_only;
+};
+
+/*! \brief Where the transcripts of an http:// endpoint go */
+enum altstream_transcripts {
+	ALTSTREAM_TRANSCRIPTS_AMI = (1 << 0),
+	ALTSTREAM_TRANSCRIPTS_VAR = (1 << 1),
+};
+
 struct altstream {
 	struct ast_audiohook audiohook;
+	const struct altstream_transport *transport;
 	struct ast_websocket *websocket;
+	int unix_fd;
+	int shm_fd;
+	int shm_event_fd;
+	struct altstream_shm_header *shm;
+	size_t shm_size;
+	/* frames are built and masked here instead of by the core websocket code */
+	int ws_direct;
+	unsigned char *ws_frame_buf;
+	size_t ws_frame_buf_len;
+	/* rate read from the audiohook and rate sent to the consumer */
+	unsigned int capture_rate;
+	unsigned int samp_rate;
+	/* milliseconds of audio per frame read from the audiohook */
+	unsigned int ptime;
+	struct altstream_resampler *resampler;
+	int16_t *resample_buf;
+	/* log-mel features are sent in place of PCM when set */
+	struct altstream_mel *mel;
+	/* CPUs the stream thread is pinned to, NULL when it may run anywhere */
+	struct altstream_cpuset *cpuset;
+	/* server the stream holds an admission slot for */
+	char *admitted;
+	/* tenant of its profile, whose audio budget the stream draws on */
+	struct altstream_tenant *tenant;
+	/* bridge this stream was started for by AltStreamBridge, and its participants */
+	char *bridge_id;
+	char *bridge_peer;
+	int tracks_enabled;
+	/* told the log participants are being left out */
+	int tracks_full;
+	struct altstream_track *tracks[ALTSTREAM_MAX_TRACKS];
+	int num_tracks;
+	unsigned int next_track;
+	uint64_t tracks_scanned;
+	char *track_buf;
+	size_t track_buf_len;
+	/* r() and t() recordings */
+	struct altstream_recorder *recorders[2];
+	/* our entry in the index of live streams */
+	struct altstream_entry *entry;
+	/* endpoints fed by this capture when more than one was given */
+	struct altstream_dest *dests[ALTSTREAM_MAX_DESTS];
+	int num_dests;
+	/* move to other endpoints in progress */
+	struct altstream_redirect *redirect;
+	/* levels since the last AltStreamQuality event, in and out */
+	struct altstream_quality interval_quality[2];
+	unsigned int quality_interval;
+	uint64_t quality_last;
+	/* linear gain applied to every frame, 1.0 when unused */
+	float gain;
+	int agc;
+	float agc_target;
+	float agc_gain;
+	int ping_interval;
+	int pong_timeout;
+	uint64_t last_service;
+	uint64_t ping_sent;
+	int ping_outstanding;
+	int compression_level;
+	int compression_no_takeover;
+	/* the server accepted compression on the current connection */
+	int compressing;
+	/* session resume: binary messages are numbered and kept until the server acknowledges them */
+	char session[AST_UUID_STR_LEN];
+	/* milliseconds of audio kept, whatever the packet time or codec of the messages */
+	unsigned int resume_window;
+	struct altstream_resume_slot *resume_buf;
+	unsigned int resume_size;
+	unsigned int resume_head;
+	unsigned int resume_count;
+	unsigned int resume_ms;
+	/* sequence number of the oldest kept message, and of the next one written */
+	uint64_t resume_seq;
+	uint64_t next_seq;
+	/* connected before, the next connect resumes the session */
+	int resuming;
+	/* the stream a fanned out endpoint belongs to, NULL for the stream itself */
+	struct altstream *parent;
+	/* the endpoint a fanned out connection sends for, its stop ends reconnecting */
+	struct altstream_dest *dest;
+	/* the server asked for a break, its audio is left out until it asks to resume */
+	int paused;
+	/* silent frames are replaced by markers, the samples left out and not reported yet */
+	unsigned int silence_keepalive;
+	uint64_t silence_samples;
+#ifdef HAVE_ZLIB
+	z_stream deflate;
+	int deflate_ready;
+	unsigned char *deflate_buf;
+	size_t deflate_buf_len;
+#endif
+	int rtp_fd;
+	int rtp_pt;
+	uint16_t rtp_seq;
+	uint32_t rtp_ts;
+	uint32_t rtp_ssrc;
+	/* utterance being cut for an http:// endpoint, and where its transcripts go */
+	struct altstream_segmenter *segmenter;
+	unsigned int transcripts;
 	char *wsserver;
 	struct ast_tls_config *tls_cfg;
 	char *tcert;
@@ -337,13 +1449,17 @@ struct altstream {
 };
 
 enum altstream_flags {
+	MUXFLAG_TRANSCRIPTS = (1 << 0),
 	MUXFLAG_APPEND = (1 << 1),
 	MUXFLAG_BRIDGED = (1 << 2),
 	MUXFLAG_VOLUME = (1 << 3),
 	MUXFLAG_READVOLUME = (1 << 4),
 	MUXFLAG_WRITEVOLUME = (1 << 5),
+	MUXFLAG_READ = (1 << 6),
+	MUXFLAG_WRITE = (1 << 7),
 	MUXFLAG_COMBINED = (1 << 8),
 	MUXFLAG_UID = (1 << 9),
+	MUXFLAG_RECONNECTION_ATTEMPTS = (1 << 10),
 	MUXFLAG_BEEP = (1 << 11),
 	MUXFLAG_BEEP_START = (1 << 12),
 	MUXFLAG_BEEP_STOP = (1 << 13),
@@ -351,7 +1467,19 @@ enum altstream_flags {
 	MUXFLAG_DIRECTION = (1 << 15),
 	MUXFLAG_TLS = (1 << 16),
 	MUXFLAG_RECONNECTION_TIMEOUT = (1 << 17),
-	MUXFLAG_RECONNECTION_ATTEMPTS = (1 << 17),
+	MUXFLAG_PING_INTERVAL = (1 << 18),
+	MUXFLAG_PONG_TIMEOUT = (1 << 19),
+	MUXFLAG_COMPRESSION = (1 << 20),
+	MUXFLAG_COMPRESSION_NO_TAKEOVER = (1 << 21),
+	MUXFLAG_GAIN = (1 << 22),
+	MUXFLAG_AGC = (1 << 23),
+	MUXFLAG_SAMPLE_RATE = (1 << 24),
+	MUXFLAG_FEATURES = (1 << 25),
+	MUXFLAG_QUALITY_INTERVAL = (1 << 26),
+	MUXFLAG_TRACKS = (1 << 27),
+	MUXFLAG_PTIME = (1 << 28),
+	MUXFLAG_RESUME = (1 << 29),
+	MUXFLAG_SILENCE = (1 << 30),
 };
 
 enum altstream_args {
@@ -365,9 +1493,75 @@ enum altstream_args {
 	OPT_ARG_TLS,
 	OPT_ARG_RECONNECTION_TIMEOUT,
 	OPT_ARG_RECONNECTION_ATTEMPTS,
+	OPT_ARG_PING_INTERVAL,
+	OPT_ARG_PONG_TIMEOUT,
+	OPT_ARG_COMPRESSION,
+	OPT_ARG_GAIN,
+	OPT_ARG_AGC,
+	OPT_ARG_SAMPLE_RATE,
+	OPT_ARG_FEATURES,
+	OPT_ARG_QUALITY_INTERVAL,
+	OPT_ARG_READNAME,
+	OPT_ARG_WRITENAME,
+	OPT_ARG_PTIME,
+	OPT_ARG_RESUME,
+	OPT_ARG_SILENCE,
+	OPT_ARG_TRANSCRIPTS,
 	OPT_ARG_ARRAY_SIZE,           /* Always last element of the enum */
 };
 
+/*! \brief AltStream options parsed once, shared by every channel a bulk action starts */
+struct altstream_options {
+	struct ast_flags flags;
+	enum ast_audiohook_direction direction;
+	const char *tcert;
+	int reconn_timeout;
+	int reconn_attempts;
+	int ping_interval;
+	int pong_timeout;
+	int compression_level;
+	float gain_db;
+	int agc;
+	float agc_target_db;
+	unsigned int samp_rate;
+	unsigned int ptime;
+	/*! milliseconds of audio kept for a resumed session, 0 when off */
+	unsigned int resume_window;
+	/*! milliseconds between silence markers, 0 to send silence as audio */
+	unsigned int silence_keepalive;
+	/*! where the transcripts of an http:// endpoint go */
+	unsigned int transcripts;
+	enum altstream_features features;
+	unsigned int quality_interval;
+	unsigned int beep_interval;
+	int readvol;
+	int writevol;
+	const char *uid_channel_var;
+	const char *filename_read;
+	const char *filename_write;
+	/*! the option string the strings above point into */
+	char *buf;
+	/*! the altstream.conf profile these came from, kept until the stream has started */
+	struct altstream_profile *profile;
+	/*! refused at once at a cap instead of waiting queue_timeout, for AltStreamBulk */
+	int no_queue;
+};
+
+/*! \brief A named altstream.conf profile, compiled once at load or reload and only read after that */
+struct altstream_profile {
+	/*! the endpoint, or several separated by | */
+	char *wsserver;
+	/*! the option string the settings compile to, for dialplan options to add to */
+	char *options;
+	/*! post process command for streams started without one */
+	char *command;
+	/*! tenant whose limits its streams count against, NULL for none */
+	char *tenant;
+	/*! the compiled options, handed out as they are when nothing is added */
+	struct altstream_options o;
+	char name[0];
+};
+
 AST_APP_OPTIONS(altstream_opts, {
 	AST_APP_OPTION('a', MUXFLAG_APPEND),
 	AST_APP_OPTION('b', MUXFLAG_BRIDGED),
@@ -382,7 +1576,23 @@ AST_APP_OPTIONS(altstream_opts, {
 	AST_APP_OPTION_ARG('D', MUXFLAG_DIRECTION, OPT_ARG_DIRECTION),
 	AST_APP_OPTION_ARG('T', MUXFLAG_TLS, OPT_ARG_TLS),
 	AST_APP_OPTION_ARG('R', MUXFLAG_RECONNECTION_TIMEOUT, OPT_ARG_RECONNECTION_TIMEOUT),
-	AST_APP_OPTION_ARG('r', MUXFLAG_RECONNECTION_ATTEMPTS, OPT_ARG_RECONNECTION_ATTEMPTS),
+	AST_APP_OPTION_ARG('n', MUXFLAG_RECONNECTION_ATTEMPTS, OPT_ARG_RECONNECTION_ATTEMPTS),
+	AST_APP_OPTION_ARG('r', MUXFLAG_READ, OPT_ARG_READNAME),
+	AST_APP_OPTION_ARG('t', MUXFLAG_WRITE, OPT_ARG_WRITENAME),
+	AST_APP_OPTION_ARG('k', MUXFLAG_PING_INTERVAL, OPT_ARG_PING_INTERVAL),
+	AST_APP_OPTION_ARG('K', MUXFLAG_PONG_TIMEOUT, OPT_ARG_PONG_TIMEOUT),
+	AST_APP_OPTION_ARG('z', MUXFLAG_COMPRESSION, OPT_ARG_COMPRESSION),
+	AST_APP_OPTION('Z', MUXFLAG_COMPRESSION_NO_TAKEOVER),
+	AST_APP_OPTION_ARG('G', MUXFLAG_GAIN, OPT_ARG_GAIN),
+	AST_APP_OPTION_ARG('A', MUXFLAG_AGC, OPT_ARG_AGC),
+	AST_APP_OPTION_ARG('s', MUXFLAG_SAMPLE_RATE, OPT_ARG_SAMPLE_RATE),
+	AST_APP_OPTION_ARG('M', MUXFLAG_FEATURES, OPT_ARG_FEATURES),
+	AST_APP_OPTION_ARG('q', MUXFLAG_QUALITY_INTERVAL, OPT_ARG_QUALITY_INTERVAL),
+	AST_APP_OPTION('e', MUXFLAG_TRACKS),
+	AST_APP_OPTION_ARG('f', MUXFLAG_PTIME, OPT_ARG_PTIME),
+	AST_APP_OPTION_ARG('c', MUXFLAG_RESUME, OPT_ARG_RESUME),
+	AST_APP_OPTION_ARG('d', MUXFLAG_SILENCE, OPT_ARG_SILENCE),
+	AST_APP_OPTION_ARG('h', MUXFLAG_TRANSCRIPTS, OPT_ARG_TRANSCRIPTS),
 });
 
 struct altstream_ds {
@@ -398,26 +1608,163 @@ struct altstream_ds {
 	char *wsserver;
 	char *beep_id;
 	struct ast_tls_config *tls_cfg;
+
+	/* updated by the stream thread only */
+	unsigned int frames_sent;
+	unsigned int frames_dropped;
+	uint64_t bytes_sent;
+	/* keepalive round trip times in microseconds */
+	unsigned int rtt;
+	unsigned int srtt;
+	unsigned int pong_timeouts;
+	/* message bytes before and after compression */
+	uint64_t compress_in;
+	uint64_t compress_out;
+	uint64_t compress_cpu_us;
+	/* captured audio levels, in and out */
+	struct altstream_quality quality[2];
+	unsigned int destinations;
+	unsigned int destinations_failed;
+	/* r() and t() recordings */
+	char *filename_read;
+	char *filename_write;
+	uint64_t recorded_bytes;
+	uint64_t record_dropped_bytes;
+	/* messages sent again on resumed sessions, and ones that fell out of the window unacknowledged */
+	uint64_t resent;
+	uint64_t resume_dropped;
+	/* endpoints AltStreamRedirect asked to move to, until the stream thread picks them up */
+	char *redirect;
+	/* a redirect is waiting or in progress */
+	int redirecting;
+	/* packet time and codec the server asked for, until the stream thread picks them up */
+	unsigned int control_ptime;
+	int codec_change;
+	enum altstream_features codec;
+	/* audio frames left out while the server had the stream paused */
+	unsigned int frames_paused;
+	/* silent audio frames replaced by silence markers */
+	unsigned int frames_silent;
+	/* audio frames dropped because the tenant used up its audio budget */
+	unsigned int frames_throttled;
+	/* utterances queued for upload to an http:// endpoint, and ones the full queue left out */
+	unsigned int segments;
+	unsigned int segments_dropped;
 };
 
 static void altstream_ds_destroy(void *data)
 {
 	struct altstream_ds *altstream_ds = data;
 
+	/* the strings stay until the stream is out of the index, see altstream_ds_strings_free */
 	ast_mutex_lock(&altstream_ds->lock);
 	altstream_ds->audiohook = NULL;
 	altstream_ds->destruction_ok = 1;
-	ast_free(altstream_ds->wsserver);
-	ast_free(altstream_ds->beep_id);
 	ast_cond_signal(&altstream_ds->destruction_condition);
 	ast_mutex_unlock(&altstream_ds->lock);
 }
 
+/*! \brief Free the strings of the statistics, once no index entry can lead to them */
+static void altstream_ds_strings_free(struct altstream_ds *altstream_ds)
+{
+	ast_free(altstream_ds->wsserver);
+	altstream_ds->wsserver = NULL;
+	ast_free(altstream_ds->beep_id);
+	altstream_ds->beep_id = NULL;
+	ast_free(altstream_ds->filename_read);
+	altstream_ds->filename_read = NULL;
+	ast_free(altstream_ds->filename_write);
+	altstream_ds->filename_write = NULL;
+	ast_free(altstream_ds->redirect);
+	altstream_ds->redirect = NULL;
+}
+
 static const struct ast_datastore_info altstream_ds_info = {
 	.type = "altstream",
 	.destroy = altstream_ds_destroy,
 };
 
+/*! \brief A live stream in the module wide index, found by ID, channel or server without channel locks */
+struct altstream_entry {
+	char id[32];
+	char uniqueid[AST_MAX_UNIQUEID];
+	char channel[AST_CHANNEL_NAME];
+	struct timeval started;
+	/*! statistics of the stream, NULL once it has ended. Protected by the object lock */
+	struct altstream_ds *ds;
+	char wsserver[0];
+};
+
+/*! \brief Hash and compare functions of an index of live streams on a string field */
+#define ALTSTREAM_REGISTRY_INDEX(field) \
+static int altstream_entry_##field##_hash(const void *obj, const int flags) \
+{ \
+	const struct altstream_entry *entry = obj; \
+ \
+	switch (flags & OBJ_SEARCH_MASK) { \
+	case OBJ_SEARCH_KEY: \
+		return ast_str_hash(obj); \
+	case OBJ_SEARCH_OBJECT: \
+		return ast_str_hash(entry->field); \
+	default: \
+		ast_assert(0); \
+		return 0; \
+	} \
+} \
+ \
+static int altstream_entry_##field##_cmp(void *obj, void *arg, int flags) \
+{ \
+	const struct altstream_entry *left = obj; \
+	const struct altstream_entry *right = arg; \
+	const char *key = arg; \
+ \
+	switch (flags & OBJ_SEARCH_MASK) { \
+	case OBJ_SEARCH_OBJECT: \
+		key = right->field; \
+		/* fall through */ \
+	case OBJ_SEARCH_KEY: \
+		return strcmp(left->field, key) ? 0 : CMP_MATCH; \
+	default: \
+		return 0; \
+	} \
+}
+
+ALTSTREAM_REGISTRY_INDEX(id)
+ALTSTREAM_REGISTRY_INDEX(uniqueid)
+ALTSTREAM_REGISTRY_INDEX(wsserver)
+
+/* every live stream, by ID, by channel unique ID and by server */
+static struct ao2_container *altstream_streams;
+static struct ao2_container *altstream_streams_by_channel;
+static struct ao2_container *altstream_streams_by_server;
+
+static int altstream_registry_init(void)
+{
+	altstream_streams = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT,
+		ALTSTREAM_REGISTRY_BUCKETS, altstream_entry_id_hash, NULL, altstream_entry_id_cmp);
+	altstream_streams_by_channel = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_ALLOW,
+		ALTSTREAM_REGISTRY_BUCKETS, altstream_entry_uniqueid_hash, NULL, altstream_entry_uniqueid_cmp);
+	altstream_streams_by_server = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_ALLOW,
+		ALTSTREAM_REGISTRY_BUCKETS, altstream_entry_wsserver_hash, NULL, altstream_entry_wsserver_cmp);
+
+	return altstream_streams && altstream_streams_by_channel && altstream_streams_by_server ? 0 : -1;
+}
+
+static void altstream_registry_cleanup(void)
+{
+	ao2_cleanup(altstream_streams);
+	altstream_streams = NULL;
+	ao2_cleanup(altstream_streams_by_channel);
+	altstream_streams_by_channel = NULL;
+	ao2_cleanup(altstream_streams_by_server);
+	altstream_streams_by_server = NULL;
+}
+
+static struct altstream_entry *altstream_registry_find(const char *id)
+{
+	return ao2_find(altstream_streams, id, OBJ_SEARCH_KEY);
+}
+
 static void destroy_monitor_audiohook(struct altstream *altstream)
 {
 	if (altstream->altstream_ds) {
@@ -441,369 +1788,5527 @@ static int start_altstream(struct ast_channel *chan, struct ast_audiohook *audio
 	return ast_audiohook_attach(chan, audiohook);
 }
 
-static int altstream_ws_close(struct altstream *altstream)
+static void altstream_mask_scalar(unsigned char *dst, const unsigned char *src, size_t len, uint32_t mask)
 {
-	int ret;
-	ast_verb(2, "[AltStream] Closing websocket connection\n");
-	if (altstream->websocket) {
-		ast_verb(2, "[AltStream] Calling ast_websocket_close\n");
-		ret = ast_websocket_close(altstream->websocket, 1011);
-		return ret;
-	}
+	uint64_t mask64 = ((uint64_t) mask << 32) | mask;
+	const unsigned char *key = (const unsigned char *) &mask;
+	size_t i = 0;
 
-	ast_verb(2, "[AltStream] No reference to websocket, can't close connection\n");
-	return -1;
+	for (; i + 8 <= len; i += 8) {
+		uint64_t chunk;
+
+		memcpy(&chunk, src + i, sizeof(chunk));
+		chunk ^= mask64;
+		memcpy(dst + i, &chunk, sizeof(chunk));
+	}
+	for (; i < len; i++) {
+		dst[i] = src[i] ^ key[i & 3];
+	}
 }
 
+#ifdef ALTSTREAM_X86_KERNELS
+__attribute__((target("sse2")))
+static void altstream_mask_sse2(unsigned char *dst, const unsigned char *src, size_t len, uint32_t mask)
+{
+	__m128i key = _mm_set1_epi32(mask);
+	size_t i = 0;
 
-/*
-	1 = success
-	0 = fail
-*/
-static enum ast_websocket_result altstream_ws_connect(struct altstream *altstream)
+	for (; i + 16 <= len; i += 16) {
+		__m128i chunk = _mm_loadu_si128((const __m128i *) (src + i));
+
+		_mm_storeu_si128((__m128i *) (dst + i), _mm_xor_si128(chunk, key));
+	}
+	/* every chunk is a multiple of 4 bytes, so the key is still in phase */
+	altstream_mask_scalar(dst + i, src + i, len - i, mask);
+}
+
+__attribute__((target("avx2")))
+static void altstream_mask_avx2(unsigned char *dst, const unsigned char *src, size_t len, uint32_t mask)
 {
-	enum ast_websocket_result result;
+	__m256i key = _mm256_set1_epi32(mask);
+	size_t i = 0;
 
-	if (altstream->websocket) {
-		ast_verb(2, "<%s> [AltStream] (%s) Reconnecting to websocket server at: %s\n",
-			ast_channel_name(altstream->autochan->chan),
-			altstream->direction_string,
-			altstream->altstream_ds->wsserver);
+	for (; i + 64 <= len; i += 64) {
+		__m256i lo = _mm256_loadu_si256((const __m256i *) (src + i));
+		__m256i hi = _mm256_loadu_si256((const __m256i *) (src + i + 32));
 
-		// close the websocket connection before reconnecting
-		altstream_ws_close(altstream);
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(lo, key));
+		_mm256_storeu_si256((__m256i *) (dst + i + 32), _mm256_xor_si256(hi, key));
+	}
+	for (; i + 32 <= len; i += 32) {
+		__m256i chunk = _mm256_loadu_si256((const __m256i *) (src + i));
 
-		ao2_cleanup(altstream->websocket);
+		_mm256_storeu_si256((__m256i *) (dst + i), _mm256_xor_si256(chunk, key));
 	}
-	else {
-		ast_verb(2, "<%s> [AltStream] (%s) Connecting to websocket server at: %s\n",
-			ast_channel_name(altstream->autochan->chan),
-			altstream->direction_string,
-			altstream->altstream_ds->wsserver);
+	altstream_mask_sse2(dst + i, src + i, len - i, mask);
+}
+#endif
+
+static void altstream_gain_scalar(int16_t *samples, size_t count, int16_t gain)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		int32_t v = (samples[i] * gain + (1 << (ALTSTREAM_GAIN_SHIFT - 1))) >> ALTSTREAM_GAIN_SHIFT;
+
+		samples[i] = v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v);
 	}
+}
 
-	// Check if we're running with TLS
-	if (altstream->has_tls == 1) {
-		ast_verb(2, "<%s> [AltStream] (%s) Creating to WebSocket server with TLS mode enabled\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-		altstream->websocket = ast_websocket_client_create(altstream->altstream_ds->wsserver, "echo", altstream->tls_cfg, &result);
-	} else {
-		ast_verb(2, "<%s> [AltStream] (%s) Creating to WebSocket server without TLS\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-		altstream->websocket = ast_websocket_client_create(altstream->altstream_ds->wsserver, "echo", NULL, &result);
+#ifdef ALTSTREAM_X86_KERNELS
+__attribute__((target("sse2")))
+static void altstream_gain_sse2(int16_t *samples, size_t count, int16_t gain)
+{
+	__m128i g = _mm_set1_epi16(gain);
+	__m128i round = _mm_set1_epi32(1 << (ALTSTREAM_GAIN_SHIFT - 1));
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (samples + i));
+		__m128i lo = _mm_mullo_epi16(x, g);
+		__m128i hi = _mm_mulhi_epi16(x, g);
+		__m128i p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), ALTSTREAM_GAIN_SHIFT);
+		__m128i p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), ALTSTREAM_GAIN_SHIFT);
+
+		/* the pack saturates to 16 bits */
+		_mm_storeu_si128((__m128i *) (samples + i), _mm_packs_epi32(p0, p1));
 	}
+	altstream_gain_scalar(samples + i, count - i, gain);
+}
 
-	return result;
+__attribute__((target("avx2")))
+static void altstream_gain_avx2(int16_t *samples, size_t count, int16_t gain)
+{
+	__m256i g = _mm256_set1_epi16(gain);
+	__m256i round = _mm256_set1_epi32(1 << (ALTSTREAM_GAIN_SHIFT - 1));
+	size_t i = 0;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (samples + i));
+		__m256i lo = _mm256_mullo_epi16(x, g);
+		__m256i hi = _mm256_mulhi_epi16(x, g);
+		/* unpack and pack both work per 128 bit lane, so the sample order survives */
+		__m256i p0 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpacklo_epi16(lo, hi), round), ALTSTREAM_GAIN_SHIFT);
+		__m256i p1 = _mm256_srai_epi32(_mm256_add_epi32(_mm256_unpackhi_epi16(lo, hi), round), ALTSTREAM_GAIN_SHIFT);
+
+		_mm256_storeu_si256((__m256i *) (samples + i), _mm256_packs_epi32(p0, p1));
+	}
+	altstream_gain_sse2(samples + i, count - i, gain);
 }
+#endif
 
-/*
-	reconn_status
-	0 = OK
-	1 = FAILED
-*/
-static int altstream_start_reconnecting(struct altstream *altstream)
+/*! \brief Sum of squared samples */
+static uint64_t altstream_energy_scalar(const int16_t *samples, size_t count)
 {
-	int counter= 0;
-	int status = 0;
-	int timeout = altstream->reconnection_timeout;
-	int attempts = altstream->reconnection_attempts;
-	int last_attempt = 0;
-	int now;
-	int delta;
-	int result;
+	uint64_t sum = 0;
+	size_t i;
 
-	while (counter < attempts) {
-		now = (int)time(NULL);
-		delta = now - last_attempt;
+	for (i = 0; i < count; i++) {
+		sum += (int32_t) samples[i] * samples[i];
+	}
 
-		// small check to see if we should keep waiting on the reconnection. This uses the
-		// reconnection_timeout variable configured in the dialplan
-		if (last_attempt != 0 && delta <= timeout) {
-			// keep waiting
-			continue;
-		}
+	return sum;
+}
 
-		// try to reconnect
-		result = altstream_ws_connect(altstream);
-		if (result == WS_OK) {
-			status = 0;
-			last_attempt = 0;
-			break;
-		}
+#ifdef ALTSTREAM_X86_KERNELS
+__attribute__((target("sse2")))
+static uint64_t altstream_energy_sse2(const int16_t *samples, size_t count)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i acc = _mm_setzero_si128();
+	uint64_t lanes[2];
+	size_t i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (samples + i));
+		/* a pair of squares still fits in 32 unsigned bits, widen before summing */
+		__m128i sq = _mm_madd_epi16(x, x);
+
+		acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(sq, zero));
+		acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(sq, zero));
+	}
+	_mm_storeu_si128((__m128i *) lanes, acc);
 
-		// reconnection failed...
-		// update our counter with the last reconnection attempt
-		last_attempt=(int)time(NULL);
+	return lanes[0] + lanes[1] + altstream_energy_scalar(samples + i, count - i);
+}
 
-		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Reconnection failed... trying again in %d seconds. %d attempts remaining reconn_now %d reconn_last_attempt %d\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, timeout, (attempts-counter), now, last_attempt);
+__attribute__((target("avx2")))
+static uint64_t altstream_energy_avx2(const int16_t *samples, size_t count)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i acc = _mm256_setzero_si256();
+	uint64_t lanes[4];
+	size_t i = 0;
 
-		counter ++;
-		status = 1;
+	for (; i + 16 <= count; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (samples + i));
+		__m256i sq = _mm256_madd_epi16(x, x);
+
+		acc = _mm256_add_epi64(acc, _mm256_unpacklo_epi32(sq, zero));
+		acc = _mm256_add_epi64(acc, _mm256_unpackhi_epi32(sq, zero));
 	}
+	_mm256_storeu_si256((__m256i *) lanes, acc);
 
-	return status;
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + altstream_energy_sse2(samples + i, count - i);
 }
+#endif
 
-static void altstream_free(struct altstream *altstream)
+/*! \brief Energy, sum, peak and clipped samples of a frame in one pass, \a count below 2^18 */
+static void altstream_analyze_scalar(const int16_t *samples, size_t count, struct altstream_levels *levels)
 {
-	if (altstream) {
-		if (altstream->altstream_ds) {
-			ast_mutex_destroy(&altstream->altstream_ds->lock);
-			ast_cond_destroy(&altstream->altstream_ds->destruction_condition);
-			ast_free(altstream->altstream_ds);
-		}
+	size_t i;
 
-		ast_free(altstream->name);
-		ast_free(altstream->post_process);
-		ast_free(altstream->wsserver);
+	memset(levels, 0, sizeof(*levels));
+	for (i = 0; i < count; i++) {
+		int32_t v = samples[i];
+		unsigned int a = MIN(abs(v), INT16_MAX);
 
-		altstream_ws_close(altstream);
+		levels->energy += (uint32_t) (v * v);
+		levels->sum += v;
+		levels->peak = MAX(levels->peak, a);
+		levels->clipped += a >= ALTSTREAM_CLIP_LEVEL;
+	}
+}
 
-		/* clean stringfields */
-		ast_string_field_free_memory(altstream);
+#ifdef ALTSTREAM_X86_KERNELS
+__attribute__((target("sse2")))
+static void altstream_analyze_sse2(const int16_t *samples, size_t count, struct altstream_levels *levels)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i ones = _mm_set1_epi16(1);
+	__m128i limit = _mm_set1_epi16(ALTSTREAM_CLIP_LEVEL - 1);
+	__m128i energy = _mm_setzero_si128();
+	__m128i sum = _mm_setzero_si128();
+	__m128i peak = _mm_setzero_si128();
+	__m128i clipped = _mm_setzero_si128();
+	struct altstream_levels tail;
+	uint64_t energy_lanes[2];
+	int32_t sum_lanes[4];
+	int16_t lanes[8];
+	size_t i = 0;
+	int k;
+
+	for (; i + 8 <= count; i += 8) {
+		__m128i x = _mm_loadu_si128((const __m128i *) (samples + i));
+		__m128i sq = _mm_madd_epi16(x, x);
+		/* saturating negate keeps |-32768| at 32767 */
+		__m128i a = _mm_max_epi16(x, _mm_subs_epi16(zero, x));
+
+		energy = _mm_add_epi64(energy, _mm_unpacklo_epi32(sq, zero));
+		energy = _mm_add_epi64(energy, _mm_unpackhi_epi32(sq, zero));
+		sum = _mm_add_epi32(sum, _mm_madd_epi16(x, ones));
+		peak = _mm_max_epi16(peak, a);
+		/* the compare gives -1 per clipped lane */
+		clipped = _mm_sub_epi16(clipped, _mm_cmpgt_epi16(a, limit));
+	}
 
-		ast_free(altstream);
+	altstream_analyze_scalar(samples + i, count - i, &tail);
+	_mm_storeu_si128((__m128i *) energy_lanes, energy);
+	_mm_storeu_si128((__m128i *) sum_lanes, sum);
+	levels->energy = energy_lanes[0] + energy_lanes[1] + tail.energy;
+	levels->sum = (int64_t) sum_lanes[0] + sum_lanes[1] + sum_lanes[2] + sum_lanes[3] + tail.sum;
+	levels->peak = tail.peak;
+	levels->clipped = tail.clipped;
+	_mm_storeu_si128((__m128i *) lanes, peak);
+	for (k = 0; k < 8; k++) {
+		levels->peak = MAX(levels->peak, lanes[k]);
+	}
+	_mm_storeu_si128((__m128i *) lanes, clipped);
+	for (k = 0; k < 8; k++) {
+		levels->clipped += (uint16_t) lanes[k];
 	}
 }
 
+__attribute__((target("avx2")))
+static void altstream_analyze_avx2(const int16_t *samples, size_t count, struct altstream_levels *levels)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i ones = _mm256_set1_epi16(1);
+	__m256i limit = _mm256_set1_epi16(ALTSTREAM_CLIP_LEVEL - 1);
+	__m256i energy = _mm256_setzero_si256();
+	__m256i sum = _mm256_setzero_si256();
+	__m256i peak = _mm256_setzero_si256();
+	__m256i clipped = _mm256_setzero_si256();
+	struct altstream_levels tail;
+	uint64_t energy_lanes[4];
+	int32_t sum_lanes[8];
+	int16_t lanes[16];
+	size_t i = 0;
+	int k;
+
+	for (; i + 16 <= count; i += 16) {
+		__m256i x = _mm256_loadu_si256((const __m256i *) (samples + i));
+		__m256i sq = _mm256_madd_epi16(x, x);
+		__m256i a = _mm256_max_epi16(x, _mm256_subs_epi16(zero, x));
+
+		energy = _mm256_add_epi64(energy, _mm256_unpacklo_epi32(sq, zero));
+		energy = _mm256_add_epi64(energy, _mm256_unpackhi_epi32(sq, zero));
+		sum = _mm256_add_epi32(sum, _mm256_madd_epi16(x, ones));
+		peak = _mm256_max_epi16(peak, a);
+		clipped = _mm256_sub_epi16(clipped, _mm256_cmpgt_epi16(a, limit));
+	}
 
+	altstream_analyze_scalar(samples + i, count - i, &tail);
+	_mm256_storeu_si256((__m256i *) energy_lanes, energy);
+	_mm256_storeu_si256((__m256i *) sum_lanes, sum);
+	levels->energy = energy_lanes[0] + energy_lanes[1] + energy_lanes[2] + energy_lanes[3] + tail.energy;
+	levels->sum = tail.sum;
+	for (k = 0; k < 8; k++) {
+		levels->sum += sum_lanes[k];
+	}
+	levels->peak = tail.peak;
+	levels->clipped = tail.clipped;
+	_mm256_storeu_si256((__m256i *) lanes, peak);
+	for (k = 0; k < 16; k++) {
+		levels->peak = MAX(levels->peak, lanes[k]);
+	}
+	_mm256_storeu_si256((__m256i *) lanes, clipped);
+	for (k = 0; k < 16; k++) {
+		levels->clipped += (uint16_t) lanes[k];
+	}
+}
+#endif
 
-static void *altstream_thread(void *obj)
+/*! \brief Dot product of \a count samples with Q15 coefficients, \a count a multiple of 16 */
+static int32_t altstream_dot_scalar(const int16_t *samples, const int16_t *coeffs, size_t count)
 {
-	struct altstream *altstream = obj;
-	struct ast_format *format_slin;
-	char *channel_name_cleanup;
-	enum ast_websocket_result result;
-	int frames_sent = 0;
-	int reconn_status;
+	int32_t sum = 0;
+	size_t i;
 
-	/* Keep callid association before any log messages */
-	if (altstream->callid) {
-		ast_verb(2, "<%s> [AltStream] (%s) Keeping Call-ID Association\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-		ast_callid_threadassoc_add(altstream->callid);
+	for (i = 0; i < count; i++) {
+		sum += samples[i] * coeffs[i];
 	}
 
-	result = altstream_ws_connect(altstream);
-	if (result != WS_OK) {
-		ast_log(LOG_ERROR, "<%s> Could not connect to websocket server: %s\n", ast_channel_name(altstream->autochan->chan), altstream->altstream_ds->wsserver);
+	return sum;
+}
 
-		ast_test_suite_event_notify("ALTSTREAM_END", "Ws server: %s\r\n", altstream->wsserver);
+#ifdef ALTSTREAM_X86_KERNELS
+__attribute__((target("sse2")))
+static int32_t altstream_dot_sse2(const int16_t *samples, const int16_t *coeffs, size_t count)
+{
+	__m128i acc = _mm_setzero_si128();
+	size_t i;
 
-		/* kill the audiohook */
-		destroy_monitor_audiohook(altstream);
-		ast_autochan_destroy(altstream->autochan);
+	for (i = 0; i + 8 <= count; i += 8) {
+		acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_loadu_si128((const __m128i *) (samples + i)),
+			_mm_loadu_si128((const __m128i *) (coeffs + i))));
+	}
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+	acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
 
-		/* We specifically don't do altstream_free(altstream) here because the automatic datastore cleanup will get it */
+	return _mm_cvtsi128_si32(acc) + altstream_dot_scalar(samples + i, coeffs + i, count - i);
+}
 
-		ast_module_unref(ast_module_info->self);
+__attribute__((target("avx2")))
+static int32_t altstream_dot_avx2(const int16_t *samples, const int16_t *coeffs, size_t count)
+{
+	__m256i acc = _mm256_setzero_si256();
+	__m128i sum;
+	size_t i;
 
-		return 0;
+	for (i = 0; i + 16 <= count; i += 16) {
+		acc = _mm256_add_epi32(acc, _mm256_madd_epi16(_mm256_loadu_si256((const __m256i *) (samples + i)),
+			_mm256_loadu_si256((const __m256i *) (coeffs + i))));
 	}
+	sum = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+	sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
 
-	ast_verb(2, "<%s> [AltStream] (%s) Begin AltStream Recording %s\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->name);
+	return _mm_cvtsi128_si32(sum) + altstream_dot_scalar(samples + i, coeffs + i, count - i);
+}
+#endif
 
-	//fs = &altstream->altstream_ds->fs;
+/*!
+ * \brief One radix pass of a Stockham autosort FFT on split complex data
+ *
+ * Butterfly t reads x[t + r * n / radix] and writes y[(t / ns) * ns * radix + t % ns + q * ns],
+ * so runs of t inside one group are contiguous on both sides and can be done
+ * a vector at a time. \a T is float or a GCC vector of floats; every lane does
+ * exactly the operations the scalar version does, in the same order, and with
+ * contraction off all versions give bit identical results.
+ */
+#define ALTSTREAM_FFT_STAGE(suffix, T) \
+static void altstream_fft_stage_##suffix(const float *xr, const float *xi, float *yr, float *yi, \
+	const float *twr, const float *twi, unsigned int n, unsigned int radix, unsigned int ns) \
+{ \
+	unsigned int stride = n / radix; \
+	unsigned int width = sizeof(T) / sizeof(float); \
+	unsigned int t, r, q; \
+\
+	if (ns % width || stride % width) { \
+		altstream_fft_stage_scalar(xr, xi, yr, yi, twr, twi, n, radix, ns); \
+		return; \
+	} \
+\
+	for (t = 0; t < stride; t += width) { \
+		T vr[5], vi[5], ur[5], ui[5], wr, wi, tr; \
+		unsigned int out = (t / ns) * ns * radix + t % ns; \
+\
+		for (r = 0; r < radix; r++) { \
+			memcpy(&vr[r], xr + t + r * stride, sizeof(T)); \
+			memcpy(&vi[r], xi + t + r * stride, sizeof(T)); \
+		} \
+		for (r = 1; r < radix; r++) { \
+			memcpy(&wr, twr + (r - 1) * stride + t, sizeof(T)); \
+			memcpy(&wi, twi + (r - 1) * stride + t, sizeof(T)); \
+			tr = vr[r] * wr - vi[r] * wi; \
+			vi[r] = vr[r] * wi + vi[r] * wr; \
+			vr[r] = tr; \
+		} \
+		if (radix == 2) { \
+			ur[0] = vr[0] + vr[1]; \
+			ui[0] = vi[0] + vi[1]; \
+			ur[1] = vr[0] - vr[1]; \
+			ui[1] = vi[0] - vi[1]; \
+		} else if (radix == 4) { \
+			T ar = vr[0] + vr[2], ai = vi[0] + vi[2]; \
+			T br = vr[0] - vr[2], bi = vi[0] - vi[2]; \
+			T cr = vr[1] + vr[3], ci = vi[1] + vi[3]; \
+			T dr = vr[1] - vr[3], di = vi[1] - vi[3]; \
+\
+			ur[0] = ar + cr; \
+			ui[0] = ai + ci; \
+			ur[1] = br + di; \
+			ui[1] = bi - dr; \
+			ur[2] = ar - cr; \
+			ui[2] = ai - ci; \
+			ur[3] = br - di; \
+			ui[3] = bi + dr; \
+		} else { \
+			for (q = 0; q < radix; q++) { \
+				ur[q] = vr[0]; \
+				ui[q] = vi[0]; \
+				for (r = 1; r < radix; r++) { \
+					unsigned int k = (r * q) % radix; \
+\
+					ur[q] = ur[q] + (vr[r] * altstream_fft_radix5_re[k] - vi[r] * altstream_fft_radix5_im[k]); \
+					ui[q] = ui[q] + (vr[r] * altstream_fft_radix5_im[k] + vi[r] * altstream_fft_radix5_re[k]); \
+				} \
+			} \
+		} \
+		for (q = 0; q < radix; q++) { \
+			memcpy(yr + out + q * ns, &ur[q], sizeof(T)); \
+			memcpy(yi + out + q * ns, &ui[q], sizeof(T)); \
+		} \
+	} \
+}
 
-	ast_mutex_lock(&altstream->altstream_ds->lock);
-	format_slin = ast_format_cache_get_slin_by_rate(altstream->altstream_ds->samp_rate);
+/*
+ * The log-mel arithmetic must round the same way in every kernel and in every build,
+ * so no multiply and add is contracted into an FMA whatever -ffp-contract says.
+ */
+#if defined(__clang__)
+#define ALTSTREAM_FP_EXACT_BEGIN _Pragma("clang fp contract(off)")
+#define ALTSTREAM_FP_EXACT_END _Pragma("clang fp contract(on)")
+#elif defined(__GNUC__)
+#define ALTSTREAM_FP_EXACT_BEGIN _Pragma("GCC push_options") _Pragma("GCC optimize(\"fp-contract=off\")")
+#define ALTSTREAM_FP_EXACT_END _Pragma("GCC pop_options")
+#else
+#define ALTSTREAM_FP_EXACT_BEGIN
+#define ALTSTREAM_FP_EXACT_END
+#endif
 
-	ast_mutex_unlock(&altstream->altstream_ds->lock);
+/* exp(-2 pi i k / 5) */
+static const float altstream_fft_radix5_re[5] = {
+	1.0f, 0.309016994f, -0.809016994f, -0.809016994f, 0.309016994f,
+};
+static const float altstream_fft_radix5_im[5] = {
+	0.0f, -0.951056516f, -0.587785252f, 0.587785252f, 0.951056516f,
+};
 
-	/* The audiohook must enter and exit the loop locked */
-	ast_audiohook_lock(&altstream->audiohook);
+ALTSTREAM_FP_EXACT_BEGIN
+static void altstream_fft_stage_scalar(const float *xr, const float *xi, float *yr, float *yi,
+	const float *twr, const float *twi, unsigned int n, unsigned int radix, unsigned int ns);
+ALTSTREAM_FFT_STAGE(scalar, float)
 
-	while (altstream->audiohook.status == AST_AUDIOHOOK_STATUS_RUNNING) {
-		// ast_verb(2, "<%s> [AltStream] (%s) Reading Audio Hook frame...\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-		struct ast_frame *fr = ast_audiohook_read_frame(&altstream->audiohook, SAMPLES_PER_FRAME, altstream->direction, format_slin);
+#ifdef ALTSTREAM_X86_KERNELS
+typedef float altstream_v4f __attribute__((vector_size(16)));
+typedef float altstream_v8f __attribute__((vector_size(32)));
 
-		if (!fr) {
-			ast_audiohook_trigger_wait(&altstream->audiohook);
+__attribute__((target("sse2")))
+ALTSTREAM_FFT_STAGE(sse2, altstream_v4f)
 
-			if (altstream->audiohook.status != AST_AUDIOHOOK_STATUS_RUNNING) {
-				ast_verb(2, "<%s> [AltStream] (%s) AST_AUDIOHOOK_STATUS_RUNNING = 0\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-				break;
-			}
+__attribute__((target("avx2")))
+ALTSTREAM_FFT_STAGE(avx2, altstream_v8f)
+#endif
+ALTSTREAM_FP_EXACT_END
+
+/*! \brief One implementation of every vectorized kernel */
+struct altstream_kernels {
+	const char *name;
+	/*! non-zero when the CPU can run it */
+	int (*supported)(void);
+	/*! XOR \a len bytes of \a src with the 4 byte websocket \a mask into \a dst */
+	void (*mask)(unsigned char *dst, const unsigned char *src, size_t len, uint32_t mask);
+	/*! multiply by a Q11 \a gain with 16 bit saturation */
+	void (*gain)(int16_t *samples, size_t count, int16_t gain);
+	/*! sum of squared samples */
+	uint64_t (*energy)(const int16_t *samples, size_t count);
+	/*! energy, DC sum, peak and clipping of a frame */
+	void (*analyze)(const int16_t *samples, size_t count, struct altstream_levels *levels);
+	/*! dot product of samples with Q15 filter coefficients */
+	int32_t (*dot)(const int16_t *samples, const int16_t *coeffs, size_t count);
+	/*! one radix 2, 4 or 5 pass of the log-mel FFT */
+	void (*fft_stage)(const float *xr, const float *xi, float *yr, float *yi,
+		const float *twr, const float *twi, unsigned int n, unsigned int radix, unsigned int ns);
+};
 
-			continue;
-		}
+static int altstream_cpu_always(void)
+{
+	return 1;
+}
 
-		/* audiohook lock is not required for the next block.
-		 * Unlock it, but remember to lock it before looping or exiting */
-		ast_audiohook_unlock(&altstream->audiohook);
-		struct ast_frame *cur;
+#ifdef ALTSTREAM_X86_KERNELS
+static int altstream_cpu_sse2(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
 
-		//ast_mutex_lock(&altstream->altstream_ds->lock);
-		for (cur = fr; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
-			// ast_verb(2, "<%s> sending audio frame to websocket...\n", ast_channel_name(altstream->autochan->chan));
-			// ast_mutex_lock(&altstream->altstream_ds->lock);
+static int altstream_cpu_avx2(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+#endif
 
-			if (ast_websocket_write(altstream->websocket, AST_WEBSOCKET_OPCODE_BINARY, cur->data.ptr, cur->datalen)) {
+/* fastest last */
+static const struct altstream_kernels altstream_kernel_sets[] = {
+	{
+		.name = "scalar",
+		.supported = altstream_cpu_always,
+		.mask = altstream_mask_scalar,
+		.gain = altstream_gain_scalar,
+		.energy = altstream_energy_scalar,
+		.analyze = altstream_analyze_scalar,
+		.dot = altstream_dot_scalar,
+		.fft_stage = altstream_fft_stage_scalar,
+	},
+#ifdef ALTSTREAM_X86_KERNELS
+	{
+		.name = "sse2",
+		.supported = altstream_cpu_sse2,
+		.mask = altstream_mask_sse2,
+		.gain = altstream_gain_sse2,
+		.energy = altstream_energy_sse2,
+		.analyze = altstream_analyze_sse2,
+		.dot = altstream_dot_sse2,
+		.fft_stage = altstream_fft_stage_sse2,
+	},
+	{
+		.name = "avx2",
+		.supported = altstream_cpu_avx2,
+		.mask = altstream_mask_avx2,
+		.gain = altstream_gain_avx2,
+		.energy = altstream_energy_avx2,
+		.analyze = altstream_analyze_avx2,
+		.dot = altstream_dot_avx2,
+		.fft_stage = altstream_fft_stage_avx2,
+	},
+#endif
+};
 
-				ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Could not write to websocket.  Reconnecting...\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-				reconn_status = altstream_start_reconnecting(altstream);
+static const struct altstream_kernels *altstream_kernels = &altstream_kernel_sets[0];
 
-				if (reconn_status == 1) {
-					altstream->websocket = NULL;
-					altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
-					break;
-				}
+static float altstream_db_to_linear(float db)
+{
+	return powf(10.0f, db / 20.0f);
+}
 
-				/* re-send the last frame */
-				if (ast_websocket_write(altstream->websocket, AST_WEBSOCKET_OPCODE_BINARY, cur->data.ptr, cur->datalen)) {
-					ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Could not re-write to websocket.  Complete Failure.\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+/*! \brief Run the gain stage and automatic gain control over one frame */
+static void altstream_apply_gain(struct altstream *altstream, int16_t *samples, size_t count)
+{
+	float gain = altstream->gain;
+	long gain_q;
 
-					altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
-					break;
-				}
-			}
+	if (altstream->agc && count) {
+		float rms = sqrtf((float) altstream_kernels->energy(samples, count) / count);
+
+		/* leave the gain alone in pauses so noise is not pumped up */
+		if (rms > 32768.0f * altstream_db_to_linear(ALTSTREAM_AGC_GATE_DB)) {
+			float desired = altstream->agc_target / rms;
 
-			frames_sent++;
+			desired = MAX(ALTSTREAM_AGC_MIN_GAIN, MIN(ALTSTREAM_AGC_MAX_GAIN, desired));
+			altstream->agc_gain += (desired - altstream->agc_gain)
+				* (desired < altstream->agc_gain ? ALTSTREAM_AGC_ATTACK : ALTSTREAM_AGC_RELEASE);
 		}
+		gain *= altstream->agc_gain;
+	}
 
-		//ast_mutex_unlock(&altstream->altstream_ds->lock);
-		//
+	gain_q = lrintf(gain * ALTSTREAM_GAIN_UNITY);
+	gain_q = MAX(0, MIN(INT16_MAX, gain_q));
+	if (gain_q == ALTSTREAM_GAIN_UNITY) {
+		return;
+	}
 
-		/* All done! free it. */
-		if (fr) {
-			ast_frame_free(fr, 0);
+	altstream_kernels->gain(samples, count, gain_q);
+}
+
+static const unsigned int altstream_rates[] = { 8000, 16000, 24000, 32000, 48000 };
+
+static int altstream_rate_supported(unsigned int rate)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(altstream_rates); i++) {
+		if (altstream_rates[i] == rate) {
+			return 1;
 		}
+	}
 
-		fr = NULL;
+	return 0;
+}
 
-		ast_audiohook_lock(&altstream->audiohook);
+static unsigned int altstream_gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+
+		a = b;
+		b = t;
 	}
 
-	ast_audiohook_unlock(&altstream->audiohook);
+	return a;
+}
 
-	if (ast_test_flag(altstream, MUXFLAG_BEEP_STOP)) {
-		ast_autochan_channel_lock(altstream->autochan);
-		ast_stream_and_wait(altstream->autochan->chan, "beep", "");
-		ast_autochan_channel_unlock(altstream->autochan);
+static double altstream_bessel_i0(double x)
+{
+	double sum = 1.0;
+	double term = 1.0;
+	int k;
+
+	for (k = 1; k < 64; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12) {
+			break;
+		}
 	}
 
-	channel_name_cleanup = ast_strdupa(ast_channel_name(altstream->autochan->chan));
+	return sum;
+}
 
-	ast_autochan_destroy(altstream->autochan);
+static void altstream_resampler_free(struct altstream_resampler *rs)
+{
+	if (rs) {
+		ast_free(rs->buf);
+		ast_free(rs);
+	}
+}
 
-	/* Datastore cleanup.  close the filestream and wait for ds destruction */
-	ast_mutex_lock(&altstream->altstream_ds->lock);
-	if (!altstream->altstream_ds->destruction_ok) {
-		ast_cond_wait(&altstream->altstream_ds->destruction_condition, &altstream->altstream_ds->lock);
+/*! \brief Kaiser windowed sinc lowpass split into one Q15 filter per phase */
+static struct altstream_resampler *altstream_resampler_alloc(unsigned int in_rate, unsigned int out_rate)
+{
+	struct altstream_resampler *rs;
+	unsigned int g = altstream_gcd(in_rate, out_rate);
+	unsigned int up = out_rate / g;
+	unsigned int down = in_rate / g;
+	unsigned int factor = MAX(up, down);
+	unsigned int taps = (ALTSTREAM_RESAMPLE_TAPS * factor / up + 15) & ~15;
+	unsigned int length = taps * up;
+	double cutoff = ALTSTREAM_RESAMPLE_ROLLOFF * 0.5 / factor;
+	double center = (length - 1) / 2.0;
+	double i0_beta = altstream_bessel_i0(ALTSTREAM_RESAMPLE_KAISER_BETA);
+	double *h;
+	unsigned int n, p, w;
+
+	rs = ast_calloc(1, sizeof(*rs) + length * sizeof(int16_t));
+	h = ast_malloc(length * sizeof(*h));
+	if (!rs || !h) {
+		ast_free(rs);
+		ast_free(h);
+		return NULL;
 	}
-	ast_mutex_unlock(&altstream->altstream_ds->lock);
 
-	/* kill the audiohook */
-	destroy_monitor_audiohook(altstream);
+	rs->in_rate = in_rate;
+	rs->out_rate = out_rate;
+	rs->up = up;
+	rs->down = down;
+	rs->taps = taps;
 
-	ast_verb(2, "<%s> [AltStream] (%s) Finished processing audiohook. Frames sent = %d\n", channel_name_cleanup, altstream->direction_string, frames_sent);
-	ast_verb(2, "<%s> [AltStream] (%s) Post Process\n", channel_name_cleanup, altstream->direction_string);
+	for (n = 0; n < length; n++) {
+		double x = n - center;
+		double r = 2.0 * x / (length - 1);
+		double sinc = x ? sin(2.0 * M_PI * cutoff * x) / (M_PI * x) : 2.0 * cutoff;
 
-	if (altstream->post_process) {
-		ast_verb(2, "<%s> [AltStream] (%s) Executing [%s]\n", channel_name_cleanup, altstream->direction_string, altstream->post_process);
-		ast_safe_system(altstream->post_process);
+		h[n] = sinc * altstream_bessel_i0(ALTSTREAM_RESAMPLE_KAISER_BETA * sqrt(MAX(0.0, 1.0 - r * r))) / i0_beta;
 	}
 
-	// altstream->name
-
-	ast_verb(2, "<%s> [AltStream] (%s) End AltStream Recording to: %s\n", channel_name_cleanup, altstream->direction_string, altstream->wsserver);
-	ast_test_suite_event_notify("ALTSTREAM_END", "Ws server: %s\r\n", altstream->wsserver);
+	for (p = 0; p < up; p++) {
+		int16_t *coeffs = rs->coeffs + p * taps;
+		double sum = 0;
+		int total = 0;
+		unsigned int peak = 0;
 
-	/* free any altstream memory */
-	altstream_free(altstream);
+		for (w = 0; w < taps; w++) {
+			sum += h[p + (taps - 1 - w) * up];
+		}
+		/* every phase gets exactly unity gain at DC, rounding error goes to the peak */
+		for (w = 0; w < taps; w++) {
+			long c = lrint(h[p + (taps - 1 - w) * up] / sum * 32768.0);
+
+			coeffs[w] = MAX(INT16_MIN, MIN(INT16_MAX, c));
+			total += coeffs[w];
+			if (abs(coeffs[w]) > abs(coeffs[peak])) {
+				peak = w;
+			}
+		}
+		coeffs[peak] += 32768 - total;
+	}
+	ast_free(h);
 
-	ast_module_unref(ast_module_info->self);
+	return rs;
+}
 
-	return NULL;
+/*! \brief Largest number of samples \a count input samples can produce */
+static size_t altstream_resample_max_output(const struct altstream_resampler *rs, size_t count)
+{
+	return count * rs->up / rs->down + 2;
 }
 
-static int setup_altstream_ds(struct altstream *altstream, struct ast_channel *chan, char **datastore_id, const char *beep_id)
+/*! \brief Resample \a count samples, returns the number of samples written to \a out */
+static size_t altstream_resample_with(struct altstream_resampler *rs, const struct altstream_kernels *kernels,
+	const int16_t *in, size_t count, int16_t *out)
 {
-	struct ast_datastore *datastore = NULL;
-	struct altstream_ds *altstream_ds;
+	size_t history = rs->taps - 1;
+	size_t produced = 0;
+	size_t i;
 
-	if (!(altstream_ds = ast_calloc(1, sizeof(*altstream_ds)))) {
-		return -1;
-	}
+	if (history + count > rs->buf_len) {
+		int16_t *buf = ast_realloc(rs->buf, (history + count) * sizeof(*buf));
 
-	if (ast_asprintf(datastore_id, "%p", altstream_ds) == -1) {
-		ast_log(LOG_ERROR, "Failed to allocate memory for AltStream ID.\n");
-		ast_free(altstream_ds);
-		return -1;
+		if (!buf) {
+			return 0;
+		}
+		if (!rs->buf) {
+			memset(buf, 0, history * sizeof(*buf));
+		}
+		rs->buf = buf;
+		rs->buf_len = history + count;
 	}
+	memcpy(rs->buf + history, in, count * sizeof(*in));
 
-	ast_mutex_init(&altstream_ds->lock);
-	ast_cond_init(&altstream_ds->destruction_condition, NULL);
+	/* the window for input sample i starts taps - 1 samples before it */
+	while ((i = rs->pos / rs->up) < count) {
+		int32_t v = kernels->dot(rs->buf + i, rs->coeffs + (rs->pos % rs->up) * rs->taps, rs->taps);
 
-	if (!(datastore = ast_datastore_alloc(&altstream_ds_info, *datastore_id))) {
-		ast_mutex_destroy(&altstream_ds->lock);
-		ast_cond_destroy(&altstream_ds->destruction_condition);
-		ast_free(altstream_ds);
-		return -1;
+		v = (v + (1 << 14)) >> 15;
+		out[produced++] = MAX(INT16_MIN, MIN(INT16_MAX, v));
+		rs->pos += rs->down;
 	}
+	rs->pos -= count * rs->up;
+	memmove(rs->buf, rs->buf + count, history * sizeof(*rs->buf));
 
-	if (ast_test_flag(altstream, MUXFLAG_BEEP_START)) {
-		ast_autochan_channel_lock(altstream->autochan);
-		ast_stream_and_wait(altstream->autochan->chan, "beep", "");
-		ast_autochan_channel_unlock(altstream->autochan);
-	}
+	return produced;
+}
 
-	altstream_ds->samp_rate = 8000;
-	altstream_ds->audiohook = &altstream->audiohook;
-	altstream_ds->wsserver = ast_strdup(altstream->wsserver);
-	if (!ast_strlen_zero(beep_id)) {
-		altstream_ds->beep_id = ast_strdup(beep_id);
+static size_t altstream_resample(struct altstream_resampler *rs, const int16_t *in, size_t count, int16_t *out)
+{
+	return altstream_resample_with(rs, altstream_kernels, in, count, out);
+}
+
+/*! \brief Constant tables of the log-mel front end, filled once at load */
+static struct {
+	float window[ALTSTREAM_MEL_N_FFT];
+	/*! exp(-2 pi i k / N_FFT), recombines the half size transform */
+	float split_re[ALTSTREAM_MEL_SPECTRUM];
+	float split_im[ALTSTREAM_MEL_SPECTRUM];
+	/*! per stage, radix - 1 rows of FFT_SIZE / radix twiddles */
+	float twiddle_re[ALTSTREAM_MEL_FFT_STAGES][ALTSTREAM_MEL_FFT_SIZE];
+	float twiddle_im[ALTSTREAM_MEL_FFT_STAGES][ALTSTREAM_MEL_FFT_SIZE];
+	/*! mel filter i covers filter_len[i] bins from filter_start[i] */
+	unsigned int filter_start[ALTSTREAM_MEL_BINS];
+	unsigned int filter_len[ALTSTREAM_MEL_BINS];
+	unsigned int filter_offset[ALTSTREAM_MEL_BINS];
+	float filters[ALTSTREAM_MEL_BINS * ALTSTREAM_MEL_SPECTRUM];
+} altstream_mel_tables;
+
+/* 200 = 4 * 2 * 5 * 5, the small radices first so later stages run a vector at a time */
+static const unsigned int altstream_mel_radices[ALTSTREAM_MEL_FFT_STAGES] = { 4, 2, 5, 5 };
+
+static double altstream_hz_to_mel(double hz)
+{
+	/* Slaney: linear below 1 kHz, logarithmic above */
+	if (hz < 1000.0) {
+		return hz * 3.0 / 200.0;
 	}
-	datastore->data = altstream_ds;
 
-	ast_channel_lock(chan);
-	ast_channel_datastore_add(chan, datastore);
-	ast_channel_unlock(chan);
+	return 15.0 + log(hz / 1000.0) / (log(6.4) / 27.0);
+}
 
-	altstream->altstream_ds = altstream_ds;
-	return 0;
+static double altstream_mel_to_hz(double mel)
+{
+	if (mel < 15.0) {
+		return mel * 200.0 / 3.0;
+	}
+
+	return 1000.0 * exp((log(6.4) / 27.0) * (mel - 15.0));
 }
 
-static int launch_altstream_thread(
-	struct ast_channel *chan,
-	const char *wsserver, unsigned int flags,
-	enum ast_audiohook_direction direction,
-	char* tcert,
-	int reconn_timeout,
-	int reconn_attempts,
-	int readvol, int writevol,
-	const char *post_process,
-	const char *uid_channel_var,
-	const char *beep_id
-)
+static void altstream_mel_init(void)
 {
-	pthread_t thread;
-	struct altstream *altstream;
-	char postprocess2[1024] = "";
-	char *datastore_id = NULL;
+	double points[ALTSTREAM_MEL_BINS + 2];
+	double top = altstream_hz_to_mel(ALTSTREAM_MEL_RATE / 2.0);
+	unsigned int ns = 1;
+	unsigned int offset = 0;
+	unsigned int i, k, s, r;
+
+	for (i = 0; i < ALTSTREAM_MEL_N_FFT; i++) {
+		/* periodic Hann, as torch.hann_window */
+		altstream_mel_tables.window[i] = 0.5 - 0.5 * cos(2.0 * M_PI * i / ALTSTREAM_MEL_N_FFT);
+	}
+	for (k = 0; k < ALTSTREAM_MEL_SPECTRUM; k++) {
+		altstream_mel_tables.split_re[k] = cos(2.0 * M_PI * k / ALTSTREAM_MEL_N_FFT);
+		altstream_mel_tables.split_im[k] = -sin(2.0 * M_PI * k / ALTSTREAM_MEL_N_FFT);
+	}
 
-	postprocess2[0] = 0;
-	/* If a post process system command is given attach it to the structure */
-	if (!ast_strlen_zero(post_process)) {
-		char *p1, *p2;
+	for (s = 0; s < ALTSTREAM_MEL_FFT_STAGES; s++) {
+		unsigned int radix = altstream_mel_radices[s];
+		unsigned int stride = ALTSTREAM_MEL_FFT_SIZE / radix;
+		unsigned int t;
 
-		p1 = ast_strdupa(post_process);
-		for (p2 = p1; *p2; p2++) {
-			if (*p2 == '^' && *(p2 + 1) == '{') {
-				*p2 = '$';
+		for (r = 1; r < radix; r++) {
+			for (t = 0; t < stride; t++) {
+				double angle = -2.0 * M_PI * (t % ns) * r / (ns * radix);
+
+				altstream_mel_tables.twiddle_re[s][(r - 1) * stride + t] = cos(angle);
+				altstream_mel_tables.twiddle_im[s][(r - 1) * stride + t] = sin(angle);
 			}
 		}
-		ast_channel_lock(chan);
-		pbx_substitute_variables_helper(chan, p1, postprocess2, sizeof(postprocess2) - 1);
-		ast_channel_unlock(chan);
+		ns *= radix;
 	}
 
-	/* Pre-allocate altstream structure and spy */
-	if (!(altstream = ast_calloc(1, sizeof(*altstream)))) {
-		return -1;
+	/* librosa.filters.mel(sr=16000, n_fft=400, n_mels=80), as Whisper ships it */
+	for (i = 0; i < ALTSTREAM_MEL_BINS + 2; i++) {
+		points[i] = altstream_mel_to_hz(top * i / (ALTSTREAM_MEL_BINS + 1));
 	}
-
-	/* Now that the struct has been calloced, go ahead and initialize the string fields. */
-	if (ast_string_field_init(altstream, 512)) {
-		altstream_free(altstream);
-		return -1;
+	for (i = 0; i < ALTSTREAM_MEL_BINS; i++) {
+		double norm = 2.0 / (points[i + 2] - points[i]);
+		unsigned int first = 0, last = 0;
+
+		for (k = 0; k < ALTSTREAM_MEL_SPECTRUM; k++) {
+			double hz = (double) k * ALTSTREAM_MEL_RATE / ALTSTREAM_MEL_N_FFT;
+			double lower = (hz - points[i]) / (points[i + 1] - points[i]);
+			double upper = (points[i + 2] - hz) / (points[i + 2] - points[i + 1]);
+
+			if (MIN(lower, upper) > 0) {
+				if (!last) {
+					first = k;
+				}
+				last = k + 1;
+			}
+		}
+		altstream_mel_tables.filter_start[i] = first;
+		altstream_mel_tables.filter_len[i] = last - first;
+		altstream_mel_tables.filter_offset[i] = offset;
+		for (k = first; k < last; k++) {
+			double hz = (double) k * ALTSTREAM_MEL_RATE / ALTSTREAM_MEL_N_FFT;
+			double lower = (hz - points[i]) / (points[i + 1] - points[i]);
+			double upper = (points[i + 2] - hz) / (points[i + 2] - points[i + 1]);
+
+			altstream_mel_tables.filters[offset++] = MIN(lower, upper) * norm;
+		}
+	}
+}
+
+static struct altstream_mel *altstream_mel_alloc(enum altstream_features format)
+{
+	struct altstream_mel *mel = ast_calloc(1, sizeof(*mel));
+
+	if (!mel) {
+		return NULL;
+	}
+	mel->format = format;
+	/* the first window is centered on the first sample */
+	mel->fill = ALTSTREAM_MEL_N_FFT / 2;
+	mel->max = -INFINITY;
+
+	return mel;
+}
+
+static void altstream_mel_free(struct altstream_mel *mel)
+{
+	if (mel) {
+		ast_free(mel->out);
+		ast_free(mel);
+	}
+}
+
+static size_t altstream_mel_frame_size(const struct altstream_mel *mel)
+{
+	return ALTSTREAM_MEL_BINS * (mel->format == ALTSTREAM_FEATURES_F32 ? sizeof(float) : sizeof(int16_t));
+}
+
+ALTSTREAM_FP_EXACT_BEGIN
+/*! \brief Power spectrum of the current window into mel->power */
+static void altstream_mel_spectrum(struct altstream_mel *mel, const struct altstream_kernels *kernels)
+{
+	float *xr = mel->re, *xi = mel->im;
+	float *yr = mel->tmp_re, *yi = mel->tmp_im;
+	unsigned int ns = 1;
+	unsigned int n, s, k;
+
+	/* even samples in the real part, odd ones in the imaginary part */
+	for (n = 0; n < ALTSTREAM_MEL_FFT_SIZE; n++) {
+		xr[n] = mel->samples[2 * n] * altstream_mel_tables.window[2 * n];
+		xi[n] = mel->samples[2 * n + 1] * altstream_mel_tables.window[2 * n + 1];
+	}
+
+	for (s = 0; s < ALTSTREAM_MEL_FFT_STAGES; s++) {
+		float *swap;
+
+		kernels->fft_stage(xr, xi, yr, yi, altstream_mel_tables.twiddle_re[s], altstream_mel_tables.twiddle_im[s],
+			ALTSTREAM_MEL_FFT_SIZE, altstream_mel_radices[s], ns);
+		ns *= altstream_mel_radices[s];
+		swap = xr;
+		xr = yr;
+		yr = swap;
+		swap = xi;
+		xi = yi;
+		yi = swap;
+	}
+
+	/* X[k] = E[k] + W^k O[k] with E and O taken apart from Z[k] and conj(Z[N/2 - k]) */
+	for (k = 0; k < ALTSTREAM_MEL_SPECTRUM; k++) {
+		unsigned int a = k % ALTSTREAM_MEL_FFT_SIZE;
+		unsigned int b = (ALTSTREAM_MEL_FFT_SIZE - k) % ALTSTREAM_MEL_FFT_SIZE;
+		float even_re = 0.5f * (xr[a] + xr[b]);
+		float even_im = 0.5f * (xi[a] - xi[b]);
+		float odd_re = 0.5f * (xi[a] + xi[b]);
+		float odd_im = 0.5f * (xr[b] - xr[a]);
+		float re = even_re + (altstream_mel_tables.split_re[k] * odd_re - altstream_mel_tables.split_im[k] * odd_im);
+		float im = even_im + (altstream_mel_tables.split_re[k] * odd_im + altstream_mel_tables.split_im[k] * odd_re);
+
+		mel->power[k] = re * re + im * im;
+	}
+}
+
+/*! \brief Mel bins of the current window, log compressed but not yet clamped */
+static void altstream_mel_frame(struct altstream_mel *mel, const struct altstream_kernels *kernels, float *bins)
+{
+	unsigned int i, k;
+
+	altstream_mel_spectrum(mel, kernels);
+	for (i = 0; i < ALTSTREAM_MEL_BINS; i++) {
+		const float *filter = altstream_mel_tables.filters + altstream_mel_tables.filter_offset[i];
+		const float *power = mel->power + altstream_mel_tables.filter_start[i];
+		float sum = 0;
+
+		for (k = 0; k < altstream_mel_tables.filter_len[i]; k++) {
+			sum += filter[k] * power[k];
+		}
+		bins[i] = log10f(MAX(sum, 1e-10f));
+	}
+}
+ALTSTREAM_FP_EXACT_END
+
+/*!
+ * \brief Feed \a count samples, returns the number of bytes of feature frames in mel->out
+ *
+ * Samples are scaled to [-1, 1) like Whisper's input. Frames come out every hop once
+ * the window is full, so one 20 ms chunk of audio gives two frames.
+ */
+static size_t altstream_mel_process(struct altstream_mel *mel, const struct altstream_kernels *kernels,
+	const int16_t *in, size_t count)
+{
+	size_t frame_size = altstream_mel_frame_size(mel);
+	size_t needed = (count / ALTSTREAM_MEL_HOP + 1) * frame_size;
+	size_t produced = 0;
+	size_t i = 0;
+
+	if (needed > mel->out_len) {
+		char *out = ast_realloc(mel->out, needed);
+
+		if (!out) {
+			return 0;
+		}
+		mel->out = out;
+		mel->out_len = needed;
+	}
+
+	while (i < count) {
+		size_t take = MIN(count - i, ALTSTREAM_MEL_N_FFT - mel->fill);
+		float bins[ALTSTREAM_MEL_BINS];
+		unsigned int k;
+
+		for (k = 0; k < take; k++) {
+			mel->samples[mel->fill + k] = in[i + k] / 32768.0f;
+		}
+		mel->fill += take;
+		i += take;
+		if (mel->fill < ALTSTREAM_MEL_N_FFT) {
+			break;
+		}
+
+		altstream_mel_frame(mel, kernels, bins);
+		for (k = 0; k < ALTSTREAM_MEL_BINS; k++) {
+			mel->max = MAX(mel->max, bins[k]);
+		}
+		for (k = 0; k < ALTSTREAM_MEL_BINS; k++) {
+			float v = (MAX(bins[k], mel->max - 8.0f) + 4.0f) / 4.0f;
+
+			if (mel->format == ALTSTREAM_FEATURES_F32) {
+				memcpy(mel->out + produced + k * sizeof(float), &v, sizeof(v));
+			} else {
+				long q = lrintf(v * (1 << ALTSTREAM_MEL_Q));
+				int16_t s = MAX(INT16_MIN, MIN(INT16_MAX, q));
+
+				memcpy(mel->out + produced + k * sizeof(int16_t), &s, sizeof(s));
+			}
+		}
+		produced += frame_size;
+
+		memmove(mel->samples, mel->samples + ALTSTREAM_MEL_HOP, (ALTSTREAM_MEL_N_FFT - ALTSTREAM_MEL_HOP) * sizeof(float));
+		mel->fill = ALTSTREAM_MEL_N_FFT - ALTSTREAM_MEL_HOP;
+	}
+
+	return produced;
+}
+
+static uint64_t altstream_monotonic_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint64_t altstream_monotonic_ms(void)
+{
+	return altstream_monotonic_us() / 1000;
+}
+
+/*! \brief Streams running on one server, for max_streams_per_server */
+struct altstream_usage {
+	int streams;
+	char server[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(altstream_usage, server)
+AO2_STRING_FIELD_CMP_FN(altstream_usage, server)
+
+/*! \brief Caps on the streams and the audio they hold, from [general] of altstream.conf */
+static struct {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	/* 0 for no cap */
+	int max_streams;
+	int max_streams_per_server;
+	int max_buffered;
+	/* milliseconds a start waits for a slot before it is refused */
+	int queue_timeout;
+	int streams;
+	struct ao2_container *servers;
+	/* bytes in messages waiting for an endpoint, a redirect or an acknowledgement, updated atomically */
+	int buffered;
+	int waiting;
+	uint64_t admitted;
+	uint64_t refused;
+	/* messages not kept because of max_buffered, updated atomically */
+	int over_budget;
+} altstream_admission;
+
+static const char * const altstream_admission_settings[] = {
+	"max_streams",
+	"max_streams_per_server",
+	"max_buffered",
+	"queue_timeout",
+};
+
+static void altstream_msg_destroy(void *obj)
+{
+	struct altstream_msg *msg = obj;
+
+	ast_atomic_fetchadd_int(&altstream_admission.buffered, -(int) msg->len);
+}
+
+/*! \brief Charge \a len bytes of held audio to max_buffered, non-zero when that would go over it */
+static int altstream_buffered_take(uint64_t len)
+{
+	int max_buffered = altstream_admission.max_buffered;
+
+	if (max_buffered && ast_atomic_fetchadd_int(&altstream_admission.buffered, len) + (int) len > max_buffered) {
+		ast_atomic_fetchadd_int(&altstream_admission.buffered, -(int) len);
+		ast_atomic_fetchadd_int(&altstream_admission.over_budget, +1);
+		return -1;
+	} else if (!max_buffered) {
+		ast_atomic_fetchadd_int(&altstream_admission.buffered, len);
+	}
+
+	return 0;
+}
+
+/*! \brief A message to keep for later, NULL when out of memory or over max_buffered */
+static struct altstream_msg *altstream_msg_alloc(enum ast_websocket_opcode opcode, const char *data, uint64_t len)
+{
+	struct altstream_msg *msg;
+
+	if (altstream_buffered_take(len)) {
+		return NULL;
+	}
+
+	if (!(msg = ao2_alloc_options(sizeof(*msg) + len, altstream_msg_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		ast_atomic_fetchadd_int(&altstream_admission.buffered, -(int) len);
+		return NULL;
+	}
+	msg->opcode = opcode;
+	msg->len = len;
+	memcpy(msg->data, data, len);
+
+	return msg;
+}
+
+/*! \brief Which cap keeps another stream to the endpoints in \a wsserver out, NULL when there is room. Called locked. */
+static const char *altstream_admission_cap(const char *wsserver)
+{
+	char *list;
+	char *endpoint;
+
+	if (altstream_admission.max_streams && altstream_admission.streams >= altstream_admission.max_streams) {
+		return "max_streams";
+	}
+	if (altstream_admission.max_buffered && altstream_admission.buffered >= altstream_admission.max_buffered) {
+		return "max_buffered";
+	}
+	if (!altstream_admission.max_streams_per_server) {
+		return NULL;
+	}
+
+	list = ast_strdupa(wsserver);
+	while ((endpoint = strsep(&list, ALTSTREAM_DEST_SEPARATOR))) {
+		struct altstream_usage *usage = ao2_find(altstream_admission.servers, ast_strip(endpoint), OBJ_SEARCH_KEY);
+		int full = usage && usage->streams >= altstream_admission.max_streams_per_server;
+
+		ao2_cleanup(usage);
+		if (full) {
+			return "max_streams_per_server";
+		}
+	}
+
+	return NULL;
+}
+
+/*! \brief Add \a delta to the streams of every endpoint in \a wsserver. Called locked. */
+static void altstream_admission_count(const char *wsserver, int delta)
+{
+	char *list = ast_strdupa(wsserver);
+	char *endpoint;
+
+	while ((endpoint = strsep(&list, ALTSTREAM_DEST_SEPARATOR))) {
+		struct altstream_usage *usage;
+
+		endpoint = ast_strip(endpoint);
+		if (ast_strlen_zero(endpoint)) {
+			continue;
+		}
+		usage = ao2_find(altstream_admission.servers, endpoint, OBJ_SEARCH_KEY);
+		if (!usage && delta > 0 && (usage = ao2_alloc_options(sizeof(*usage) + strlen(endpoint) + 1, NULL, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+			strcpy(usage->server, endpoint); /* SAFE */
+			ao2_link(altstream_admission.servers, usage);
+		}
+		if (!usage) {
+			continue;
+		}
+		usage->streams += delta;
+		if (usage->streams <= 0) {
+			ao2_unlink(altstream_admission.servers, usage);
+		}
+		ao2_ref(usage, -1);
+	}
+}
+
+/*!
+ * \brief Take a slot for a stream and one on each of the endpoints in \a wsserver
+ * \param queue wait up to queue_timeout for room, otherwise a full cap refuses at once
+ * \retval 0 admitted, give it back with altstream_admission_release()
+ * \retval -1 refused
+ */
+static int altstream_admit(struct ast_channel *chan, const char *wsserver, int queue)
+{
+	struct timeval deadline;
+	const char *cap;
+	int waiting = 0;
+
+	ast_mutex_lock(&altstream_admission.lock);
+	deadline = ast_tvadd(ast_tvnow(), ast_samp2tv(queue ? altstream_admission.queue_timeout : 0, 1000));
+	for (;;) {
+		struct timeval wait;
+		struct timespec ts;
+
+		if (!(cap = altstream_admission_cap(wsserver))) {
+			break;
+		}
+
+		if (ast_tvdiff_ms(deadline, ast_tvnow()) <= 0) {
+			altstream_admission.waiting -= waiting;
+			altstream_admission.refused++;
+			ast_mutex_unlock(&altstream_admission.lock);
+			ast_log(LOG_WARNING, "<%s> [AltStream] Refusing a stream to %s, %s reached\n", ast_channel_name(chan), wsserver, cap);
+			return -1;
+		}
+		if (!waiting) {
+			waiting = 1;
+			altstream_admission.waiting++;
+		}
+
+		/* woken when a stream ends, buffered audio drains without telling anyone */
+		wait = ast_tvadd(ast_tvnow(), ast_samp2tv(MIN(ast_tvdiff_ms(deadline, ast_tvnow()), ALTSTREAM_ADMISSION_POLL_MS), 1000));
+		ts.tv_sec = wait.tv_sec;
+		ts.tv_nsec = wait.tv_usec * 1000;
+		ast_cond_timedwait(&altstream_admission.cond, &altstream_admission.lock, &ts);
+	}
+
+	altstream_admission_count(wsserver, 1);
+	altstream_admission.streams++;
+	altstream_admission.admitted++;
+	altstream_admission.waiting -= waiting;
+	ast_mutex_unlock(&altstream_admission.lock);
+
+	return 0;
+}
+
+static void altstream_admission_release(const char *wsserver)
+{
+	ast_mutex_lock(&altstream_admission.lock);
+	altstream_admission_count(wsserver, -1);
+	altstream_admission.streams--;
+	ast_cond_broadcast(&altstream_admission.cond);
+	ast_mutex_unlock(&altstream_admission.lock);
+}
+
+/*! \brief Move the endpoint slots of a redirected stream from the endpoints in \a from to those in \a to */
+static void altstream_admission_move(const char *from, const char *to)
+{
+	ast_mutex_lock(&altstream_admission.lock);
+	altstream_admission_count(from, -1);
+	altstream_admission_count(to, 1);
+	ast_cond_broadcast(&altstream_admission.cond);
+	ast_mutex_unlock(&altstream_admission.lock);
+}
+
+static int altstream_admission_setting(const char *name)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(altstream_admission_settings); i++) {
+		if (!strcasecmp(name, altstream_admission_settings[i])) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Take the caps from the [general] category of \a cfg, which may be NULL */
+static void altstream_admission_load(struct ast_config *cfg)
+{
+	int values[ARRAY_LEN(altstream_admission_settings)] = { 0, };
+	struct ast_variable *var;
+	int i;
+
+	for (var = cfg ? ast_variable_browse(cfg, ALTSTREAM_GENERAL) : NULL; var; var = var->next) {
+		for (i = 0; i < ARRAY_LEN(altstream_admission_settings); i++) {
+			if (strcasecmp(var->name, altstream_admission_settings[i])) {
+				continue;
+			}
+			if (sscanf(var->value, "%30d", &values[i]) != 1 || values[i] < 0) {
+				ast_log(LOG_WARNING, "[AltStream] Invalid %s '%s' at line %d of %s, no cap\n", var->name, var->value,
+					var->lineno, ALTSTREAM_CONFIG);
+				values[i] = 0;
+			}
+		}
+	}
+
+	ast_mutex_lock(&altstream_admission.lock);
+	altstream_admission.max_streams = values[0];
+	altstream_admission.max_streams_per_server = values[1];
+	altstream_admission.max_buffered = values[2];
+	altstream_admission.queue_timeout = values[3];
+	/* a raised cap lets waiting starts in */
+	ast_cond_broadcast(&altstream_admission.cond);
+	ast_mutex_unlock(&altstream_admission.lock);
+}
+
+/*!
+ * \brief Limits shared by the streams of every profile with the same tenant key
+ *
+ * Audio is metered by a token bucket holding microseconds of audio, refilled at
+ * \a rate audio seconds per second up to \a burst seconds.
+ */
+struct altstream_tenant {
+	/* 0 for no cap */
+	int max_streams;
+	double rate;
+	double burst;
+	double tokens;
+	uint64_t refilled;
+	int streams;
+	uint64_t started;
+	uint64_t refused;
+	/* microseconds of audio let through and dropped */
+	uint64_t sent_us;
+	uint64_t throttled_us;
+	/* no longer in altstream.conf, dropped once the reload is through */
+	int stale;
+	char name[0];
+};
+
+AO2_STRING_FIELD_HASH_FN(altstream_tenant, name)
+AO2_STRING_FIELD_CMP_FN(altstream_tenant, name)
+
+/*! \brief Tenants are updated in place on reload, so running streams keep counting against them */
+static struct ao2_container *altstream_tenants;
+
+static void altstream_tenant_refill(struct altstream_tenant *tenant, uint64_t now)
+{
+	tenant->tokens = MIN(tenant->burst * 1000000.0, tenant->tokens + (now - tenant->refilled) * tenant->rate);
+	tenant->refilled = now;
+}
+
+/*!
+ * \brief Count a stream against \a name, a tenant unknown to altstream.conf has no limits
+ * \retval 0 admitted, *tenant set to release with altstream_tenant_release() unless NULL
+ * \retval -1 refused
+ */
+static int altstream_tenant_admit(struct ast_channel *chan, const char *name, struct altstream_tenant **tenant)
+{
+	const char *cap = NULL;
+
+	if (!(*tenant = ao2_find(altstream_tenants, name, OBJ_SEARCH_KEY))) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] No tenant '%s' in %s, the stream is not limited\n", ast_channel_name(chan),
+			name, ALTSTREAM_CONFIG);
+		return 0;
+	}
+
+	ao2_lock(*tenant);
+	if ((*tenant)->rate) {
+		altstream_tenant_refill(*tenant, altstream_monotonic_us());
+	}
+	if ((*tenant)->max_streams && (*tenant)->streams >= (*tenant)->max_streams) {
+		cap = "max_streams";
+	} else if ((*tenant)->rate && (*tenant)->tokens <= 0) {
+		cap = "its audio rate";
+	}
+	if (cap) {
+		(*tenant)->refused++;
+	} else {
+		(*tenant)->streams++;
+		(*tenant)->started++;
+	}
+	ao2_unlock(*tenant);
+
+	if (cap) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] Refusing a stream for tenant %s, %s reached\n", ast_channel_name(chan), name, cap);
+		ao2_ref(*tenant, -1);
+		*tenant = NULL;
+		return -1;
+	}
+
+	return 0;
+}
+
+static void altstream_tenant_release(struct altstream_tenant *tenant)
+{
+	if (tenant) {
+		ao2_lock(tenant);
+		tenant->streams--;
+		ao2_unlock(tenant);
+		ao2_ref(tenant, -1);
+	}
+}
+
+/*! \brief Draw \a samples of audio at \a rate Hz from the tenant's budget, non-zero when it has run out */
+static int altstream_tenant_take(struct altstream_tenant *tenant, size_t samples, unsigned int rate)
+{
+	double cost = samples * 1000000.0 / rate;
+	int res = 0;
+
+	if (!tenant) {
+		return 0;
+	}
+
+	ao2_lock(tenant);
+	if (tenant->rate) {
+		altstream_tenant_refill(tenant, altstream_monotonic_us());
+		if (tenant->tokens < cost) {
+			res = -1;
+		} else {
+			tenant->tokens -= cost;
+		}
+	}
+	if (res) {
+		tenant->throttled_us += cost;
+	} else {
+		tenant->sent_us += cost;
+	}
+	ao2_unlock(tenant);
+
+	return res;
+}
+
+/*! \brief Create or update a tenant from a type=tenant category of altstream.conf */
+static void altstream_tenant_load(const char *name, struct ast_variable *var)
+{
+	struct altstream_tenant *tenant;
+	int max_streams = 0;
+	double rate = 0;
+	double burst = 0;
+
+	for (; var; var = var->next) {
+		if (!strcasecmp(var->name, "type")) {
+			continue;
+		} else if (!strcasecmp(var->name, "max_streams")) {
+			if (sscanf(var->value, "%30d", &max_streams) != 1 || max_streams < 0) {
+				max_streams = 0;
+			} else {
+				continue;
+			}
+		} else if (!strcasecmp(var->name, "rate")) {
+			if (sscanf(var->value, "%30lf", &rate) != 1 || rate < 0) {
+				rate = 0;
+			} else {
+				continue;
+			}
+		} else if (!strcasecmp(var->name, "burst")) {
+			if (sscanf(var->value, "%30lf", &burst) != 1 || burst < 0) {
+				burst = 0;
+			} else {
+				continue;
+			}
+		} else {
+			ast_log(LOG_WARNING, "[AltStream] Unknown setting '%s' in tenant '%s' at line %d of %s\n",
+				var->name, name, var->lineno, ALTSTREAM_CONFIG);
+			continue;
+		}
+		ast_log(LOG_WARNING, "[AltStream] Invalid %s '%s' in tenant '%s' at line %d of %s, no limit\n",
+			var->name, var->value, name, var->lineno, ALTSTREAM_CONFIG);
+	}
+
+	if (!(tenant = ao2_find(altstream_tenants, name, OBJ_SEARCH_KEY))) {
+		if (!(tenant = ao2_alloc(sizeof(*tenant) + strlen(name) + 1, NULL))) {
+			return;
+		}
+		strcpy(tenant->name, name); /* SAFE */
+		tenant->refilled = altstream_monotonic_us();
+		ao2_link(altstream_tenants, tenant);
+	}
+
+	ao2_lock(tenant);
+	tenant->max_streams = max_streams;
+	tenant->rate = rate;
+	/* a second of audio at the full rate unless told otherwise */
+	tenant->burst = burst ? burst : MAX(rate, 1.0);
+	tenant->tokens = MIN(tenant->tokens, tenant->burst * 1000000.0);
+	if (!tenant->started) {
+		tenant->tokens = tenant->burst * 1000000.0;
+	}
+	tenant->stale = 0;
+	ao2_unlock(tenant);
+	ao2_ref(tenant, -1);
+}
+
+static int altstream_tenant_mark_stale(void *obj, void *arg, int flags)
+{
+	struct altstream_tenant *tenant = obj;
+
+	tenant->stale = 1;
+
+	return 0;
+}
+
+static int altstream_tenant_is_stale(void *obj, void *arg, int flags)
+{
+	struct altstream_tenant *tenant = obj;
+
+	return tenant->stale ? CMP_MATCH : 0;
+}
+
+static int altstream_admission_init(void)
+{
+	ast_mutex_init(&altstream_admission.lock);
+	ast_cond_init(&altstream_admission.cond, NULL);
+	altstream_admission.servers = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, 0, ALTSTREAM_USAGE_BUCKETS,
+		altstream_usage_hash_fn, NULL, altstream_usage_cmp_fn);
+	altstream_tenants = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_MUTEX, AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT,
+		ALTSTREAM_TENANT_BUCKETS, altstream_tenant_hash_fn, NULL, altstream_tenant_cmp_fn);
+
+	return altstream_admission.servers && altstream_tenants ? 0 : -1;
+}
+
+static void altstream_admission_cleanup(void)
+{
+	ao2_cleanup(altstream_tenants);
+	altstream_tenants = NULL;
+	ao2_cleanup(altstream_admission.servers);
+	altstream_admission.servers = NULL;
+	ast_mutex_destroy(&altstream_admission.lock);
+	ast_cond_destroy(&altstream_admission.cond);
+}
+
+/*! \brief Count kept messages sent again or lost, on the stream itself when \a altstream is one of its endpoints */
+static void altstream_resume_stats(struct altstream *altstream, uint64_t resent, uint64_t dropped)
+{
+	struct altstream_ds *altstream_ds = altstream->parent ? altstream->parent->altstream_ds : altstream->altstream_ds;
+
+	/* the senders of every endpoint add to the same figures */
+	ast_mutex_lock(&altstream_ds->lock);
+	altstream_ds->resent += resent;
+	altstream_ds->resume_dropped += dropped;
+	ast_mutex_unlock(&altstream_ds->lock);
+}
+
+/*! \brief Milliseconds of audio in a binary message of \a len bytes, at least one */
+static unsigned int altstream_resume_ms(struct altstream *altstream, uint64_t len)
+{
+	uint64_t ms;
+
+	if (altstream->mel) {
+		ms = len / altstream_mel_frame_size(altstream->mel) * ALTSTREAM_MEL_HOP * 1000 / ALTSTREAM_MEL_RATE;
+	} else {
+		ms = len * 1000 / (altstream->samp_rate * sizeof(int16_t));
+	}
+
+	return MAX(1, MIN(ms, UINT_MAX));
+}
+
+/*! \brief The server has every message up to and including \a seq */
+static void altstream_resume_ack(struct altstream *altstream, uint64_t seq)
+{
+	while (altstream->resume_count && altstream->resume_seq <= seq) {
+		struct altstream_resume_slot *slot = &altstream->resume_buf[altstream->resume_head];
+
+		ao2_ref(slot->msg, -1);
+		altstream->resume_ms -= slot->ms;
+		altstream->resume_head = (altstream->resume_head + 1) % altstream->resume_size;
+		altstream->resume_count--;
+		altstream->resume_seq++;
+	}
+}
+
+/*! \brief Make room for twice as many kept messages, in order from the start */
+static int altstream_resume_grow(struct altstream *altstream)
+{
+	unsigned int size = altstream->resume_size ? altstream->resume_size * 2 : ALTSTREAM_RESUME_SLOTS;
+	struct altstream_resume_slot *buf = ast_calloc(size, sizeof(*buf));
+	unsigned int i;
+
+	if (!buf) {
+		return -1;
+	}
+	for (i = 0; i < altstream->resume_count; i++) {
+		buf[i] = altstream->resume_buf[(altstream->resume_head + i) % altstream->resume_size];
+	}
+	ast_free(altstream->resume_buf);
+	altstream->resume_buf = buf;
+	altstream->resume_size = size;
+	altstream->resume_head = 0;
+
+	return 0;
+}
+
+/*! \brief Keep a binary message that went out until the server acknowledges it, the oldest go when the window is full */
+static void altstream_resume_keep(struct altstream *altstream, const char *data, uint64_t len)
+{
+	struct altstream_resume_slot *slot;
+	struct altstream_msg *msg = NULL;
+	unsigned int ms = altstream_resume_ms(altstream, len);
+	uint64_t dropped = 0;
+
+	while (altstream->resume_count && altstream->resume_ms + ms > altstream->resume_window) {
+		altstream_resume_ack(altstream, altstream->resume_seq);
+		dropped++;
+	}
+
+	if ((altstream->resume_count == altstream->resume_size && altstream_resume_grow(altstream))
+		|| !(msg = altstream_msg_alloc(AST_WEBSOCKET_OPCODE_BINARY, data, len))) {
+		/* the kept messages have to be in a row, start over after this one */
+		dropped += altstream->resume_count;
+		altstream_resume_ack(altstream, altstream->next_seq++);
+	} else {
+		if (!altstream->resume_count) {
+			altstream->resume_seq = altstream->next_seq;
+		}
+		slot = &altstream->resume_buf[(altstream->resume_head + altstream->resume_count) % altstream->resume_size];
+		slot->msg = msg;
+		slot->ms = ms;
+		altstream->resume_count++;
+		altstream->resume_ms += ms;
+		altstream->next_seq++;
+	}
+
+	if (dropped) {
+		altstream_resume_stats(altstream, 0, dropped);
+	}
+}
+
+static void altstream_resume_free(struct altstream *altstream)
+{
+	altstream_resume_ack(altstream, UINT64_MAX);
+	ast_free(altstream->resume_buf);
+	altstream->resume_buf = NULL;
+	altstream->resume_size = 0;
+}
+
+static const char *altstream_codec_name(enum altstream_features codec)
+{
+	switch (codec) {
+	case ALTSTREAM_FEATURES_Q12:
+		return "mel-q12";
+	case ALTSTREAM_FEATURES_F32:
+		return "mel-f32";
+	case ALTSTREAM_FEATURES_NONE:
+		break;
+	}
+
+	return "slin";
+}
+
+/*! \brief Whether the websocket servers may redirect their streams, server_redirects in [general] */
+static int altstream_server_redirects;
+
+/*!
+ * \brief Whether a server may move its stream to \a wsserver
+ *
+ * Only one websocket endpoint, and nothing that would end a header of the
+ * AltStreamRedirect event.
+ */
+static int altstream_server_redirect_valid(const char *wsserver)
+{
+	if (strncasecmp(wsserver, "ws://", 5) && strncasecmp(wsserver, "wss://", 6)) {
+		return 0;
+	}
+
+	return !strpbrk(wsserver, "\r\n" ALTSTREAM_DEST_SEPARATOR);
+}
+
+/*! \brief Ask the stream thread to move to \a wsserver, 1 when a redirect is already under way */
+static int altstream_ds_redirect(struct altstream_ds *altstream_ds, const char *wsserver)
+{
+	int res = -1;
+
+	ast_mutex_lock(&altstream_ds->lock);
+	if (altstream_ds->destruction_ok) {
+		/* stopped, the stream thread will not look for it */
+	} else if (altstream_ds->redirecting) {
+		res = 1;
+	} else if ((altstream_ds->redirect = ast_strdup(wsserver))) {
+		altstream_ds->redirecting = 1;
+		res = 0;
+	}
+	ast_mutex_unlock(&altstream_ds->lock);
+
+	return res;
+}
+
+/*!
+ * \brief Handle a text message from the server
+ *
+ * Pausing concerns the connection the message came in on, the other requests concern the
+ * whole stream and are left in its datastore for the stream thread to pick up.
+ */
+static void altstream_server_message(struct altstream *altstream, const char *payload, uint64_t len)
+{
+	struct altstream *stream = altstream->parent ? altstream->parent : altstream;
+	struct ast_json *message;
+	struct ast_json *value;
+	const char *event;
+
+	if (!(message = ast_json_load_buf(payload, len, NULL))) {
+		ast_debug(1, "<%s> [AltStream] (%s) Ignoring a text message that is not JSON\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		return;
+	}
+
+	event = S_OR(ast_json_string_get(ast_json_object_get(message, "event")), "");
+	value = ast_json_object_get(message, !strcmp(event, "ack") ? "seq" : event);
+
+	if (!strcmp(event, "ack")) {
+		if (altstream->resume_window && ast_json_typeof(value) == AST_JSON_INTEGER) {
+			altstream_resume_ack(altstream, ast_json_integer_get(value));
+		}
+	} else if (!strcmp(event, "pause") || !strcmp(event, "resume")) {
+		if (altstream->paused != !strcmp(event, "pause")) {
+			altstream->paused = !altstream->paused;
+			ast_verb(2, "<%s> [AltStream] (%s) %s %s asked to %s the audio\n", ast_channel_name(altstream->autochan->chan),
+				altstream->direction_string, altstream->transport->name, altstream->wsserver, event);
+		}
+	} else if (!strcmp(event, "ptime")) {
+		intmax_t ptime = ast_json_typeof(value) == AST_JSON_INTEGER ? ast_json_integer_get(value) : 0;
+
+		if (ptime < 10 || ptime > ALTSTREAM_MAX_PTIME) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Ignoring a packet time outside 10 to %d ms from %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, ALTSTREAM_MAX_PTIME, altstream->wsserver);
+		} else {
+			ast_mutex_lock(&stream->altstream_ds->lock);
+			stream->altstream_ds->control_ptime = ptime;
+			ast_mutex_unlock(&stream->altstream_ds->lock);
+		}
+	} else if (!strcmp(event, "codec")) {
+		const char *name = S_OR(ast_json_string_get(value), "");
+		enum altstream_features codec;
+
+		if (!strcasecmp(name, "slin")) {
+			codec = ALTSTREAM_FEATURES_NONE;
+		} else if (!strcasecmp(name, "mel") || !strcasecmp(name, "mel-q12")) {
+			codec = ALTSTREAM_FEATURES_Q12;
+		} else if (!strcasecmp(name, "mel-f32")) {
+			codec = ALTSTREAM_FEATURES_F32;
+		} else {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Ignoring unknown codec '%s' from %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, name, altstream->wsserver);
+			ast_json_unref(message);
+			return;
+		}
+		ast_mutex_lock(&stream->altstream_ds->lock);
+		stream->altstream_ds->codec_change = 1;
+		stream->altstream_ds->codec = codec;
+		ast_mutex_unlock(&stream->altstream_ds->lock);
+	} else if (!strcmp(event, "redirect")) {
+		const char *wsserver = ast_json_string_get(value);
+		const char *reason = NULL;
+
+		if (!altstream_server_redirects) {
+			reason = "server redirects are off";
+		} else if (ast_strlen_zero(wsserver)) {
+			reason = "no endpoint given";
+		} else if (!altstream_server_redirect_valid(wsserver)) {
+			reason = "it is not a single ws:// or wss:// endpoint";
+		} else if (altstream_ds_redirect(stream->altstream_ds, wsserver)) {
+			reason = "the stream is already moving";
+		}
+		if (reason) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Ignoring a redirect from %s, %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->wsserver, reason);
+		}
+	} else {
+		ast_debug(1, "<%s> [AltStream] (%s) Ignoring '%s' message from %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, event, altstream->wsserver);
+	}
+
+	ast_json_unref(message);
+}
+
+static int altstream_ws_send(struct altstream *altstream, enum ast_websocket_opcode opcode, const char *data, uint64_t len)
+{
+	unsigned char *frame;
+	size_t header_len = 2;
+	size_t frame_len;
+	size_t written = 0;
+	uint32_t mask;
+	ssize_t res;
+	int fd;
+	int i;
+
+	if (!altstream->ws_direct) {
+		return ast_websocket_write(altstream->websocket, opcode, (char *) data, len);
+	}
+
+	if (len > 65535) {
+		header_len += 8;
+	} else if (len > 125) {
+		header_len += 2;
+	}
+	header_len += sizeof(mask);
+	frame_len = header_len + len;
+
+	if (frame_len > altstream->ws_frame_buf_len) {
+		unsigned char *buf = ast_realloc(altstream->ws_frame_buf, frame_len);
+
+		if (!buf) {
+			return -1;
+		}
+		altstream->ws_frame_buf = buf;
+		altstream->ws_frame_buf_len = frame_len;
+	}
+	frame = altstream->ws_frame_buf;
+
+	/* single final frame, client frames are always masked */
+	frame[0] = 0x80 | opcode;
+	if (len > 65535) {
+		frame[1] = 0x80 | 127;
+		for (i = 0; i < 8; i++) {
+			frame[2 + i] = len >> (56 - 8 * i);
+		}
+	} else if (len > 125) {
+		frame[1] = 0x80 | 126;
+		put_unaligned_uint16(frame + 2, htons(len));
+	} else {
+		frame[1] = 0x80 | len;
+	}
+
+	mask = ast_random();
+	memcpy(frame + header_len - sizeof(mask), &mask, sizeof(mask));
+	altstream_kernels->mask(frame + header_len, (const unsigned char *) data, len, mask);
+
+	/* the same lock ast_websocket_write holds, keeps frames from interleaving */
+	ao2_lock(altstream->websocket);
+	fd = ast_websocket_fd(altstream->websocket);
+	while (fd >= 0 && written < frame_len) {
+		res = send(fd, frame + written, frame_len - written, MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if ((errno == EAGAIN || errno == EWOULDBLOCK) && ast_wait_for_output(fd, ALTSTREAM_WS_WRITE_TIMEOUT) > 0) {
+				continue;
+			}
+			break;
+		}
+		written += res;
+	}
+	ao2_unlock(altstream->websocket);
+
+	return written == frame_len ? 0 : -1;
+}
+
+static int altstream_ws_close(struct altstream *altstream)
+{
+	int ret;
+	ast_verb(2, "[AltStream] Closing websocket connection\n");
+	if (altstream->websocket) {
+		ast_verb(2, "[AltStream] Calling ast_websocket_close\n");
+		ret = ast_websocket_close(altstream->websocket, 1011);
+		ao2_cleanup(altstream->websocket);
+		altstream->websocket = NULL;
+		return ret;
+	}
+
+	ast_verb(2, "[AltStream] No reference to websocket, can't close connection\n");
+	return -1;
+}
+
+
+#ifdef HAVE_ZLIB
+static uint64_t altstream_thread_cpu_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int altstream_deflate_setup(struct altstream *altstream)
+{
+	if (altstream->deflate_ready) {
+		/* a new connection starts with a fresh compression context */
+		return deflateReset(&altstream->deflate) == Z_OK ? 0 : -1;
+	}
+
+	if (deflateInit2(&altstream->deflate, altstream->compression_level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		return -1;
+	}
+	altstream->deflate_ready = 1;
+
+	return 0;
+}
+
+static void altstream_deflate_destroy(struct altstream *altstream)
+{
+	if (altstream->deflate_ready) {
+		deflateEnd(&altstream->deflate);
+		altstream->deflate_ready = 0;
+	}
+	ast_free(altstream->deflate_buf);
+	altstream->deflate_buf = NULL;
+}
+
+/*! \brief Compress a message the way permessage-deflate does, returns the compressed length or -1 */
+static ssize_t altstream_deflate(struct altstream *altstream, const char *data, uint64_t len)
+{
+	z_stream *zs = &altstream->deflate;
+	size_t needed = deflateBound(zs, len) + 6;
+	size_t out_len;
+
+	if (needed > altstream->deflate_buf_len) {
+		unsigned char *buf = ast_realloc(altstream->deflate_buf, needed);
+
+		if (!buf) {
+			return -1;
+		}
+		altstream->deflate_buf = buf;
+		altstream->deflate_buf_len = needed;
+	}
+
+	zs->next_in = (unsigned char *) data;
+	zs->avail_in = len;
+	zs->next_out = altstream->deflate_buf;
+	zs->avail_out = altstream->deflate_buf_len;
+	if (deflate(zs, Z_SYNC_FLUSH) != Z_OK || zs->avail_in) {
+		return -1;
+	}
+
+	/* the sync flush always ends in an empty stored block, which the receiver adds back */
+	out_len = altstream->deflate_buf_len - zs->avail_out;
+	if (out_len >= 4) {
+		out_len -= 4;
+	}
+
+	if (altstream->compression_no_takeover && deflateReset(zs) != Z_OK) {
+		return -1;
+	}
+
+	return out_len;
+}
+#endif
+
+/*
+	1 = success
+	0 = fail
+*/
+static enum ast_websocket_result altstream_ws_connect(struct altstream *altstream)
+{
+	enum ast_websocket_result result;
+	const char *protocols = "echo";
+
+	if (altstream->websocket) {
+		ast_verb(2, "<%s> [AltStream] (%s) Reconnecting to websocket server at: %s\n",
+			ast_channel_name(altstream->autochan->chan),
+			altstream->direction_string,
+			altstream->altstream_ds->wsserver);
+
+		// close the websocket connection before reconnecting
+		altstream_ws_close(altstream);
+	}
+	else {
+		ast_verb(2, "<%s> [AltStream] (%s) Connecting to websocket server at: %s\n",
+			ast_channel_name(altstream->autochan->chan),
+			altstream->direction_string,
+			altstream->altstream_ds->wsserver);
+	}
+
+#ifdef HAVE_ZLIB
+	if (altstream->compression_level) {
+		protocols = altstream->compression_no_takeover
+			? ALTSTREAM_DEFLATE_NCT_PROTOCOL ",echo" : ALTSTREAM_DEFLATE_PROTOCOL ",echo";
+	}
+#endif
+
+	// Check if we're running with TLS
+	if (altstream->has_tls == 1) {
+		ast_verb(2, "<%s> [AltStream] (%s) Creating to WebSocket server with TLS mode enabled\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		altstream->websocket = ast_websocket_client_create(altstream->altstream_ds->wsserver, protocols, altstream->tls_cfg, &result);
+	} else {
+		ast_verb(2, "<%s> [AltStream] (%s) Creating to WebSocket server without TLS\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		altstream->websocket = ast_websocket_client_create(altstream->altstream_ds->wsserver, protocols, NULL, &result);
+	}
+
+	altstream->ping_outstanding = 0;
+	altstream->ping_sent = altstream_monotonic_us();
+
+	/* TLS sessions have to go through the core so the data gets encrypted */
+	altstream->ws_direct = altstream->websocket && !ast_websocket_is_secure(altstream->websocket);
+
+	altstream->compressing = 0;
+#ifdef HAVE_ZLIB
+	if (altstream->websocket && altstream->compression_level) {
+		const char *accepted = ast_websocket_client_accept_protocol(altstream->websocket);
+
+		if (ast_strlen_zero(accepted) || !ast_begins_with(accepted, ALTSTREAM_DEFLATE_PROTOCOL)) {
+			ast_verb(2, "<%s> [AltStream] (%s) Server declined compression\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		} else if (altstream_deflate_setup(altstream)) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Unable to set up compression, sending uncompressed\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		} else {
+			ast_verb(2, "<%s> [AltStream] (%s) Compressing with %s level %d\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, accepted, altstream->compression_level);
+			altstream->compressing = 1;
+		}
+	}
+#endif
+
+	return result;
+}
+
+static int altstream_ws_transport_connect(struct altstream *altstream)
+{
+	return altstream_ws_connect(altstream) == WS_OK ? 0 : -1;
+}
+
+static int altstream_ws_write(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	if (!altstream->websocket) {
+		return -1;
+	}
+
+#ifdef HAVE_ZLIB
+	if (altstream->compressing && opcode == AST_WEBSOCKET_OPCODE_BINARY) {
+		struct altstream_ds *altstream_ds = altstream->altstream_ds;
+		uint64_t start = altstream_thread_cpu_us();
+		ssize_t out_len = altstream_deflate(altstream, data, len);
+
+		altstream_ds->compress_cpu_us += altstream_thread_cpu_us() - start;
+		if (out_len < 0) {
+			ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to compress message\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+			return -1;
+		}
+		altstream_ds->compress_in += len;
+		altstream_ds->compress_out += out_len;
+
+		return altstream_ws_send(altstream, opcode, (char *) altstream->deflate_buf, out_len);
+	}
+#endif
+
+	return altstream_ws_send(altstream, opcode, data, len);
+}
+
+static void altstream_ws_pong(struct altstream *altstream, const char *payload, uint64_t len, uint64_t now)
+{
+	struct altstream_ds *altstream_ds = altstream->altstream_ds;
+	uint64_t sent;
+
+	/* unsolicited pongs and pongs from a previous connection are ignored */
+	if (!altstream->ping_outstanding || len != sizeof(sent)) {
+		return;
+	}
+
+	memcpy(&sent, payload, sizeof(sent));
+	if (sent != altstream->ping_sent) {
+		return;
+	}
+
+	altstream->ping_outstanding = 0;
+	altstream_ds->rtt = now - sent;
+	altstream_ds->srtt = altstream_ds->srtt ? (7 * altstream_ds->srtt + altstream_ds->rtt) / 8 : altstream_ds->rtt;
+}
+
+static int altstream_ws_service(struct altstream *altstream)
+{
+	uint64_t now = altstream_monotonic_us();
+	char *payload;
+	uint64_t len;
+	enum ast_websocket_opcode opcode;
+	int fragmented;
+
+	if (!altstream->websocket) {
+		return -1;
+	}
+
+	/* Pings from the server are answered inside ast_websocket_read */
+	while (ast_websocket_wait_for_input(altstream->websocket, 0) > 0) {
+		if (ast_websocket_read(altstream->websocket, &payload, &len, &opcode, &fragmented)) {
+			return -1;
+		}
+
+		if (opcode == AST_WEBSOCKET_OPCODE_CLOSE) {
+			ast_verb(2, "<%s> [AltStream] (%s) Websocket server closed the connection\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+			return -1;
+		} else if (opcode == AST_WEBSOCKET_OPCODE_PONG) {
+			altstream_ws_pong(altstream, payload, len, now);
+		} else if (opcode == AST_WEBSOCKET_OPCODE_TEXT && !fragmented) {
+			altstream_server_message(altstream, payload, len);
+		}
+	}
+
+	if (!altstream->ping_interval) {
+		return 0;
+	}
+
+	if (altstream->ping_outstanding) {
+		if (now - altstream->ping_sent < (uint64_t) altstream->pong_timeout * 1000000) {
+			return 0;
+		}
+		altstream->altstream_ds->pong_timeouts++;
+		ast_log(LOG_WARNING, "<%s> [AltStream] (%s) No pong within %d seconds\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->pong_timeout);
+		return -1;
+	}
+
+	if (now - altstream->ping_sent >= (uint64_t) altstream->ping_interval * 1000000) {
+		/* the pong echoes our send time back, which gives the round trip */
+		altstream->ping_sent = now;
+		altstream->ping_outstanding = 1;
+		if (ast_websocket_write(altstream->websocket, AST_WEBSOCKET_OPCODE_PING, (char *) &altstream->ping_sent, sizeof(altstream->ping_sent))) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static int altstream_unix_close(struct altstream *altstream)
+{
+	if (altstream->unix_fd < 0) {
+		return -1;
+	}
+
+	ast_verb(2, "[AltStream] Closing unix socket connection\n");
+	close(altstream->unix_fd);
+	altstream->unix_fd = -1;
+
+	return 0;
+}
+
+static int altstream_unix_connect(struct altstream *altstream)
+{
+	const char *path = altstream->altstream_ds->wsserver + strlen(ALTSTREAM_UNIX_PREFIX);
+	struct sockaddr_un addr = { .sun_family = AF_UNIX, };
+	struct timeval send_timeout = { .tv_sec = ALTSTREAM_UNIX_SEND_TIMEOUT, };
+
+	if (altstream->unix_fd >= 0) {
+		ast_verb(2, "<%s> [AltStream] (%s) Reconnecting to unix socket at: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, path);
+		altstream_unix_close(altstream);
+	} else {
+		ast_verb(2, "<%s> [AltStream] (%s) Connecting to unix socket at: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, path);
+	}
+
+	if (ast_strlen_zero(path) || strlen(path) >= sizeof(addr.sun_path)) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Invalid unix socket path '%s'\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, path);
+		return -1;
+	}
+	ast_copy_string(addr.sun_path, path, sizeof(addr.sun_path));
+
+	altstream->unix_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (altstream->unix_fd < 0) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to create unix socket: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, strerror(errno));
+		return -1;
+	}
+
+	/* Don't let a stalled consumer block the stream thread forever */
+	setsockopt(altstream->unix_fd, SOL_SOCKET, SO_SNDTIMEO, &send_timeout, sizeof(send_timeout));
+
+	if (connect(altstream->unix_fd, (struct sockaddr *) &addr, sizeof(addr))) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to connect to unix socket %s: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, path, strerror(errno));
+		altstream_unix_close(altstream);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*! \brief The consumer never talks on a unix socket, so readable means it hung up */
+static int altstream_unix_service(struct altstream *altstream)
+{
+	struct pollfd pfd = { .fd = altstream->unix_fd, .events = POLLIN | POLLRDHUP, };
+	char discard[256];
+
+	if (altstream->unix_fd < 0) {
+		return -1;
+	}
+
+	while (poll(&pfd, 1, 0) > 0) {
+		if (pfd.revents & (POLLERR | POLLHUP | POLLRDHUP | POLLNVAL)) {
+			return -1;
+		}
+		if (recv(altstream->unix_fd, discard, sizeof(discard), MSG_DONTWAIT) <= 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+/*
+	header (network byte order)
+	bits 31-24 = websocket opcode
+	bits 23-0  = payload length
+*/
+static int altstream_unix_write(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	uint32_t header;
+	struct iovec iov[2];
+	struct msghdr msg = { .msg_iov = iov, .msg_iovlen = ARRAY_LEN(iov), };
+	ssize_t res;
+
+	if (altstream->unix_fd < 0 || len > ALTSTREAM_UNIX_MAX_PAYLOAD) {
+		return -1;
+	}
+
+	header = htonl(((uint32_t) opcode << 24) | (uint32_t) len);
+	iov[0].iov_base = &header;
+	iov[0].iov_len = sizeof(header);
+	iov[1].iov_base = data;
+	iov[1].iov_len = len;
+
+	while (msg.msg_iovlen) {
+		res = sendmsg(altstream->unix_fd, &msg, MSG_NOSIGNAL);
+		if (res < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+
+		/* skip whatever part of the message made it out */
+		while (msg.msg_iovlen && (size_t) res >= msg.msg_iov->iov_len) {
+			res -= msg.msg_iov->iov_len;
+			msg.msg_iov++;
+			msg.msg_iovlen--;
+		}
+		if (msg.msg_iovlen) {
+			msg.msg_iov->iov_base = (char *) msg.msg_iov->iov_base + res;
+			msg.msg_iov->iov_len -= res;
+		}
+	}
+
+	return 0;
+}
+
+static int altstream_shm_close(struct altstream *altstream)
+{
+	if (!altstream->shm) {
+		return -1;
+	}
+
+	ast_verb(2, "[AltStream] Closing shared memory ring\n");
+
+	__atomic_store_n(&altstream->shm->state, 0, __ATOMIC_RELEASE);
+	if (altstream->shm_event_fd >= 0) {
+		uint64_t one = 1;
+
+		/* wake up readers so they notice the writer is gone */
+		if (write(altstream->shm_event_fd, &one, sizeof(one)) < 0) {
+			ast_debug(1, "[AltStream] Unable to signal shared memory readers: %s\n", strerror(errno));
+		}
+		close(altstream->shm_event_fd);
+		altstream->shm_event_fd = -1;
+	}
+
+	munmap(altstream->shm, altstream->shm_size);
+	altstream->shm = NULL;
+	close(altstream->shm_fd);
+	altstream->shm_fd = -1;
+
+	return 0;
+}
+
+static int altstream_shm_connect(struct altstream *altstream)
+{
+	const char *name = altstream->altstream_ds->wsserver + strlen(ALTSTREAM_SHM_PREFIX);
+	struct altstream_shm_header *hdr;
+	pid_t pid = getpid();
+
+	/* The ring survives write errors, there is nothing to reconnect */
+	if (altstream->shm) {
+		return 0;
+	}
+
+	ast_verb(2, "<%s> [AltStream] (%s) Creating shared memory ring: %s\n",
+		ast_channel_name(altstream->autochan->chan), altstream->direction_string, name);
+
+	altstream->shm_size = sizeof(*hdr) + ALTSTREAM_SHM_DATA_SIZE;
+
+	altstream->shm_fd = memfd_create(S_OR(name, "altstream"), MFD_CLOEXEC);
+	if (altstream->shm_fd < 0) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to create memfd: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, strerror(errno));
+		return -1;
+	}
+
+	if (ftruncate(altstream->shm_fd, altstream->shm_size)) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to size memfd: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, strerror(errno));
+		close(altstream->shm_fd);
+		altstream->shm_fd = -1;
+		return -1;
+	}
+
+	hdr = mmap(NULL, altstream->shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, altstream->shm_fd, 0);
+	if (hdr == MAP_FAILED) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to map memfd: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, strerror(errno));
+		close(altstream->shm_fd);
+		altstream->shm_fd = -1;
+		return -1;
+	}
+
+	altstream->shm_event_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (altstream->shm_event_fd < 0) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to create eventfd: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, strerror(errno));
+		munmap(hdr, altstream->shm_size);
+		close(altstream->shm_fd);
+		altstream->shm_fd = -1;
+		return -1;
+	}
+
+	hdr->magic = ALTSTREAM_SHM_MAGIC;
+	hdr->version = ALTSTREAM_SHM_VERSION;
+	hdr->header_size = sizeof(*hdr);
+	hdr->data_size = ALTSTREAM_SHM_DATA_SIZE;
+	hdr->sample_rate = altstream->altstream_ds->samp_rate;
+	hdr->direction = altstream->direction;
+	hdr->writer_pid = pid;
+	hdr->heartbeat = altstream_monotonic_ms();
+	__atomic_store_n(&hdr->state, 1, __ATOMIC_RELEASE);
+	altstream->shm = hdr;
+
+	manager_event(EVENT_FLAG_CALL, "AltStreamShm",
+		"Channel: %s\r\n"
+		"Name: %s\r\n"
+		"Direction: %s\r\n"
+		"Pid: %d\r\n"
+		"MemFd: %d\r\n"
+		"EventFd: %d\r\n"
+		"MemPath: /proc/%d/fd/%d\r\n"
+		"EventPath: /proc/%d/fd/%d\r\n"
+		"Size: %zu\r\n",
+		ast_channel_name(altstream->autochan->chan), name, altstream->direction_string,
+		(int) pid, altstream->shm_fd, altstream->shm_event_fd,
+		(int) pid, altstream->shm_fd, (int) pid, altstream->shm_event_fd,
+		altstream->shm_size);
+
+	return 0;
+}
+
+static int altstream_shm_write(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	struct altstream_shm_header *hdr = altstream->shm;
+	struct altstream_shm_record *rec;
+	char *ring;
+	uint64_t write_pos;
+	uint64_t offset;
+	uint64_t needed;
+	uint64_t seq;
+	uint64_t one = 1;
+
+	if (!hdr) {
+		return -1;
+	}
+
+	needed = ALTSTREAM_SHM_ALIGN(sizeof(*rec) + len);
+	if (needed > hdr->data_size / 2) {
+		return -1;
+	}
+
+	ring = (char *) hdr + hdr->header_size;
+	write_pos = hdr->write_pos;
+	seq = hdr->seq;
+	offset = write_pos % hdr->data_size;
+
+	/* Records never wrap, pad out the tail and start over at the beginning */
+	if (offset + needed > hdr->data_size) {
+		rec = (struct altstream_shm_record *) (ring + offset);
+		rec->seq = seq;
+		rec->len = hdr->data_size - offset - sizeof(*rec);
+		rec->opcode = ALTSTREAM_SHM_OPCODE_PAD;
+		rec->direction = altstream->direction;
+		write_pos += hdr->data_size - offset;
+		offset = 0;
+	}
+
+	rec = (struct altstream_shm_record *) (ring + offset);
+	rec->seq = ++seq;
+	rec->len = len;
+	rec->opcode = opcode;
+	rec->direction = altstream->direction;
+	memcpy(rec + 1, data, len);
+
+	hdr->seq = seq;
+	hdr->heartbeat = altstream_monotonic_ms();
+	/* publish the record only once it is complete */
+	__atomic_store_n(&hdr->write_pos, write_pos + needed, __ATOMIC_RELEASE);
+
+	if (write(altstream->shm_event_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int altstream_rtp_close(struct altstream *altstream)
+{
+	if (altstream->rtp_fd < 0) {
+		return -1;
+	}
+
+	ast_verb(2, "[AltStream] Closing RTP socket\n");
+	close(altstream->rtp_fd);
+	altstream->rtp_fd = -1;
+
+	return 0;
+}
+
+static int altstream_rtp_connect(struct altstream *altstream)
+{
+	char *host = ast_strdupa(altstream->altstream_ds->wsserver + strlen(ALTSTREAM_RTP_PREFIX));
+	char *pt = strchr(host, '?');
+	struct ast_sockaddr *addrs;
+	struct ast_sockaddr addr;
+	int num_addrs;
+
+	if (altstream->rtp_fd >= 0) {
+		ast_verb(2, "<%s> [AltStream] (%s) Reopening RTP socket to: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, host);
+		altstream_rtp_close(altstream);
+	} else {
+		ast_verb(2, "<%s> [AltStream] (%s) Opening RTP socket to: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, host);
+	}
+
+	altstream->rtp_pt = ALTSTREAM_RTP_DEFAULT_PT;
+	if (pt) {
+		*pt++ = '\0';
+		if (sscanf(pt, "pt=%30d", &altstream->rtp_pt) != 1 || altstream->rtp_pt < 0 || altstream->rtp_pt > 127) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Invalid RTP payload type '%s', using %d\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, pt, ALTSTREAM_RTP_DEFAULT_PT);
+			altstream->rtp_pt = ALTSTREAM_RTP_DEFAULT_PT;
+		}
+	}
+
+	num_addrs = ast_sockaddr_resolve(&addrs, host, PARSE_PORT_REQUIRE, 0);
+	if (num_addrs <= 0) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to resolve RTP destination '%s'\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, host);
+		return -1;
+	}
+	ast_sockaddr_copy(&addr, &addrs[0]);
+	ast_free(addrs);
+
+	altstream->rtp_fd = socket(ast_sockaddr_is_ipv6(&addr) ? AF_INET6 : AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (altstream->rtp_fd < 0) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to create RTP socket: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, strerror(errno));
+		return -1;
+	}
+
+	if (ast_connect(altstream->rtp_fd, &addr)) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to set RTP destination %s: %s\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string,
+			ast_sockaddr_stringify(&addr), strerror(errno));
+		altstream_rtp_close(altstream);
+		return -1;
+	}
+
+	/* A reopened socket keeps going as the same RTP stream */
+	if (!altstream->rtp_ssrc) {
+		altstream->rtp_ssrc = ast_random();
+		altstream->rtp_seq = ast_random();
+		altstream->rtp_ts = ast_random();
+	}
+
+	return 0;
+}
+
+static int altstream_rtp_write(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	uint32_t buf[(ALTSTREAM_RTP_HEADER_SIZE + ALTSTREAM_RTP_MAX_PAYLOAD) / 4];
+	unsigned char *packet = (unsigned char *) buf;
+	uint16_t *payload = (uint16_t *) (packet + ALTSTREAM_RTP_HEADER_SIZE);
+	const uint16_t *samples = (const uint16_t *) data;
+	uint64_t total = len / 2;
+	uint64_t sent = 0;
+	size_t count;
+	size_t i;
+
+	if (altstream->rtp_fd < 0) {
+		return -1;
+	}
+
+	/* Only audio has a place in an RTP stream */
+	if (opcode != AST_WEBSOCKET_OPCODE_BINARY) {
+		return 0;
+	}
+
+	while (sent < total) {
+		count = MIN(total - sent, ALTSTREAM_RTP_MAX_PAYLOAD / 2);
+
+		packet[0] = 0x80;
+		packet[1] = altstream->rtp_pt & 0x7f;
+		put_unaligned_uint16(packet + 2, htons(altstream->rtp_seq));
+		put_unaligned_uint32(packet + 4, htonl(altstream->rtp_ts));
+		put_unaligned_uint32(packet + 8, htonl(altstream->rtp_ssrc));
+		/* L16 is big endian on the wire */
+		for (i = 0; i < count; i++) {
+			payload[i] = htons(samples[sent + i]);
+		}
+
+		/* A lossy or congested path drops packets instead of holding up the stream */
+		if (send(altstream->rtp_fd, packet, ALTSTREAM_RTP_HEADER_SIZE + count * 2, MSG_NOSIGNAL) < 0) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS && errno != ECONNREFUSED) {
+				return -1;
+			}
+			altstream->altstream_ds->frames_dropped++;
+		}
+
+		altstream->rtp_seq++;
+		altstream->rtp_ts += count;
+		sent += count;
+	}
+
+	return 0;
+}
+
+static void altstream_wav_header(char *header, unsigned int rate, uint64_t data_len)
+{
+	uint32_t len = MIN(data_len, UINT32_MAX - 36);
+
+	memcpy(header, "RIFF", 4);
+	put_unaligned_uint32(header + 4, htole32(len + 36));
+	memcpy(header + 8, "WAVEfmt ", 8);
+	put_unaligned_uint32(header + 16, htole32(16));
+	put_unaligned_uint16(header + 20, htole16(1));
+	put_unaligned_uint16(header + 22, htole16(1));
+	put_unaligned_uint32(header + 24, htole32(rate));
+	put_unaligned_uint32(header + 28, htole32(rate * sizeof(int16_t)));
+	put_unaligned_uint16(header + 32, htole16(sizeof(int16_t)));
+	put_unaligned_uint16(header + 34, htole16(16));
+	memcpy(header + 36, "data", 4);
+	put_unaligned_uint32(header + 40, htole32(len));
+}
+
+/*! \brief Utterance being cut from the audio of an http:// endpoint, shared with its uploads */
+struct altstream_segmenter {
+	/* the endpoint without its query, and the form fields the query held */
+	char *url;
+	char *fields;
+	/* whose audio it is, for the transcripts */
+	char *channel;
+	char *uniqueid;
+	char *id;
+	unsigned int transcripts;
+	unsigned int rate;
+	/* sum of squares a frame needs per sample to be speech */
+	double level;
+	size_t preroll;
+	size_t hangover;
+	size_t min_speech;
+	size_t max_len;
+	int16_t *buf;
+	size_t len;
+	size_t size;
+	/* within an utterance, its speech so far and the silence since */
+	int speaking;
+	size_t speech;
+	size_t silence;
+	/* samples of the stream before buf[0] */
+	uint64_t position;
+	unsigned int segments;
+};
+
+/*! \brief One utterance waiting for an upload worker */
+struct altstream_segment {
+	struct altstream_segmenter *segmenter;
+	struct timeval queued;
+	unsigned int number;
+	double start;
+	double duration;
+	size_t len;
+	AST_LIST_ENTRY(altstream_segment) list;
+	char wav[0];
+};
+
+/*! \brief Utterances of every http:// endpoint, posted by a few workers that keep their connections open */
+static struct {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	AST_LIST_HEAD_NOLOCK(, altstream_segment) queue;
+	pthread_t workers[ALTSTREAM_HTTP_WORKERS];
+	int num_workers;
+	int stop;
+	unsigned int depth;
+	unsigned int max_depth;
+	unsigned int running;
+	uint64_t queued;
+	uint64_t posted;
+	uint64_t failed;
+	uint64_t dropped;
+	uint64_t audio_ms;
+	uint64_t wait_us;
+	uint64_t max_wait_us;
+	uint64_t run_us;
+	uint64_t max_run_us;
+} altstream_uploads;
+
+static void altstream_segmenter_destroy(void *obj)
+{
+	struct altstream_segmenter *segmenter = obj;
+
+	ast_free(segmenter->url);
+	ast_free(segmenter->fields);
+	ast_free(segmenter->channel);
+	ast_free(segmenter->uniqueid);
+	ast_free(segmenter->id);
+	ast_free(segmenter->buf);
+}
+
+static void altstream_segment_free(struct altstream_segment *segment)
+{
+	ast_atomic_fetchadd_int(&altstream_admission.buffered, -(int) segment->len);
+	ao2_cleanup(segment->segmenter);
+	ast_free(segment);
+}
+
+/*! \brief Hand the transcript of \a segment, or its failure, to the dialplan and manager */
+static void altstream_transcript_deliver(struct altstream_segment *segment, int res, long code, const char *text, uint64_t latency_us)
+{
+	struct altstream_segmenter *segmenter = segment->segmenter;
+	struct ast_channel *chan;
+	char *line = ast_strdup(res ? "" : S_OR(text, ""));
+	char *p;
+
+	if (!line) {
+		return;
+	}
+	/* manager headers end at a line break */
+	for (p = line; *p; p++) {
+		if (*p == '\r' || *p == '\n') {
+			*p = ' ';
+		}
+	}
+	text = ast_strip(line);
+
+	if (segmenter->transcripts & ALTSTREAM_TRANSCRIPTS_AMI) {
+		manager_event(EVENT_FLAG_CALL, "AltStreamTranscript",
+			"Channel: %s\r\n"
+			"Uniqueid: %s\r\n"
+			"AltStreamID: %s\r\n"
+			"Endpoint: %s\r\n"
+			"Segment: %u\r\n"
+			"Start: %.2f\r\n"
+			"Duration: %.2f\r\n"
+			"Status: %s\r\n"
+			"HttpCode: %ld\r\n"
+			"Latency: %.3f\r\n"
+			"Text: %s\r\n",
+			segmenter->channel, segmenter->uniqueid, segmenter->id, segmenter->url, segment->number,
+			segment->start, segment->duration, res ? "Failed" : "Success", code, latency_us / 1000000.0, text);
+	}
+
+	if ((segmenter->transcripts & ALTSTREAM_TRANSCRIPTS_VAR) && !res
+		&& (chan = ast_channel_get_by_name(segmenter->uniqueid))) {
+		char name[64];
+		char number[16];
+		const char *highest;
+
+		snprintf(name, sizeof(name), "ALTSTREAM_TRANSCRIPT_%u", segment->number);
+		snprintf(number, sizeof(number), "%u", segment->number);
+		ast_channel_lock(chan);
+		pbx_builtin_setvar_helper(chan, name, text);
+		/* uploads finish in any order */
+		highest = pbx_builtin_getvar_helper(chan, "ALTSTREAM_TRANSCRIPTS");
+		if (ast_strlen_zero(highest) || strtoul(highest, NULL, 10) < segment->number) {
+			pbx_builtin_setvar_helper(chan, "ALTSTREAM_TRANSCRIPTS", number);
+		}
+		ast_channel_unlock(chan);
+		ast_channel_unref(chan);
+	}
+
+	ast_free(line);
+}
+
+#ifdef HAVE_CURL
+static size_t altstream_upload_response(char *data, size_t size, size_t nmemb, void *userdata)
+{
+	struct ast_str **body = userdata;
+
+	/* anything past the limit is not a transcript worth keeping */
+	ast_str_append_substr(body, ALTSTREAM_HTTP_MAX_RESPONSE, data, size * nmemb);
+
+	return size * nmemb;
+}
+
+/*! \brief Post one utterance, the response ends up in \a body. 0 on a 2xx answer */
+static int altstream_upload_post(CURL *curl, struct altstream_segment *segment, long *code, struct ast_str **body)
+{
+	struct altstream_segmenter *segmenter = segment->segmenter;
+	char *fields = ast_strdupa(segmenter->fields);
+	char *field;
+	curl_mime *mime;
+	curl_mimepart *part;
+	CURLcode res;
+
+	if (!(mime = curl_mime_init(curl))) {
+		return -1;
+	}
+	part = curl_mime_addpart(mime);
+	curl_mime_name(part, "file");
+	curl_mime_filename(part, "segment.wav");
+	curl_mime_type(part, "audio/wav");
+	curl_mime_data(part, segment->wav, segment->len);
+	while ((field = strsep(&fields, "&"))) {
+		char *value = field;
+
+		strsep(&value, "=");
+		if (ast_strlen_zero(field)) {
+			continue;
+		}
+		part = curl_mime_addpart(mime);
+		curl_mime_name(part, field);
+		curl_mime_data(part, S_OR(value, ""), CURL_ZERO_TERMINATED);
+	}
+
+	ast_str_reset(*body);
+	curl_easy_setopt(curl, CURLOPT_URL, segmenter->url);
+	curl_easy_setopt(curl, CURLOPT_MIMEPOST, mime);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, body);
+	res = curl_easy_perform(curl);
+	curl_easy_setopt(curl, CURLOPT_MIMEPOST, NULL);
+	curl_mime_free(mime);
+
+	if (res != CURLE_OK) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] Could not post utterance %u to %s: %s\n", segmenter->channel,
+			segment->number, segmenter->url, curl_easy_strerror(res));
+		return -1;
+	}
+	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, code);
+	if (*code / 100 != 2) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] %s answered utterance %u with status %ld\n", segmenter->channel,
+			segmenter->url, segment->number, *code);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *altstream_upload_worker(void *data)
+{
+	/* the handle keeps its connections open between requests to the same servers */
+	CURL *curl = curl_easy_init();
+	struct ast_str *body = ast_str_create(512);
+
+	if (curl) {
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, (long) ALTSTREAM_HTTP_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, (long) ALTSTREAM_HTTP_CONNECT_TIMEOUT);
+		curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+		curl_easy_setopt(curl, CURLOPT_USERAGENT, "asterisk-altstream");
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, altstream_upload_response);
+	}
+
+	ast_mutex_lock(&altstream_uploads.lock);
+	for (;;) {
+		struct altstream_segment *segment;
+		struct ast_json *json = NULL;
+		const char *text = NULL;
+		struct timeval started;
+		uint64_t waited;
+		uint64_t ran;
+		long code = 0;
+		int res;
+
+		if (altstream_uploads.stop) {
+			break;
+		}
+		if (AST_LIST_EMPTY(&altstream_uploads.queue)) {
+			ast_cond_wait(&altstream_uploads.cond, &altstream_uploads.lock);
+			continue;
+		}
+
+		segment = AST_LIST_REMOVE_HEAD(&altstream_uploads.queue, list);
+		altstream_uploads.depth--;
+		altstream_uploads.running++;
+		ast_mutex_unlock(&altstream_uploads.lock);
+
+		started = ast_tvnow();
+		waited = ast_tvdiff_us(started, segment->queued);
+		res = curl && body ? altstream_upload_post(curl, segment, &code, &body) : -1;
+		ran = ast_tvdiff_us(ast_tvnow(), started);
+		if (!res) {
+			/* OpenAI style servers answer {"text":"..."}, anything else is taken as it is */
+			json = ast_json_load_buf(ast_str_buffer(body), ast_str_strlen(body), NULL);
+			text = json ? ast_json_string_get(ast_json_object_get(json, "text")) : NULL;
+			if (!text) {
+				text = ast_str_buffer(body);
+			}
+		}
+		altstream_transcript_deliver(segment, res, code, text, waited + ran);
+		ast_json_unref(json);
+
+		ast_mutex_lock(&altstream_uploads.lock);
+		altstream_uploads.running--;
+		altstream_uploads.posted++;
+		altstream_uploads.failed += res ? 1 : 0;
+		altstream_uploads.audio_ms += segment->duration * 1000;
+		altstream_uploads.wait_us += waited;
+		altstream_uploads.max_wait_us = MAX(altstream_uploads.max_wait_us, waited);
+		altstream_uploads.run_us += ran;
+		altstream_uploads.max_run_us = MAX(altstream_uploads.max_run_us, ran);
+		altstream_segment_free(segment);
+	}
+	ast_mutex_unlock(&altstream_uploads.lock);
+
+	if (curl) {
+		curl_easy_cleanup(curl);
+	}
+	ast_free(body);
+
+	return NULL;
+}
+#endif
+
+/*! \brief Hand an utterance to the upload workers, never waits for it */
+static int altstream_upload_queue(struct altstream_segment *segment)
+{
+	segment->queued = ast_tvnow();
+
+	ast_mutex_lock(&altstream_uploads.lock);
+	if (altstream_uploads.depth >= ALTSTREAM_HTTP_QUEUE || !altstream_uploads.num_workers || altstream_uploads.stop) {
+		altstream_uploads.dropped++;
+		ast_mutex_unlock(&altstream_uploads.lock);
+		ast_log(LOG_WARNING, "<%s> [AltStream] Upload queue is full, dropping utterance %u\n",
+			segment->segmenter->channel, segment->number);
+		altstream_segment_free(segment);
+		return -1;
+	}
+	AST_LIST_INSERT_TAIL(&altstream_uploads.queue, segment, list);
+	altstream_uploads.depth++;
+	altstream_uploads.max_depth = MAX(altstream_uploads.max_depth, altstream_uploads.depth);
+	altstream_uploads.queued++;
+	ast_cond_signal(&altstream_uploads.cond);
+	ast_mutex_unlock(&altstream_uploads.lock);
+
+	return 0;
+}
+
+static void altstream_uploads_start(void)
+{
+	ast_mutex_init(&altstream_uploads.lock);
+	ast_cond_init(&altstream_uploads.cond, NULL);
+
+#ifdef HAVE_CURL
+	/* res_curl owns libcurl's global state */
+	for (altstream_uploads.num_workers = 0; altstream_uploads.num_workers < ALTSTREAM_HTTP_WORKERS; altstream_uploads.num_workers++) {
+		if (ast_pthread_create_background(&altstream_uploads.workers[altstream_uploads.num_workers], NULL, altstream_upload_worker, NULL)) {
+			ast_log(LOG_WARNING, "[AltStream] Only %d upload workers\n", altstream_uploads.num_workers);
+			break;
+		}
+	}
+#endif
+}
+
+/*! \brief Drop what is still queued, then stop the workers once their current posts are done */
+static void altstream_uploads_stop(void)
+{
+	struct altstream_segment *segment;
+	unsigned int dropped = 0;
+	int i;
+
+	ast_mutex_lock(&altstream_uploads.lock);
+	altstream_uploads.stop = 1;
+	/* a backlog of slow posts would hold up the unload for minutes */
+	while ((segment = AST_LIST_REMOVE_HEAD(&altstream_uploads.queue, list))) {
+		altstream_uploads.depth--;
+		altstream_uploads.dropped++;
+		altstream_segment_free(segment);
+		dropped++;
+	}
+	ast_cond_broadcast(&altstream_uploads.cond);
+	ast_mutex_unlock(&altstream_uploads.lock);
+
+	if (dropped) {
+		ast_log(LOG_WARNING, "[AltStream] Dropped %u queued utterances on unload\n", dropped);
+	}
+
+	for (i = 0; i < altstream_uploads.num_workers; i++) {
+		pthread_join(altstream_uploads.workers[i], NULL);
+	}
+	altstream_uploads.num_workers = 0;
+
+	ast_mutex_destroy(&altstream_uploads.lock);
+	ast_cond_destroy(&altstream_uploads.cond);
+}
+
+/*! \brief Package the utterance collected so far and queue it, then start looking for the next one */
+static void altstream_segmenter_cut(struct altstream *altstream)
+{
+	struct altstream_segmenter *segmenter = altstream->segmenter;
+	struct altstream_segment *segment;
+	/* the silence that ended it goes too, bar as much as came before the speech */
+	size_t trailing = segmenter->silence > segmenter->preroll ? segmenter->silence - segmenter->preroll : 0;
+	size_t count = segmenter->len - trailing;
+	size_t len = ALTSTREAM_WAV_HEADER_SIZE + count * sizeof(int16_t);
+	size_t keep;
+
+	if (segmenter->speech < segmenter->min_speech) {
+		/* too short to be speech */
+	} else if (altstream_buffered_take(len)) {
+		/* queued utterances count against max_buffered like any other held audio */
+		altstream->altstream_ds->segments_dropped++;
+	} else if (!(segment = ast_calloc(1, sizeof(*segment) + len))) {
+		ast_atomic_fetchadd_int(&altstream_admission.buffered, -(int) len);
+	} else {
+		segment->segmenter = ao2_bump(segmenter);
+		segment->number = ++segmenter->segments;
+		segment->start = (double) segmenter->position / segmenter->rate;
+		segment->duration = (double) count / segmenter->rate;
+		segment->len = len;
+		altstream_wav_header(segment->wav, segmenter->rate, count * sizeof(int16_t));
+		memcpy(segment->wav + ALTSTREAM_WAV_HEADER_SIZE, segmenter->buf, count * sizeof(int16_t));
+		if (altstream_upload_queue(segment)) {
+			altstream->altstream_ds->segments_dropped++;
+		} else {
+			altstream->altstream_ds->segments++;
+		}
+	}
+
+	/* the silence at the end leads into the next one */
+	keep = MIN(segmenter->silence, segmenter->preroll);
+	memmove(segmenter->buf, segmenter->buf + segmenter->len - keep, keep * sizeof(int16_t));
+	segmenter->position += segmenter->len - keep;
+	segmenter->len = keep;
+	segmenter->speaking = 0;
+	segmenter->speech = 0;
+	segmenter->silence = 0;
+}
+
+/*! \brief Send the utterance in progress as it is */
+static void altstream_segmenter_flush(struct altstream *altstream)
+{
+	if (altstream->segmenter && altstream->segmenter->speaking) {
+		altstream_segmenter_cut(altstream);
+	}
+}
+
+static int altstream_http_close(struct altstream *altstream)
+{
+	if (!altstream->segmenter) {
+		return 0;
+	}
+
+	altstream_segmenter_flush(altstream);
+	ao2_ref(altstream->segmenter, -1);
+	altstream->segmenter = NULL;
+
+	return 0;
+}
+
+static int altstream_http_connect(struct altstream *altstream)
+{
+	struct altstream *owner = altstream->parent ? altstream->parent : altstream;
+	struct altstream_segmenter *segmenter;
+	double level = ALTSTREAM_VAD_LEVEL;
+	unsigned int silence = ALTSTREAM_VAD_SILENCE;
+	unsigned int max = ALTSTREAM_VAD_MAX;
+	char *query;
+	char *param;
+
+	/* every upload makes its own way to the server, there is nothing to reopen */
+	if (altstream->segmenter) {
+		return 0;
+	}
+
+	if (!altstream_uploads.num_workers) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) No upload workers for %s, is Asterisk built with libcurl?\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->altstream_ds->wsserver);
+		return -1;
+	}
+
+	if (!(segmenter = ao2_alloc_options(sizeof(*segmenter), altstream_segmenter_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return -1;
+	}
+	segmenter->url = ast_strdup(altstream->altstream_ds->wsserver);
+	segmenter->channel = ast_strdup(ast_channel_name(altstream->autochan->chan));
+	segmenter->uniqueid = ast_strdup(ast_channel_uniqueid(altstream->autochan->chan));
+	segmenter->id = ast_strdup(owner->entry ? owner->entry->id : "");
+	if (!segmenter->url || !segmenter->channel || !segmenter->uniqueid || !segmenter->id
+		|| !(segmenter->fields = ast_calloc(1, strlen(segmenter->url) + 1))) {
+		ao2_ref(segmenter, -1);
+		return -1;
+	}
+
+	/* the query is ours or goes along as form fields */
+	if ((query = strchr(segmenter->url, '?'))) {
+		*query++ = '\0';
+	}
+	while ((param = strsep(&query, "&"))) {
+		if (!strncmp(param, "vad_level=", 10)) {
+			if (sscanf(param + 10, "%30lf", &level) != 1 || level > 0) {
+				ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Invalid speech level '%s', using %.0f dBFS\n",
+					segmenter->channel, altstream->direction_string, param + 10, ALTSTREAM_VAD_LEVEL);
+				level = ALTSTREAM_VAD_LEVEL;
+			}
+		} else if (!strncmp(param, "vad_silence=", 12)) {
+			if (sscanf(param + 12, "%30u", &silence) != 1 || !silence) {
+				ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Invalid utterance silence '%s', using %d ms\n",
+					segmenter->channel, altstream->direction_string, param + 12, ALTSTREAM_VAD_SILENCE);
+				silence = ALTSTREAM_VAD_SILENCE;
+			}
+		} else if (!strncmp(param, "vad_max=", 8)) {
+			if (sscanf(param + 8, "%30u", &max) != 1 || max < ALTSTREAM_VAD_MIN_SPEECH) {
+				ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Invalid utterance length '%s', using %d ms\n",
+					segmenter->channel, altstream->direction_string, param + 8, ALTSTREAM_VAD_MAX);
+				max = ALTSTREAM_VAD_MAX;
+			}
+		} else if (!ast_strlen_zero(param)) {
+			if (*segmenter->fields) {
+				strcat(segmenter->fields, "&");
+			}
+			strcat(segmenter->fields, param);
+		}
+	}
+
+	segmenter->transcripts = altstream->transcripts;
+	segmenter->rate = altstream->samp_rate;
+	segmenter->level = 32768.0 * 32768.0 * pow(10.0, level / 10.0);
+	segmenter->preroll = (size_t) ALTSTREAM_VAD_PREROLL * segmenter->rate / 1000;
+	segmenter->hangover = (size_t) silence * segmenter->rate / 1000;
+	segmenter->min_speech = (size_t) ALTSTREAM_VAD_MIN_SPEECH * segmenter->rate / 1000;
+	segmenter->max_len = (size_t) max * segmenter->rate / 1000;
+	altstream->segmenter = segmenter;
+
+	ast_verb(2, "<%s> [AltStream] (%s) Posting utterances to %s, speech above %.0f dBFS, %u ms of silence ends one\n",
+		segmenter->channel, altstream->direction_string, segmenter->url, level, silence);
+
+	return 0;
+}
+
+static int altstream_http_write(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	struct altstream_segmenter *segmenter = altstream->segmenter;
+	const int16_t *samples = (const int16_t *) data;
+	size_t count = len / sizeof(int16_t);
+
+	if (!segmenter) {
+		return -1;
+	}
+
+	/* utterances are cut from the audio alone */
+	if (opcode != AST_WEBSOCKET_OPCODE_BINARY || !count) {
+		return 0;
+	}
+
+	if (segmenter->len + count > segmenter->size) {
+		size_t size = MAX(segmenter->size * 2, segmenter->len + count);
+		int16_t *buf = ast_realloc(segmenter->buf, size * sizeof(int16_t));
+
+		if (!buf) {
+			altstream->altstream_ds->frames_dropped++;
+			return 0;
+		}
+		segmenter->buf = buf;
+		segmenter->size = size;
+	}
+	memcpy(segmenter->buf + segmenter->len, samples, count * sizeof(int16_t));
+	segmenter->len += count;
+
+	if (altstream_kernels->energy(samples, count) >= segmenter->level * count) {
+		segmenter->speaking = 1;
+		segmenter->speech += count;
+		segmenter->silence = 0;
+	} else if (segmenter->speaking) {
+		segmenter->silence += count;
+	} else {
+		/* until someone speaks only the preroll is kept */
+		if (segmenter->len > segmenter->preroll) {
+			size_t drop = segmenter->len - segmenter->preroll;
+
+			memmove(segmenter->buf, segmenter->buf + drop, segmenter->preroll * sizeof(int16_t));
+			segmenter->len = segmenter->preroll;
+			segmenter->position += drop;
+		}
+		return 0;
+	}
+
+	if (segmenter->silence >= segmenter->hangover || segmenter->len >= segmenter->max_len) {
+		altstream_segmenter_cut(altstream);
+	}
+
+	return 0;
+}
+
+static const struct altstream_transport altstream_ws_transport = {
+	.name = "websocket",
+	.connect = altstream_ws_transport_connect,
+	.write = altstream_ws_write,
+	.close = altstream_ws_close,
+	.service = altstream_ws_service,
+};
+
+static const struct altstream_transport altstream_unix_transport = {
+	.name = "unix",
+	.prefix = ALTSTREAM_UNIX_PREFIX,
+	.connect = altstream_unix_connect,
+	.write = altstream_unix_write,
+	.close = altstream_unix_close,
+	.service = altstream_unix_service,
+};
+
+static const struct altstream_transport altstream_shm_transport = {
+	.name = "shared memory",
+	.prefix = ALTSTREAM_SHM_PREFIX,
+	.connect = altstream_shm_connect,
+	.write = altstream_shm_write,
+	.close = altstream_shm_close,
+};
+
+static const struct altstream_transport altstream_rtp_transport = {
+	.name = "RTP",
+	.prefix = ALTSTREAM_RTP_PREFIX,
+	.connect = altstream_rtp_connect,
+	.write = altstream_rtp_write,
+	.close = altstream_rtp_close,
+	.pcm_only = 1,
+};
+
+static const struct altstream_transport altstream_http_transport = {
+	.name = "HTTP",
+	.prefix = ALTSTREAM_HTTP_PREFIX,
+	.connect = altstream_http_connect,
+	.write = altstream_http_write,
+	.close = altstream_http_close,
+	.pcm_only = 1,
+};
+
+/* same uploads, libcurl takes care of TLS */
+static const struct altstream_transport altstream_https_transport = {
+	.name = "HTTPS",
+	.prefix = ALTSTREAM_HTTPS_PREFIX,
+	.connect = altstream_http_connect,
+	.write = altstream_http_write,
+	.close = altstream_http_close,
+	.pcm_only = 1,
+};
+
+static const struct altstream_transport *altstream_transports[] = {
+	&altstream_unix_transport,
+	&altstream_shm_transport,
+	&altstream_rtp_transport,
+	&altstream_http_transport,
+	&altstream_https_transport,
+};
+
+static const struct altstream_transport *altstream_transport_find(const char *wsserver)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(altstream_transports); i++) {
+		if (!strncasecmp(wsserver, altstream_transports[i]->prefix, strlen(altstream_transports[i]->prefix))) {
+			return altstream_transports[i];
+		}
+	}
+
+	return &altstream_ws_transport;
+}
+
+/*! \brief The transport of the first endpoint in \a wsserver that only carries PCM, NULL when none does */
+static const struct altstream_transport *altstream_transport_pcm_only(const char *wsserver)
+{
+	char *list = ast_strdupa(wsserver);
+	char *endpoint;
+
+	while ((endpoint = strsep(&list, ALTSTREAM_DEST_SEPARATOR))) {
+		const struct altstream_transport *transport = altstream_transport_find(ast_strip(endpoint));
+
+		if (transport->pcm_only) {
+			return transport;
+		}
+	}
+
+	return NULL;
+}
+
+/*!
+ * \brief Name the session to the server, then send again what it has not acknowledged
+ *
+ * The first binary message after this one is number \a seq, and every binary message after
+ * that is one more, also across reconnects. The server acknowledges them with
+ * {"event":"ack","seq":N} and drops anything it already has when the session is resumed.
+ */
+static int altstream_resume_session(struct altstream *altstream)
+{
+	char session[256];
+	unsigned int i;
+	int len;
+
+	len = snprintf(session, sizeof(session), "{\"event\":\"session\",\"session\":\"%s\",\"resume\":%s,\"seq\":%" PRIu64 "}",
+		altstream->session, altstream->resuming ? "true" : "false",
+		altstream->resume_count ? altstream->resume_seq : altstream->next_seq);
+	if (altstream->transport->write(altstream, AST_WEBSOCKET_OPCODE_TEXT, session, len)) {
+		return -1;
+	}
+
+	if (altstream->resume_count) {
+		ast_verb(2, "<%s> [AltStream] (%s) Resuming session %s, sending %u unacknowledged messages again\n",
+			ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->session, altstream->resume_count);
+	}
+	for (i = 0; i < altstream->resume_count; i++) {
+		struct altstream_msg *msg = altstream->resume_buf[(altstream->resume_head + i) % altstream->resume_size].msg;
+
+		if (altstream->transport->write(altstream, msg->opcode, msg->data, msg->len)) {
+			altstream_resume_stats(altstream, i, 0);
+			return -1;
+		}
+	}
+	altstream_resume_stats(altstream, altstream->resume_count, 0);
+	altstream->resuming = 1;
+
+	return 0;
+}
+
+static int altstream_features_info(struct altstream *altstream, char *info, size_t size)
+{
+	return snprintf(info, size,
+		"{\"event\":\"features\",\"type\":\"log-mel\",\"bins\":%d,\"sample_rate\":%d,"
+		"\"n_fft\":%d,\"hop\":%d,\"format\":\"%s\"}",
+		ALTSTREAM_MEL_BINS, ALTSTREAM_MEL_RATE, ALTSTREAM_MEL_N_FFT, ALTSTREAM_MEL_HOP,
+		altstream->mel->format == ALTSTREAM_FEATURES_F32 ? "f32" : "q12");
+}
+
+static int altstream_connect(struct altstream *altstream)
+{
+	char info[256];
+	int len;
+
+	if (altstream->transport->connect(altstream)) {
+		return -1;
+	}
+
+	if (altstream->mel) {
+		/* Tell the consumer what the binary messages hold before the first one */
+		len = altstream_features_info(altstream, info, sizeof(info));
+		if (altstream->transport->write(altstream, AST_WEBSOCKET_OPCODE_TEXT, info, len)) {
+			return -1;
+		}
+	}
+
+	return altstream->resume_window ? altstream_resume_session(altstream) : 0;
+}
+
+static int altstream_write(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	if (altstream->transport->write(altstream, opcode, data, len)) {
+		return -1;
+	}
+
+	/* a message that could not be written is sent again by the caller, and numbered then */
+	if (altstream->resume_window && opcode == AST_WEBSOCKET_OPCODE_BINARY) {
+		altstream_resume_keep(altstream, data, len);
+	}
+
+	return 0;
+}
+
+static int altstream_close(struct altstream *altstream)
+{
+	return altstream->transport->close(altstream);
+}
+
+static int altstream_service(struct altstream *altstream)
+{
+	uint64_t now;
+
+	if (!altstream->transport->service) {
+		return 0;
+	}
+
+	now = altstream_monotonic_us();
+	if (now - altstream->last_service < ALTSTREAM_SERVICE_INTERVAL_US) {
+		return 0;
+	}
+	altstream->last_service = now;
+
+	return altstream->transport->service(altstream);
+}
+
+/*! \brief Whether the endpoint a connection sends for is being torn down */
+static int altstream_dest_stopping(struct altstream *altstream)
+{
+	int stop;
+
+	if (!altstream->dest) {
+		return 0;
+	}
+
+	ast_mutex_lock(&altstream->dest->lock);
+	stop = altstream->dest->stop;
+	ast_mutex_unlock(&altstream->dest->lock);
+
+	return stop;
+}
+
+/*
+	reconn_status
+	0 = OK
+	1 = FAILED
+*/
+static int altstream_start_reconnecting(struct altstream *altstream)
+{
+	int counter= 0;
+	int status = 0;
+	int timeout = altstream->reconnection_timeout;
+	int attempts = altstream->reconnection_attempts;
+	int last_attempt = 0;
+	int now;
+	int delta;
+	int result;
+
+	while (counter < attempts) {
+		// an endpoint being torn down is not waited for
+		if (altstream_dest_stopping(altstream)) {
+			status = 1;
+			break;
+		}
+
+		now = (int)time(NULL);
+		delta = now - last_attempt;
+
+		// small check to see if we should keep waiting on the reconnection. This uses the
+		// reconnection_timeout variable configured in the dialplan
+		if (last_attempt != 0 && delta <= timeout) {
+			// keep waiting
+			usleep(100000);
+			continue;
+		}
+
+		// try to reconnect
+		result = altstream_connect(altstream);
+		if (!result) {
+			status = 0;
+			last_attempt = 0;
+			break;
+		}
+
+		// reconnection failed...
+		// update our counter with the last reconnection attempt
+		last_attempt=(int)time(NULL);
+
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Reconnection failed... trying again in %d seconds. %d attempts remaining reconn_now %d reconn_last_attempt %d\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, timeout, (attempts-counter), now, last_attempt);
+
+		counter ++;
+		status = 1;
+	}
+
+	return status;
+}
+
+/*! \brief Number of endpoints of a fanned out stream still connected or reconnecting */
+static int altstream_dests_live(struct altstream *altstream)
+{
+	int live = 0;
+	int i;
+
+	for (i = 0; i < altstream->num_dests; i++) {
+		struct altstream_dest *dest = altstream->dests[i];
+
+		ast_mutex_lock(&dest->lock);
+		live += !dest->failed;
+		ast_mutex_unlock(&dest->lock);
+	}
+	altstream->altstream_ds->destinations_failed = altstream->num_dests - live;
+
+	return live;
+}
+
+/*! \brief Check the connection and reconnect if the peer went away, non-zero to give up */
+static int altstream_check_connection(struct altstream *altstream)
+{
+	if (altstream->num_dests) {
+		/* every endpoint looks after its own connection */
+		return altstream_dests_live(altstream) ? 0 : -1;
+	}
+
+	if (!altstream_service(altstream)) {
+		return 0;
+	}
+
+	ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Lost %s connection.  Reconnecting...\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->transport->name);
+	if (altstream_start_reconnecting(altstream)) {
+		altstream_close(altstream);
+		return -1;
+	}
+
+	return 0;
+}
+
+/*!
+ * \brief TLS settings of one connection
+ *
+ * Not shared between connections or from the profile: the core's TLS
+ * client keeps the SSL_CTX it sets up for each connect in here.
+ */
+static struct ast_tls_config *altstream_tls_cfg_alloc(void)
+{
+	struct ast_tls_config *tls_cfg = ast_calloc(1, sizeof(*tls_cfg));
+
+	if (tls_cfg) {
+		ast_set_flag(&tls_cfg->flags, AST_SSL_DONT_VERIFY_SERVER);
+	}
+
+	return tls_cfg;
+}
+
+static void altstream_tls_cfg_free(struct ast_tls_config *tls_cfg)
+{
+	if (tls_cfg) {
+		ast_ssl_teardown(tls_cfg);
+		ast_free(tls_cfg);
+	}
+}
+
+/*! \brief Connection to one endpoint of a fanned out stream, set up like \a altstream */
+static struct altstream *altstream_conn_alloc(struct altstream *altstream, const char *wsserver)
+{
+	struct altstream *conn = ast_calloc(1, sizeof(*conn));
+
+	if (!conn) {
+		return NULL;
+	}
+
+	conn->altstream_ds = ast_calloc(1, sizeof(*conn->altstream_ds));
+	conn->wsserver = ast_strdup(wsserver);
+	if (altstream->has_tls) {
+		conn->tls_cfg = altstream_tls_cfg_alloc();
+	}
+	if (!conn->altstream_ds || !conn->wsserver || (altstream->has_tls && !conn->tls_cfg)) {
+		ast_free(conn->altstream_ds);
+		ast_free(conn->wsserver);
+		altstream_tls_cfg_free(conn->tls_cfg);
+		ast_free(conn);
+		return NULL;
+	}
+	/* the transports find their endpoint and keep their figures in here */
+	conn->altstream_ds->wsserver = ast_strdup(wsserver);
+	conn->altstream_ds->samp_rate = altstream->samp_rate;
+
+	conn->transport = altstream_transport_find(wsserver);
+	conn->unix_fd = -1;
+	conn->shm_fd = -1;
+	conn->shm_event_fd = -1;
+	conn->rtp_fd = -1;
+	conn->flags = altstream->flags;
+	conn->autochan = altstream->autochan;
+	conn->direction = altstream->direction;
+	conn->direction_string = altstream->direction_string;
+	conn->has_tls = altstream->has_tls;
+	conn->reconnection_attempts = altstream->reconnection_attempts;
+	conn->reconnection_timeout = altstream->reconnection_timeout;
+	conn->ping_interval = altstream->ping_interval;
+	conn->pong_timeout = altstream->pong_timeout;
+	conn->compression_level = altstream->compression_level;
+	conn->compression_no_takeover = altstream->compression_no_takeover;
+	/* acknowledgements only come back over websockets */
+	conn->resume_window = conn->transport == &altstream_ws_transport ? altstream->resume_window : 0;
+	ast_copy_string(conn->session, altstream->session, sizeof(conn->session));
+	conn->samp_rate = altstream->samp_rate;
+	conn->capture_rate = altstream->capture_rate;
+	conn->parent = altstream;
+	/* borrowed from the stream, only read to describe the features on connect */
+	conn->mel = altstream->mel;
+	conn->transcripts = altstream->transcripts;
+
+	return conn;
+}
+
+static void altstream_conn_free(struct altstream *conn)
+{
+	if (!conn) {
+		return;
+	}
+
+	altstream_close(conn);
+	altstream_tls_cfg_free(conn->tls_cfg);
+#ifdef HAVE_ZLIB
+	altstream_deflate_destroy(conn);
+#endif
+	altstream_resume_free(conn);
+	ast_free(conn->ws_frame_buf);
+	ast_free(conn->wsserver);
+	ast_free(conn->altstream_ds->wsserver);
+	ast_free(conn->altstream_ds);
+	ast_free(conn);
+}
+
+/*! \brief Write one message to an endpoint, reconnecting once if that fails */
+static int altstream_dest_write(struct altstream *conn, struct altstream_msg *msg)
+{
+	if (!altstream_write(conn, msg->opcode, msg->data, msg->len)) {
+		return 0;
+	}
+
+	ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Could not write to %s %s.  Reconnecting...\n", ast_channel_name(conn->autochan->chan),
+		conn->direction_string, conn->transport->name, conn->wsserver);
+	if (altstream_start_reconnecting(conn)) {
+		return -1;
+	}
+
+	return altstream_write(conn, msg->opcode, msg->data, msg->len);
+}
+
+static void *altstream_dest_thread(void *obj)
+{
+	struct altstream_dest *dest = obj;
+	struct altstream *conn = dest->conn;
+	int failed = 0;
+
+	if (!dest->connected && altstream_connect(conn)) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Could not connect to %s server: %s.  Reconnecting...\n",
+			ast_channel_name(conn->autochan->chan), conn->direction_string, conn->transport->name, conn->wsserver);
+		failed = altstream_start_reconnecting(conn);
+	}
+
+	ast_mutex_lock(&dest->lock);
+	dest->failed = failed;
+	while (!dest->failed) {
+		struct altstream_msg *msg;
+		int skip;
+		int res;
+
+		if (!dest->count) {
+			struct timeval wait;
+			struct timespec ts;
+
+			if (dest->stop) {
+				break;
+			}
+
+			wait = ast_tvadd(ast_tvnow(), ast_tv(0, ALTSTREAM_SERVICE_INTERVAL_US));
+			ts.tv_sec = wait.tv_sec;
+			ts.tv_nsec = wait.tv_usec * 1000;
+			ast_cond_timedwait(&dest->cond, &dest->lock, &ts);
+			if (!dest->count) {
+				/* idle, make sure the peer is still there */
+				ast_mutex_unlock(&dest->lock);
+				res = altstream_check_connection(conn);
+				ast_mutex_lock(&dest->lock);
+				dest->failed = res ? 1 : 0;
+				continue;
+			}
+		}
+
+		msg = dest->queue[dest->head];
+		dest->head = (dest->head + 1) % ALTSTREAM_DEST_QUEUE;
+		dest->count--;
+		ast_mutex_unlock(&dest->lock);
+
+		/* a paused endpoint still gets told what is going on */
+		skip = conn->paused && msg->opcode == AST_WEBSOCKET_OPCODE_BINARY;
+		res = skip ? 0 : altstream_dest_write(conn, msg);
+		ao2_ref(msg, -1);
+
+		/* acknowledgements and keepalives are looked after while busy too */
+		if (!res) {
+			res = altstream_check_connection(conn);
+		}
+
+		ast_mutex_lock(&dest->lock);
+		if (res) {
+			dest->failed = 1;
+		} else if (skip) {
+			dest->skipped++;
+		} else {
+			dest->sent++;
+		}
+	}
+
+	/* whatever is still queued has nowhere to go */
+	while (dest->count) {
+		ao2_ref(dest->queue[dest->head], -1);
+		dest->head = (dest->head + 1) % ALTSTREAM_DEST_QUEUE;
+		dest->count--;
+		dest->dropped++;
+	}
+	ast_mutex_unlock(&dest->lock);
+
+	altstream_close(conn);
+
+	return NULL;
+}
+
+/*!
+ * \brief Split a list of endpoints into one connection each, added to \a dests
+ * \retval -1 out of memory, the connections made so far are left for the caller
+ */
+static int altstream_dests_alloc(struct altstream *altstream, const char *wsserver, struct altstream_dest **dests, int *num_dests)
+{
+	char *list = ast_strdupa(wsserver);
+	char *endpoint;
+
+	while ((endpoint = strsep(&list, ALTSTREAM_DEST_SEPARATOR))) {
+		struct altstream_dest *dest;
+
+		endpoint = ast_strip(endpoint);
+		if (ast_strlen_zero(endpoint)) {
+			continue;
+		}
+		if (*num_dests == ALTSTREAM_MAX_DESTS) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Only %d endpoints are supported, ignoring %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, ALTSTREAM_MAX_DESTS, endpoint);
+			continue;
+		}
+		if (altstream->mel && altstream_transport_find(endpoint)->pcm_only) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Log-mel features cannot be carried over %s, ignoring %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream_transport_find(endpoint)->name, endpoint);
+			continue;
+		}
+		if (altstream->silence_keepalive && altstream_transport_find(endpoint)->pcm_only) {
+			/* a redirect, the stream was started with silence markers */
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Silence markers cannot be carried over %s, ignoring %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream_transport_find(endpoint)->name, endpoint);
+			continue;
+		}
+
+		if (!(dest = ast_calloc(1, sizeof(*dest)))) {
+			return -1;
+		}
+		if (!(dest->conn = altstream_conn_alloc(altstream, endpoint))) {
+			ast_free(dest);
+			return -1;
+		}
+		dest->conn->dest = dest;
+		ast_mutex_init(&dest->lock);
+		ast_cond_init(&dest->cond, NULL);
+		dests[(*num_dests)++] = dest;
+
+		ast_verb(2, "<%s> [AltStream] (%s) Endpoint %d: %s over %s\n", ast_channel_name(altstream->autochan->chan),
+			altstream->direction_string, *num_dests, endpoint, dest->conn->transport->name);
+	}
+
+	return 0;
+}
+
+static int altstream_dests_setup(struct altstream *altstream, const char *wsserver)
+{
+	if (altstream_dests_alloc(altstream, wsserver, altstream->dests, &altstream->num_dests)) {
+		return -1;
+	}
+
+	return altstream->num_dests ? 0 : -1;
+}
+
+static int altstream_dests_start(struct altstream *altstream)
+{
+	int started = 0;
+	int i;
+
+	for (i = 0; i < altstream->num_dests; i++) {
+		struct altstream_dest *dest = altstream->dests[i];
+
+		if (ast_pthread_create_background(&dest->thread, NULL, altstream_dest_thread, dest)) {
+			ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Unable to start sender for %s\n", ast_channel_name(altstream->autochan->chan),
+				altstream->direction_string, dest->conn->wsserver);
+			dest->failed = 1;
+			continue;
+		}
+		dest->started = 1;
+		started++;
+	}
+
+	return started ? 0 : -1;
+}
+
+/*! \brief Queue a message to every live endpoint, the oldest one goes when a queue is full */
+static int altstream_dests_send(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	struct altstream_msg *msg = altstream_msg_alloc(opcode, data, len);
+	int live = 0;
+	int i;
+
+	if (!msg) {
+		altstream->altstream_ds->frames_dropped++;
+		return 0;
+	}
+
+	for (i = 0; i < altstream->num_dests; i++) {
+		struct altstream_dest *dest = altstream->dests[i];
+
+		ast_mutex_lock(&dest->lock);
+		if (!dest->failed) {
+			if (dest->count == ALTSTREAM_DEST_QUEUE) {
+				ao2_ref(dest->queue[dest->head], -1);
+				dest->head = (dest->head + 1) % ALTSTREAM_DEST_QUEUE;
+				dest->count--;
+				dest->dropped++;
+				altstream->altstream_ds->frames_dropped++;
+			}
+			dest->queue[(dest->head + dest->count) % ALTSTREAM_DEST_QUEUE] = ao2_bump(msg);
+			dest->count++;
+			ast_cond_signal(&dest->cond);
+			live++;
+		}
+		ast_mutex_unlock(&dest->lock);
+	}
+	ao2_ref(msg, -1);
+
+	return live ? 0 : -1;
+}
+
+/*! \brief Let an endpoint send what it has queued, then tear it down */
+static void altstream_dest_destroy(struct altstream_dest *dest)
+{
+	if (dest->started) {
+		ast_mutex_lock(&dest->lock);
+		dest->stop = 1;
+		ast_cond_signal(&dest->cond);
+		ast_mutex_unlock(&dest->lock);
+		pthread_join(dest->thread, NULL);
+
+		ast_verb(2, "<%s> [AltStream] (%s) Endpoint %s: sent = %u, dropped = %u, skipped = %u%s\n", ast_channel_name(dest->conn->autochan->chan),
+			dest->conn->direction_string, dest->conn->wsserver, dest->sent, dest->dropped, dest->skipped, dest->failed ? ", failed" : "");
+	}
+
+	altstream_conn_free(dest->conn);
+	ast_mutex_destroy(&dest->lock);
+	ast_cond_destroy(&dest->cond);
+	ast_free(dest);
+}
+
+static void altstream_dests_destroy(struct altstream *altstream)
+{
+	int i;
+
+	for (i = 0; i < altstream->num_dests; i++) {
+		altstream_dest_destroy(altstream->dests[i]);
+		altstream->dests[i] = NULL;
+	}
+	altstream->num_dests = 0;
+}
+
+static int altstream_registry_add(struct altstream *altstream, struct ast_channel *chan, const char *id)
+{
+	struct altstream_entry *entry;
+	const char *wsserver = S_OR(altstream->wsserver, "");
+
+	if (!(entry = ao2_alloc(sizeof(*entry) + strlen(wsserver) + 1, NULL))) {
+		return -1;
+	}
+	ast_copy_string(entry->id, id, sizeof(entry->id));
+	ast_channel_lock(chan);
+	ast_copy_string(entry->uniqueid, ast_channel_uniqueid(chan), sizeof(entry->uniqueid));
+	ast_copy_string(entry->channel, ast_channel_name(chan), sizeof(entry->channel));
+	ast_channel_unlock(chan);
+	strcpy(entry->wsserver, wsserver); /* safe */
+	entry->started = ast_tvnow();
+	entry->ds = altstream->altstream_ds;
+
+	ao2_link(altstream_streams, entry);
+	ao2_link(altstream_streams_by_channel, entry);
+	ao2_link(altstream_streams_by_server, entry);
+	altstream->entry = entry;
+
+	return 0;
+}
+
+/*! \brief Take the stream out of the index, before its statistics go away */
+static void altstream_registry_remove(struct altstream *altstream)
+{
+	struct altstream_entry *entry = altstream->entry;
+
+	if (!entry) {
+		return;
+	}
+
+	ao2_unlink(altstream_streams, entry);
+	ao2_unlink(altstream_streams_by_channel, entry);
+	ao2_unlink(altstream_streams_by_server, entry);
+
+	/* anyone still holding the entry sees the stream has ended */
+	ao2_lock(entry);
+	entry->ds = NULL;
+	ao2_unlock(entry);
+
+	ao2_ref(entry, -1);
+	altstream->entry = NULL;
+}
+
+/*! \brief Index the stream under the server it was redirected to, keeping its ID */
+static void altstream_registry_move(struct altstream *altstream)
+{
+	struct altstream_entry *old = altstream->entry;
+	struct altstream_entry *entry;
+
+	if (!old || !(entry = ao2_alloc(sizeof(*entry) + strlen(altstream->wsserver) + 1, NULL))) {
+		return;
+	}
+	memcpy(entry, old, sizeof(*entry));
+	strcpy(entry->wsserver, altstream->wsserver); /* safe */
+
+	altstream_registry_remove(altstream);
+	entry->ds = altstream->altstream_ds;
+	ao2_link(altstream_streams, entry);
+	ao2_link(altstream_streams_by_channel, entry);
+	ao2_link(altstream_streams_by_server, entry);
+	altstream->entry = entry;
+}
+
+/*!
+ * \brief Connect to the endpoints of a redirect and replay what the stream sent since the cut point,
+ * then close the old endpoints once the stream has moved over
+ */
+static void *altstream_redirect_thread(void *obj)
+{
+	struct altstream *altstream = obj;
+	struct altstream_redirect *redirect = altstream->redirect;
+	int connected = 0;
+	int i;
+
+	for (i = 0; i < redirect->num_dests; i++) {
+		struct altstream_dest *dest = redirect->dests[i];
+
+		/* a single attempt, the stream stays where it is if this does not work out */
+		if (altstream_connect(dest->conn)) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Could not connect to %s server %s for the redirect\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, dest->conn->transport->name, dest->conn->wsserver);
+			continue;
+		}
+		dest->connected = 1;
+		connected++;
+	}
+
+	ast_mutex_lock(&redirect->lock);
+	if (!connected) {
+		redirect->state = ALTSTREAM_REDIRECT_FAILED;
+		ast_mutex_unlock(&redirect->lock);
+		return NULL;
+	}
+
+	while (!redirect->stop && redirect->state != ALTSTREAM_REDIRECT_SWITCHED) {
+		struct altstream_msg *msg;
+
+		if (!redirect->count) {
+			redirect->state = ALTSTREAM_REDIRECT_READY;
+			ast_cond_wait(&redirect->cond, &redirect->lock);
+			continue;
+		}
+
+		msg = redirect->backlog[redirect->head];
+		redirect->head = (redirect->head + 1) % ALTSTREAM_REDIRECT_BACKLOG;
+		redirect->count--;
+		ast_mutex_unlock(&redirect->lock);
+
+		for (i = 0; i < redirect->num_dests; i++) {
+			struct altstream_dest *dest = redirect->dests[i];
+
+			/* the sender reconnects it once the stream has moved over */
+			if (dest->connected && altstream_write(dest->conn, msg->opcode, msg->data, msg->len)) {
+				altstream_close(dest->conn);
+				dest->connected = 0;
+			}
+		}
+		ao2_ref(msg, -1);
+
+		ast_mutex_lock(&redirect->lock);
+		redirect->replayed++;
+	}
+	if (redirect->stop) {
+		ast_mutex_unlock(&redirect->lock);
+		return NULL;
+	}
+	ast_mutex_unlock(&redirect->lock);
+
+	/* nothing goes to the old endpoints any more, let them send what they have and close */
+	for (i = 0; i < redirect->num_old_dests; i++) {
+		altstream_dest_destroy(redirect->old_dests[i]);
+		redirect->old_dests[i] = NULL;
+	}
+	redirect->num_old_dests = 0;
+	if (redirect->close_own) {
+		altstream_close(altstream);
+	}
+
+	ast_mutex_lock(&redirect->lock);
+	redirect->state = ALTSTREAM_REDIRECT_DONE;
+	ast_mutex_unlock(&redirect->lock);
+
+	return NULL;
+}
+
+static void altstream_redirect_free(struct altstream_redirect *redirect)
+{
+	int i;
+
+	while (redirect->count) {
+		ao2_ref(redirect->backlog[redirect->head], -1);
+		redirect->head = (redirect->head + 1) % ALTSTREAM_REDIRECT_BACKLOG;
+		redirect->count--;
+	}
+	for (i = 0; i < redirect->num_dests; i++) {
+		altstream_dest_destroy(redirect->dests[i]);
+	}
+	for (i = 0; i < redirect->num_old_dests; i++) {
+		altstream_dest_destroy(redirect->old_dests[i]);
+	}
+	ast_free(redirect->wsserver);
+	ast_mutex_destroy(&redirect->lock);
+	ast_cond_destroy(&redirect->cond);
+	ast_free(redirect);
+}
+
+/*! \brief Wait for the redirect thread and drop whatever the redirect still holds */
+static void altstream_redirect_destroy(struct altstream *altstream)
+{
+	struct altstream_redirect *redirect = altstream->redirect;
+
+	if (!redirect) {
+		return;
+	}
+
+	ast_mutex_lock(&redirect->lock);
+	redirect->stop = 1;
+	ast_cond_signal(&redirect->cond);
+	ast_mutex_unlock(&redirect->lock);
+	pthread_join(redirect->thread, NULL);
+
+	altstream_redirect_free(redirect);
+	altstream->redirect = NULL;
+
+	ast_mutex_lock(&altstream->altstream_ds->lock);
+	altstream->altstream_ds->redirecting = 0;
+	ast_mutex_unlock(&altstream->altstream_ds->lock);
+}
+
+static void altstream_redirect_event(struct altstream *altstream, const char *wsserver, const char *status,
+	unsigned int replayed, unsigned int dropped)
+{
+	manager_event(EVENT_FLAG_CALL, "AltStreamRedirect",
+		"Channel: %s\r\n"
+		"AltStreamID: %s\r\n"
+		"WsServer: %s\r\n"
+		"Status: %s\r\n"
+		"Replayed: %u\r\n"
+		"Dropped: %u\r\n",
+		ast_channel_name(altstream->autochan->chan), altstream->entry ? altstream->entry->id : "",
+		wsserver, status, replayed, dropped);
+}
+
+/*! \brief Start moving the stream to \a wsserver, the audio from here on is kept for the new endpoints */
+static void altstream_redirect_start(struct altstream *altstream, const char *wsserver)
+{
+	struct altstream_redirect *redirect;
+
+	if ((redirect = ast_calloc(1, sizeof(*redirect)))) {
+		ast_mutex_init(&redirect->lock);
+		ast_cond_init(&redirect->cond, NULL);
+		redirect->state = ALTSTREAM_REDIRECT_CONNECTING;
+		altstream->redirect = redirect;
+
+		if ((redirect->wsserver = ast_strdup(wsserver))
+			&& !altstream_dests_alloc(altstream, wsserver, redirect->dests, &redirect->num_dests) && redirect->num_dests
+			&& !ast_pthread_create_background(&redirect->thread, NULL, altstream_redirect_thread, altstream)) {
+			ast_verb(2, "<%s> [AltStream] (%s) Redirecting to %s\n", ast_channel_name(altstream->autochan->chan),
+				altstream->direction_string, wsserver);
+			return;
+		}
+
+		altstream_redirect_free(redirect);
+		altstream->redirect = NULL;
+	}
+
+	ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Unable to redirect to %s\n", ast_channel_name(altstream->autochan->chan),
+		altstream->direction_string, wsserver);
+	altstream_redirect_event(altstream, wsserver, "Failed", 0, 0);
+
+	ast_mutex_lock(&altstream->altstream_ds->lock);
+	altstream->altstream_ds->redirecting = 0;
+	ast_mutex_unlock(&altstream->altstream_ds->lock);
+}
+
+/*! \brief Move the stream over to the caught up endpoints, called with the redirect locked */
+static void altstream_redirect_switch(struct altstream *altstream)
+{
+	struct altstream_redirect *redirect = altstream->redirect;
+	struct altstream_ds *altstream_ds = altstream->altstream_ds;
+	char *admitted;
+	char *wsserver;
+
+	/* the redirect thread closes the old endpoints once they are out of the way */
+	memcpy(redirect->old_dests, altstream->dests, sizeof(redirect->old_dests));
+	redirect->num_old_dests = altstream->num_dests;
+	redirect->close_own = !altstream->num_dests;
+	memcpy(altstream->dests, redirect->dests, sizeof(altstream->dests));
+	altstream->num_dests = redirect->num_dests;
+	redirect->num_dests = 0;
+	altstream_dests_start(altstream);
+
+	/* the redirect keeps the old endpoints for the event */
+	wsserver = altstream->wsserver;
+	altstream->wsserver = redirect->wsserver;
+	redirect->wsserver = wsserver;
+
+	/* the endpoint slots follow the stream, which was admitted already */
+	if (altstream->admitted && (admitted = ast_strdup(altstream->wsserver))) {
+		altstream_admission_move(altstream->admitted, admitted);
+		ast_free(altstream->admitted);
+		altstream->admitted = admitted;
+	}
+
+	ast_mutex_lock(&altstream_ds->lock);
+	ast_free(altstream_ds->wsserver);
+	altstream_ds->wsserver = ast_strdup(altstream->wsserver);
+	altstream_ds->destinations = altstream->num_dests;
+	ast_mutex_unlock(&altstream_ds->lock);
+	altstream_registry_move(altstream);
+
+	ast_verb(2, "<%s> [AltStream] (%s) Switched from %s to %s, %u messages replayed, %u dropped\n",
+		ast_channel_name(altstream->autochan->chan), altstream->direction_string, S_OR(redirect->wsserver, ""),
+		altstream->wsserver, redirect->replayed, redirect->dropped);
+}
+
+/*!
+ * \brief Keep a redirect going with the next message of the stream
+ *
+ * Until the new endpoints have caught up the message goes to the old ones as well as into
+ * the backlog, after that the stream switches over and the message goes to the new ones only.
+ */
+static void altstream_redirect_feed(struct altstream *altstream, enum ast_websocket_opcode opcode, const char *data, uint64_t len)
+{
+	struct altstream_redirect *redirect;
+	enum altstream_redirect_state state;
+	char *wsserver;
+
+	if (!(redirect = altstream->redirect)) {
+		/* cheap enough for every message, and a redirect starts on a message boundary */
+		ast_mutex_lock(&altstream->altstream_ds->lock);
+		wsserver = altstream->altstream_ds->redirect;
+		altstream->altstream_ds->redirect = NULL;
+		ast_mutex_unlock(&altstream->altstream_ds->lock);
+
+		if (!wsserver) {
+			return;
+		}
+		altstream_redirect_start(altstream, wsserver);
+		ast_free(wsserver);
+		if (!(redirect = altstream->redirect)) {
+			return;
+		}
+	}
+
+	ast_mutex_lock(&redirect->lock);
+	if (redirect->state == ALTSTREAM_REDIRECT_CONNECTING) {
+		struct altstream_msg *msg = altstream_msg_alloc(opcode, data, len);
+
+		if (redirect->count == ALTSTREAM_REDIRECT_BACKLOG) {
+			ao2_ref(redirect->backlog[redirect->head], -1);
+			redirect->head = (redirect->head + 1) % ALTSTREAM_REDIRECT_BACKLOG;
+			redirect->count--;
+			redirect->dropped++;
+		}
+		if (msg) {
+			redirect->backlog[(redirect->head + redirect->count) % ALTSTREAM_REDIRECT_BACKLOG] = msg;
+			redirect->count++;
+			ast_cond_signal(&redirect->cond);
+		} else {
+			redirect->dropped++;
+		}
+	} else if (redirect->state == ALTSTREAM_REDIRECT_READY) {
+		altstream_redirect_switch(altstream);
+		redirect->state = ALTSTREAM_REDIRECT_SWITCHED;
+		ast_cond_signal(&redirect->cond);
+	}
+	state = redirect->state;
+	ast_mutex_unlock(&redirect->lock);
+
+	if (state == ALTSTREAM_REDIRECT_DONE || state == ALTSTREAM_REDIRECT_FAILED) {
+		/* the endpoints moved away from, or the ones that could not be moved to */
+		char *other = ast_strdupa(S_OR(redirect->wsserver, ""));
+		unsigned int replayed = redirect->replayed;
+		unsigned int dropped = redirect->dropped;
+
+		if (state == ALTSTREAM_REDIRECT_FAILED) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Redirect to %s failed, staying on %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, other, altstream->wsserver);
+		}
+		altstream_redirect_destroy(altstream);
+		altstream_redirect_event(altstream, state == ALTSTREAM_REDIRECT_DONE ? altstream->wsserver : other,
+			state == ALTSTREAM_REDIRECT_DONE ? "Switched" : "Failed", replayed, dropped);
+	}
+}
+
+
+/*! \brief Write a whole batch, picking up after short writes */
+static int altstream_record_pwritev(int fd, struct iovec *iov, int iovcnt, off_t offset)
+{
+	while (iovcnt) {
+		ssize_t res = pwritev(fd, iov, iovcnt, offset);
+
+		if (res < 0 && errno == EINTR) {
+			continue;
+		}
+		if (res <= 0) {
+			return -1;
+		}
+		offset += res;
+		while (iovcnt && (size_t) res >= iov->iov_len) {
+			res -= iov->iov_len;
+			iov++;
+			iovcnt--;
+		}
+		if (iovcnt) {
+			iov->iov_base = (char *) iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+
+	return 0;
+}
+
+static void *altstream_record_thread(void *obj)
+{
+	struct altstream_recorder *rec = obj;
+	struct iovec iov[ALTSTREAM_RECORD_BUFFERS];
+
+	ast_mutex_lock(&rec->lock);
+	while (!rec->failed) {
+		unsigned int batch;
+		unsigned int i;
+		size_t total = 0;
+		int res;
+
+		if (!rec->count) {
+			if (!rec->stop) {
+				struct timeval wait = ast_tvadd(ast_tvnow(), ast_samp2tv(ALTSTREAM_RECORD_FLUSH_MS, 1000));
+				struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000 };
+
+				ast_cond_timedwait(&rec->cond, &rec->lock, &ts);
+			}
+			if (!rec->count) {
+				/* nothing filled up in a while, or we are done: take the partial buffer too */
+				if (!rec->bufs[rec->head].len) {
+					if (rec->stop) {
+						break;
+					}
+					continue;
+				}
+				rec->count = 1;
+			}
+		}
+
+		/* everything that is full goes out in one call, the stream thread keeps filling the next one */
+		batch = rec->count;
+		for (i = 0; i < batch; i++) {
+			unsigned int b = (rec->head + i) % ALTSTREAM_RECORD_BUFFERS;
+
+			iov[i].iov_base = rec->bufs[b].data;
+			iov[i].iov_len = rec->bufs[b].len;
+			total += rec->bufs[b].len;
+		}
+		ast_mutex_unlock(&rec->lock);
+
+		res = altstream_record_pwritev(rec->fd, iov, batch, rec->offset);
+		if (res) {
+			ast_log(LOG_ERROR, "[AltStream] Could not write recording %s: %s\n", rec->filename, strerror(errno));
+		} else {
+			rec->offset += total;
+		}
+
+		ast_mutex_lock(&rec->lock);
+		for (i = 0; i < batch; i++) {
+			rec->bufs[(rec->head + i) % ALTSTREAM_RECORD_BUFFERS].len = 0;
+		}
+		rec->head = (rec->head + batch) % ALTSTREAM_RECORD_BUFFERS;
+		rec->count -= batch;
+		rec->failed = res;
+	}
+	ast_mutex_unlock(&rec->lock);
+
+	return NULL;
+}
+
+/*! \brief Queue audio to a recording, returns how many bytes had to be dropped. Never waits for the disk */
+static size_t altstream_recorder_write(struct altstream_recorder *rec, const char *data, size_t len)
+{
+	size_t dropped = 0;
+
+	ast_mutex_lock(&rec->lock);
+	if (rec->failed) {
+		dropped = len;
+	}
+	while (len > dropped) {
+		unsigned int b = (rec->head + rec->count) % ALTSTREAM_RECORD_BUFFERS;
+		size_t n;
+
+		if (rec->bufs[b].len == ALTSTREAM_RECORD_BUFFER_SIZE) {
+			if (rec->count + 1 == ALTSTREAM_RECORD_BUFFERS) {
+				/* the writer is that far behind, rather lose audio here than stall the stream */
+				dropped = len;
+				break;
+			}
+			rec->count++;
+			ast_cond_signal(&rec->cond);
+			continue;
+		}
+
+		n = MIN(len, ALTSTREAM_RECORD_BUFFER_SIZE - rec->bufs[b].len);
+		memcpy(rec->bufs[b].data + rec->bufs[b].len, data, n);
+		rec->bufs[b].len += n;
+		data += n;
+		len -= n;
+	}
+	ast_mutex_unlock(&rec->lock);
+
+	return dropped;
+}
+
+static void altstream_recorder_free(struct altstream_recorder *rec)
+{
+	int i;
+
+	if (rec->fd >= 0) {
+		close(rec->fd);
+	}
+	for (i = 0; i < ALTSTREAM_RECORD_BUFFERS; i++) {
+		ast_std_free(rec->bufs[i].data);
+	}
+	ast_mutex_destroy(&rec->lock);
+	ast_cond_destroy(&rec->cond);
+	ast_free(rec->filename);
+	ast_free(rec);
+}
+
+static struct altstream_recorder *altstream_recorder_open(const char *filename, unsigned int rate, int append)
+{
+	struct altstream_recorder *rec;
+	const char *ext;
+	struct stat st;
+	char *dir;
+	char *slash;
+	int i;
+
+	if (!(rec = ast_calloc(1, sizeof(*rec)))) {
+		return NULL;
+	}
+	rec->fd = -1;
+	rec->rate = rate;
+	ast_mutex_init(&rec->lock);
+	ast_cond_init(&rec->cond, NULL);
+
+	if (filename[0] == '/') {
+		rec->filename = ast_strdup(filename);
+	} else if (ast_asprintf(&rec->filename, "%s/%s", ast_config_AST_MONITOR_DIR, filename) < 0) {
+		rec->filename = NULL;
+	}
+	if (!rec->filename) {
+		altstream_recorder_free(rec);
+		return NULL;
+	}
+
+	dir = ast_strdupa(rec->filename);
+	if ((slash = strrchr(dir, '/')) && slash != dir) {
+		*slash = '\0';
+		ast_mkdir(dir, 0777);
+	}
+
+	rec->fd = open(rec->filename, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? 0 : O_TRUNC), AST_FILE_MODE);
+	if (rec->fd < 0 || fstat(rec->fd, &st)) {
+		ast_log(LOG_WARNING, "[AltStream] Could not open recording %s: %s\n", rec->filename, strerror(errno));
+		altstream_recorder_free(rec);
+		return NULL;
+	}
+
+	ext = strrchr(rec->filename, '.');
+	rec->wav = ext && !strcasecmp(ext, ".wav");
+	rec->offset = st.st_size;
+	if (rec->wav) {
+		rec->data_start = ALTSTREAM_WAV_HEADER_SIZE;
+		if (st.st_size < ALTSTREAM_WAV_HEADER_SIZE) {
+			/* a new file, the sizes are filled in when it is closed */
+			char header[ALTSTREAM_WAV_HEADER_SIZE];
+
+			altstream_wav_header(header, rate, 0);
+			if (ftruncate(rec->fd, 0) || pwrite(rec->fd, header, sizeof(header), 0) != sizeof(header)) {
+				ast_log(LOG_WARNING, "[AltStream] Could not write recording %s: %s\n", rec->filename, strerror(errno));
+				altstream_recorder_free(rec);
+				return NULL;
+			}
+			rec->offset = ALTSTREAM_WAV_HEADER_SIZE;
+		}
+	}
+
+	for (i = 0; i < ALTSTREAM_RECORD_BUFFERS; i++) {
+		if (posix_memalign((void **) &rec->bufs[i].data, ALTSTREAM_RECORD_ALIGN, ALTSTREAM_RECORD_BUFFER_SIZE)) {
+			rec->bufs[i].data = NULL;
+			altstream_recorder_free(rec);
+			return NULL;
+		}
+	}
+
+	if (ast_pthread_create_background(&rec->thread, NULL, altstream_record_thread, rec)) {
+		altstream_recorder_free(rec);
+		return NULL;
+	}
+
+	return rec;
+}
+
+/*! \brief Let the writer finish what is buffered, then complete the file */
+static void altstream_recorder_close(struct altstream_recorder *rec)
+{
+	ast_mutex_lock(&rec->lock);
+	rec->stop = 1;
+	ast_cond_signal(&rec->cond);
+	ast_mutex_unlock(&rec->lock);
+	pthread_join(rec->thread, NULL);
+
+	if (rec->wav) {
+		char header[ALTSTREAM_WAV_HEADER_SIZE];
+
+		altstream_wav_header(header, rec->rate, rec->offset - rec->data_start);
+		if (pwrite(rec->fd, header, sizeof(header), 0) != sizeof(header)) {
+			ast_log(LOG_WARNING, "[AltStream] Could not complete recording %s: %s\n", rec->filename, strerror(errno));
+		}
+	}
+
+	altstream_recorder_free(rec);
+}
+
+static void altstream_recorders_close(struct altstream *altstream)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(altstream->recorders); i++) {
+		if (altstream->recorders[i]) {
+			altstream_recorder_close(altstream->recorders[i]);
+			altstream->recorders[i] = NULL;
+		}
+	}
+}
+
+/*! \brief Record one direction of a captured frame, \a out for the transmitted audio */
+static void altstream_record_frame(struct altstream *altstream, int out, struct ast_frame *fr)
+{
+	size_t dropped;
+
+	if (!altstream->recorders[out]) {
+		return;
+	}
+
+	dropped = altstream_recorder_write(altstream->recorders[out], fr->data.ptr, fr->datalen);
+	altstream->altstream_ds->recorded_bytes += fr->datalen - dropped;
+	altstream->altstream_ds->record_dropped_bytes += dropped;
+}
+
+/*! \brief Send one message to the endpoint or endpoints, reconnecting as needed, non-zero to give up */
+static int altstream_deliver(struct altstream *altstream, enum ast_websocket_opcode opcode, char *data, uint64_t len)
+{
+	altstream_redirect_feed(altstream, opcode, data, len);
+
+	if (altstream->num_dests) {
+		if (altstream_dests_send(altstream, opcode, data, len)) {
+			ast_log(LOG_ERROR, "<%s> [AltStream] (%s) No endpoint left to stream to.\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+			return -1;
+		}
+		return 0;
+	}
+
+	if (!altstream_write(altstream, opcode, data, len)) {
+		return 0;
+	}
+
+	ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Could not write to %s.  Reconnecting...\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->transport->name);
+	if (altstream_start_reconnecting(altstream)) {
+		altstream_close(altstream);
+		return -1;
+	}
+
+	/* re-send the last frame */
+	if (altstream_write(altstream, opcode, data, len)) {
+		ast_log(LOG_ERROR, "<%s> [AltStream] (%s) Could not re-write to %s.  Complete Failure.\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->transport->name);
+		return -1;
+	}
+
+	return 0;
+}
+
+static int altstream_track_event(struct altstream *altstream, struct altstream_track *track, const char *state)
+{
+	char event[512];
+	int len;
+
+	len = snprintf(event, sizeof(event),
+		"{\"event\":\"track\",\"track\":%u,\"state\":\"%s\",\"channel\":\"%s\",\"uniqueid\":\"%s\"}",
+		track->id, state, ast_channel_name(track->chan), track->uniqueid);
+
+	return altstream_deliver(altstream, AST_WEBSOCKET_OPCODE_TEXT, event, MIN(len, sizeof(event) - 1));
+}
+
+static void altstream_track_free(struct altstream_track *track)
+{
+	ast_audiohook_lock(&track->audiohook);
+	ast_audiohook_detach(&track->audiohook);
+	ast_audiohook_unlock(&track->audiohook);
+	ast_audiohook_destroy(&track->audiohook);
+	ast_channel_unref(track->chan);
+	ast_free(track);
+}
+
+static int altstream_track_add(struct altstream *altstream, struct ast_channel *chan)
+{
+	struct altstream_track *track;
+
+	if (altstream->num_tracks == ALTSTREAM_MAX_TRACKS) {
+		if (!altstream->tracks_full) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Only %d participants are sent as tracks, leaving out %s\n",
+				ast_channel_name(altstream->autochan->chan), altstream->direction_string, ALTSTREAM_MAX_TRACKS, ast_channel_name(chan));
+			altstream->tracks_full = 1;
+		}
+		return 0;
+	}
+	if (!(track = ast_calloc(1, sizeof(*track)))) {
+		return 0;
+	}
+	if (ast_audiohook_init(&track->audiohook, AST_AUDIOHOOK_TYPE_SPY, altstream_track_spy_type, 0)) {
+		ast_free(track);
+		return 0;
+	}
+	if (ast_audiohook_attach(chan, &track->audiohook)) {
+		ast_audiohook_destroy(&track->audiohook);
+		ast_free(track);
+		return 0;
+	}
+
+	track->id = ++altstream->next_track;
+	track->chan = ast_channel_ref(chan);
+	track->seen = 1;
+	ast_copy_string(track->uniqueid, ast_channel_uniqueid(chan), sizeof(track->uniqueid));
+	altstream->tracks[altstream->num_tracks++] = track;
+
+	ast_verb(2, "<%s> [AltStream] (%s) Track %u is %s\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string,
+		track->id, ast_channel_name(chan));
+
+	return altstream_track_event(altstream, track, "start");
+}
+
+/*! \brief Drop track \a i, announcing it unless the stream is going away */
+static int altstream_track_remove(struct altstream *altstream, int i, int announce)
+{
+	struct altstream_track *track = altstream->tracks[i];
+	int res = 0;
+
+	if (announce) {
+		res = altstream_track_event(altstream, track, "stop");
+	}
+	altstream->tracks[i] = altstream->tracks[--altstream->num_tracks];
+	altstream->tracks[altstream->num_tracks] = NULL;
+	altstream_track_free(track);
+
+	return res;
+}
+
+static void altstream_tracks_destroy(struct altstream *altstream)
+{
+	while (altstream->num_tracks) {
+		altstream_track_remove(altstream, altstream->num_tracks - 1, 0);
+	}
+}
+
+/*! \brief Follow the bridge membership, a track for everyone but our own Recorder */
+static int altstream_tracks_scan(struct altstream *altstream)
+{
+	struct ast_channel *joined[ALTSTREAM_MAX_TRACKS];
+	struct ast_bridge_channel *bridge_channel;
+	struct ast_bridge *bridge;
+	int num_joined = 0;
+	int res = 0;
+	int i;
+
+	if (!(bridge = ast_bridge_find_by_id(altstream->bridge_id))) {
+		return 0;
+	}
+
+	for (i = 0; i < altstream->num_tracks; i++) {
+		altstream->tracks[i]->seen = 0;
+	}
+
+	ast_bridge_lock(bridge);
+	AST_LIST_TRAVERSE(&bridge->channels, bridge_channel, entry) {
+		int known = 0;
+
+		if (altstream->bridge_peer && !strcmp(altstream->bridge_peer, ast_channel_uniqueid(bridge_channel->chan))) {
+			continue;
+		}
+		for (i = 0; i < altstream->num_tracks; i++) {
+			if (!strcmp(altstream->tracks[i]->uniqueid, ast_channel_uniqueid(bridge_channel->chan))) {
+				altstream->tracks[i]->seen = 1;
+				known = 1;
+				break;
+			}
+		}
+		if (!known && num_joined < ARRAY_LEN(joined)) {
+			joined[num_joined++] = ast_channel_ref(bridge_channel->chan);
+		}
+	}
+	ast_bridge_unlock(bridge);
+	ao2_ref(bridge, -1);
+
+	/* attach outside the bridge lock, it takes the channel lock */
+	for (i = altstream->num_tracks - 1; i >= 0; i--) {
+		if (!altstream->tracks[i]->seen) {
+			res |= altstream_track_remove(altstream, i, 1);
+		}
+	}
+	for (i = 0; i < num_joined; i++) {
+		if (!res) {
+			res |= altstream_track_add(altstream, joined[i]);
+		}
+		ast_channel_unref(joined[i]);
+	}
+
+	return res;
+}
+
+/*! \brief Send whatever audio every track has, non-zero to give up */
+static int altstream_tracks_service(struct altstream *altstream)
+{
+	struct ast_format *format = ast_format_cache_get_slin_by_rate(altstream->samp_rate);
+	size_t samples = altstream->ptime * altstream->samp_rate / 1000;
+	uint64_t now = altstream_monotonic_ms();
+	int i;
+
+	if (now - altstream->tracks_scanned >= ALTSTREAM_TRACK_SCAN_MS) {
+		altstream->tracks_scanned = now;
+		if (altstream_tracks_scan(altstream)) {
+			return -1;
+		}
+	}
+
+	for (i = altstream->num_tracks - 1; i >= 0; i--) {
+		struct altstream_track *track = altstream->tracks[i];
+		struct ast_frame *fr;
+
+		if (track->audiohook.status != AST_AUDIOHOOK_STATUS_RUNNING) {
+			/* hung up or moved on before the next scan noticed */
+			if (altstream_track_remove(altstream, i, 1)) {
+				return -1;
+			}
+			continue;
+		}
+
+		for (;;) {
+			size_t len;
+
+			ast_audiohook_lock(&track->audiohook);
+			fr = ast_audiohook_read_frame(&track->audiohook, samples, AST_AUDIOHOOK_DIRECTION_READ, format);
+			ast_audiohook_unlock(&track->audiohook);
+			if (!fr) {
+				break;
+			}
+			if (altstream->paused) {
+				altstream->altstream_ds->frames_paused++;
+				ast_frame_free(fr, 0);
+				continue;
+			}
+			if (altstream_tenant_take(altstream->tenant, fr->datalen / sizeof(int16_t), altstream->samp_rate)) {
+				altstream->altstream_ds->frames_throttled++;
+				ast_frame_free(fr, 0);
+				continue;
+			}
+
+			len = ALTSTREAM_TRACK_HEADER + fr->datalen;
+			if (len > altstream->track_buf_len) {
+				char *buf = ast_realloc(altstream->track_buf, len);
+
+				if (!buf) {
+					ast_frame_free(fr, 0);
+					break;
+				}
+				altstream->track_buf = buf;
+				altstream->track_buf_len = len;
+			}
+			put_unaligned_uint32(altstream->track_buf, htonl(track->id));
+			memcpy(altstream->track_buf + ALTSTREAM_TRACK_HEADER, fr->data.ptr, fr->datalen);
+			ast_frame_free(fr, 0);
+
+			if (altstream_deliver(altstream, AST_WEBSOCKET_OPCODE_BINARY, altstream->track_buf, len)) {
+				return -1;
+			}
+			altstream->altstream_ds->frames_sent++;
+			altstream->altstream_ds->bytes_sent += len;
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief CPUs stream threads are pinned to, a cpuset line of altstream.conf or a NUMA node */
+struct altstream_cpuset {
+	cpu_set_t cpus;
+	/*! NUMA node of its CPUs, -1 when they span nodes or the node is unknown */
+	int node;
+	/*! streams running on it, and started on it since the last reload */
+	int streams;
+	int started;
+};
+
+/*! \brief Where stream threads go, swapped as a whole on reload */
+struct altstream_placement {
+	/*! prefer the node of the thread starting the stream */
+	int numa;
+	int num_cpusets;
+	struct altstream_cpuset *cpusets[ALTSTREAM_MAX_CPUSETS];
+	/*! NUMA node of every CPU, -1 when unknown */
+	short cpu_node[CPU_SETSIZE];
+};
+
+static AO2_GLOBAL_OBJ_STATIC(altstream_placement);
+
+/*!
+ * \brief Pick the cpuset for a stream started from this thread
+ *
+ * The least busy cpuset on the NUMA node of the calling CPU wins, for the AltStream
+ * application that is the channel's own thread. The stream thread pins itself before it
+ * connects, so what it and its endpoint senders allocate from then on is first touched on
+ * the cpuset's node. The resampler, mel state, recorder rings and endpoints are allocated
+ * by launch_altstream_thread on the calling thread, and stay on that node.
+ *
+ * \return the cpuset with the stream counted on it, NULL to leave the thread alone
+ */
+static struct altstream_cpuset *altstream_cpuset_pick(void)
+{
+	struct altstream_placement *placement = ao2_global_obj_ref(altstream_placement);
+	struct altstream_cpuset *best = NULL;
+	int node = -1;
+	int cpu;
+	int i;
+
+	if (!placement) {
+		return NULL;
+	}
+
+	if (placement->numa && (cpu = sched_getcpu()) >= 0 && cpu < CPU_SETSIZE) {
+		node = placement->cpu_node[cpu];
+	}
+	for (i = 0; i < placement->num_cpusets; i++) {
+		struct altstream_cpuset *cpuset = placement->cpusets[i];
+		int local = node >= 0 && cpuset->node == node;
+
+		/* a local cpuset beats a remote one, then the one with fewer streams */
+		if (!best || (local && best->node != node)
+			|| (local == (node >= 0 && best->node == node) && cpuset->streams < best->streams)) {
+			best = cpuset;
+		}
+	}
+	if (best) {
+		ao2_ref(best, +1);
+		ast_atomic_fetchadd_int(&best->streams, +1);
+		ast_atomic_fetchadd_int(&best->started, +1);
+	}
+	ao2_ref(placement, -1);
+
+	return best;
+}
+
+static void altstream_cpuset_release(struct altstream_cpuset *cpuset)
+{
+	if (cpuset) {
+		ast_atomic_fetchadd_int(&cpuset->streams, -1);
+		ao2_ref(cpuset, -1);
+	}
+}
+
+/*! \brief Write \a cpus the way sysfs and altstream.conf list CPUs, 0-3,8 */
+static void altstream_cpulist_format(const cpu_set_t *cpus, char *buf, size_t len)
+{
+	int first = -1;
+	int cpu;
+
+	*buf = '\0';
+	for (cpu = 0; cpu <= CPU_SETSIZE; cpu++) {
+		size_t used = strlen(buf);
+
+		if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, cpus)) {
+			if (first < 0) {
+				first = cpu;
+			}
+			continue;
+		}
+		if (first < 0) {
+			continue;
+		}
+		if (first == cpu - 1) {
+			snprintf(buf + used, len - used, "%s%d", used ? "," : "", first);
+		} else {
+			snprintf(buf + used, len - used, "%s%d-%d", used ? "," : "", first, cpu - 1);
+		}
+		first = -1;
+	}
+}
+
+static void altstream_free(struct altstream *altstream)
+{
+	if (altstream) {
+		altstream_registry_remove(altstream);
+		altstream_redirect_destroy(altstream);
+		altstream_dests_destroy(altstream);
+		altstream_tracks_destroy(altstream);
+		altstream_recorders_close(altstream);
+		altstream_cpuset_release(altstream->cpuset);
+		if (altstream->admitted) {
+			altstream_admission_release(altstream->admitted);
+			ast_free(altstream->admitted);
+		}
+		altstream_tenant_release(altstream->tenant);
+		ast_free(altstream->bridge_id);
+		ast_free(altstream->bridge_peer);
+		ast_free(altstream->track_buf);
+
+		if (altstream->altstream_ds) {
+			altstream_ds_strings_free(altstream->altstream_ds);
+			ast_mutex_destroy(&altstream->altstream_ds->lock);
+			ast_cond_destroy(&altstream->altstream_ds->destruction_condition);
+			ast_free(altstream->altstream_ds);
+		}
+
+		ast_free(altstream->name);
+		ast_free(altstream->post_process);
+		ast_free(altstream->wsserver);
+
+		if (altstream->transport) {
+			altstream_close(altstream);
+		}
+		altstream_tls_cfg_free(altstream->tls_cfg);
+#ifdef HAVE_ZLIB
+		altstream_deflate_destroy(altstream);
+#endif
+		altstream_resume_free(altstream);
+		ast_free(altstream->ws_frame_buf);
+		altstream_resampler_free(altstream->resampler);
+		ast_free(altstream->resample_buf);
+		altstream_mel_free(altstream->mel);
+
+		/* clean stringfields */
+		ast_string_field_free_memory(altstream);
+
+		ast_free(altstream);
+	}
+}
+
+
+
+/*! \brief A post process command waiting for a worker */
+struct altstream_job {
+	struct timeval queued;
+	char *channel;
+	AST_LIST_ENTRY(altstream_job) list;
+	char command[0];
+};
+
+/*! \brief Post process commands of every stream, run by a few workers at a limited rate */
+static struct {
+	ast_mutex_t lock;
+	ast_cond_t cond;
+	AST_LIST_HEAD_NOLOCK(, altstream_job) queue;
+	pthread_t workers[ALTSTREAM_JOB_WORKERS];
+	int num_workers;
+	int stop;
+	/* token bucket, refilled at ALTSTREAM_JOB_RATE per second */
+	double tokens;
+	struct timeval refilled;
+	unsigned int depth;
+	unsigned int max_depth;
+	unsigned int running;
+	uint64_t queued;
+	uint64_t run;
+	uint64_t failed;
+	uint64_t dropped;
+	uint64_t wait_us;
+	uint64_t max_wait_us;
+	uint64_t run_us;
+	uint64_t max_run_us;
+} altstream_jobs;
+
+/*! \brief Take a start token, or say how many microseconds until there is one. Called locked */
+static int64_t altstream_jobs_take_token(void)
+{
+	struct timeval now = ast_tvnow();
+
+	altstream_jobs.tokens = MIN(ALTSTREAM_JOB_RATE,
+		altstream_jobs.tokens + ast_tvdiff_us(now, altstream_jobs.refilled) * ALTSTREAM_JOB_RATE / 1000000.0);
+	altstream_jobs.refilled = now;
+
+	if (altstream_jobs.tokens >= 1.0) {
+		altstream_jobs.tokens -= 1.0;
+		return 0;
+	}
+
+	return (1.0 - altstream_jobs.tokens) * 1000000.0 / ALTSTREAM_JOB_RATE + 1;
+}
+
+/*!
+ * \brief Start \a argv without our descriptors or realtime priority, like ast_safe_system. 0 or an errno
+ *
+ * Where posix_spawn cannot close them the child does both between fork and
+ * exec, the way the core does.
+ */
+static int altstream_job_spawn(char **argv, pid_t *pid)
+{
+#ifdef ALTSTREAM_SPAWN_CLOSEFROM
+	posix_spawn_file_actions_t actions;
+	posix_spawnattr_t attr;
+	struct sched_param sched = { .sched_priority = 0 };
+	int res;
+
+	if ((res = posix_spawn_file_actions_init(&actions))) {
+		return res;
+	}
+	if ((res = posix_spawnattr_init(&attr))) {
+		posix_spawn_file_actions_destroy(&actions);
+		return res;
+	}
+	posix_spawn_file_actions_addclosefrom_np(&actions, STDERR_FILENO + 1);
+	/* a command must not run with the realtime priority asterisk -p gave us */
+	posix_spawnattr_setschedpolicy(&attr, SCHED_OTHER);
+	posix_spawnattr_setschedparam(&attr, &sched);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSCHEDULER);
+	res = posix_spawnp(pid, argv[0], &actions, &attr, argv, environ);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+	return res;
+#else
+	if ((*pid = fork()) < 0) {
+		return errno;
+	}
+	if (!*pid) {
+		ast_set_priority(0);
+		ast_close_fds_above_n(STDERR_FILENO);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+
+	return 0;
+#endif
+}
+
+/*! \brief Run one command to completion, directly when it needs no shell */
+static int altstream_job_run(struct altstream_job *job)
+{
+	char *argv[ALTSTREAM_JOB_MAX_ARGS + 1];
+	int argc = 0;
+	int status = 0;
+	pid_t pid;
+	int res;
+
+	if (!strpbrk(job->command, ALTSTREAM_JOB_SHELL_CHARS)) {
+		char *args = ast_strdupa(job->command);
+		char *arg;
+
+		while ((arg = strsep(&args, " \t"))) {
+			if (ast_strlen_zero(arg)) {
+				continue;
+			}
+			if (argc == ALTSTREAM_JOB_MAX_ARGS) {
+				argc = 0;
+				break;
+			}
+			argv[argc++] = arg;
+		}
+	}
+	if (!argc || strchr(argv[0], '=')) {
+		/* empty, too long or starting with a variable assignment */
+		argc = 0;
+		argv[argc++] = "/bin/sh";
+		argv[argc++] = "-c";
+		argv[argc++] = job->command;
+	}
+	argv[argc] = NULL;
+
+	ast_replace_sigchld();
+	res = altstream_job_spawn(argv, &pid);
+	if (!res) {
+		while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+		}
+	}
+	ast_unreplace_sigchld();
+
+	if (res) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] Could not start [%s]: %s\n", job->channel, job->command, strerror(res));
+		return -1;
+	}
+	if (!WIFEXITED(status) || WEXITSTATUS(status)) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] [%s] failed with status %d\n", job->channel, job->command,
+			WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void *altstream_job_worker(void *data)
+{
+	ast_mutex_lock(&altstream_jobs.lock);
+	for (;;) {
+		struct altstream_job *job;
+		struct timeval started;
+		uint64_t waited;
+		uint64_t ran;
+		int64_t wait_us;
+		int res;
+
+		if (AST_LIST_EMPTY(&altstream_jobs.queue)) {
+			if (altstream_jobs.stop) {
+				break;
+			}
+			ast_cond_wait(&altstream_jobs.cond, &altstream_jobs.lock);
+			continue;
+		}
+
+		/* on unload whatever is left runs without waiting for tokens */
+		if (!altstream_jobs.stop && (wait_us = altstream_jobs_take_token())) {
+			struct timeval wait = ast_tvadd(ast_tvnow(), ast_tv(wait_us / 1000000, wait_us % 1000000));
+			struct timespec ts = { .tv_sec = wait.tv_sec, .tv_nsec = wait.tv_usec * 1000 };
+
+			ast_cond_timedwait(&altstream_jobs.cond, &altstream_jobs.lock, &ts);
+			continue;
+		}
+
+		job = AST_LIST_REMOVE_HEAD(&altstream_jobs.queue, list);
+		altstream_jobs.depth--;
+		altstream_jobs.running++;
+		ast_mutex_unlock(&altstream_jobs.lock);
+
+		started = ast_tvnow();
+		waited = ast_tvdiff_us(started, job->queued);
+		ast_verb(2, "<%s> [AltStream] Executing [%s]\n", job->channel, job->command);
+		res = altstream_job_run(job);
+		ran = ast_tvdiff_us(ast_tvnow(), started);
+		ast_free(job->channel);
+		ast_free(job);
+
+		ast_mutex_lock(&altstream_jobs.lock);
+		altstream_jobs.running--;
+		altstream_jobs.run++;
+		altstream_jobs.failed += res ? 1 : 0;
+		altstream_jobs.wait_us += waited;
+		altstream_jobs.max_wait_us = MAX(altstream_jobs.max_wait_us, waited);
+		altstream_jobs.run_us += ran;
+		altstream_jobs.max_run_us = MAX(altstream_jobs.max_run_us, ran);
+	}
+	ast_mutex_unlock(&altstream_jobs.lock);
+
+	return NULL;
+}
+
+/*! \brief Hand a post process command to the workers, never waits for it */
+static int altstream_job_queue(const char *channel, const char *command)
+{
+	struct altstream_job *job;
+
+	if (!(job = ast_calloc(1, sizeof(*job) + strlen(command) + 1))) {
+		return -1;
+	}
+	strcpy(job->command, command); /* safe */
+	job->channel = ast_strdup(channel);
+	job->queued = ast_tvnow();
+
+	ast_mutex_lock(&altstream_jobs.lock);
+	if (altstream_jobs.depth >= ALTSTREAM_JOB_QUEUE || !altstream_jobs.num_workers) {
+		altstream_jobs.dropped++;
+		ast_mutex_unlock(&altstream_jobs.lock);
+		ast_log(LOG_ERROR, "<%s> [AltStream] Post process queue is full, dropping [%s]\n", channel, command);
+		ast_free(job->channel);
+		ast_free(job);
+		return -1;
+	}
+	AST_LIST_INSERT_TAIL(&altstream_jobs.queue, job, list);
+	altstream_jobs.depth++;
+	altstream_jobs.max_depth = MAX(altstream_jobs.max_depth, altstream_jobs.depth);
+	altstream_jobs.queued++;
+	ast_cond_signal(&altstream_jobs.cond);
+	ast_mutex_unlock(&altstream_jobs.lock);
+
+	return 0;
+}
+
+static void altstream_jobs_start(void)
+{
+	ast_mutex_init(&altstream_jobs.lock);
+	ast_cond_init(&altstream_jobs.cond, NULL);
+	altstream_jobs.tokens = ALTSTREAM_JOB_RATE;
+	altstream_jobs.refilled = ast_tvnow();
+
+	for (altstream_jobs.num_workers = 0; altstream_jobs.num_workers < ALTSTREAM_JOB_WORKERS; altstream_jobs.num_workers++) {
+		if (ast_pthread_create_background(&altstream_jobs.workers[altstream_jobs.num_workers], NULL, altstream_job_worker, NULL)) {
+			ast_log(LOG_WARNING, "[AltStream] Only %d post process workers\n", altstream_jobs.num_workers);
+			break;
+		}
+	}
+}
+
+/*! \brief Run what is still queued, then stop the workers */
+static void altstream_jobs_stop(void)
+{
+	int i;
+
+	ast_mutex_lock(&altstream_jobs.lock);
+	altstream_jobs.stop = 1;
+	ast_cond_broadcast(&altstream_jobs.cond);
+	ast_mutex_unlock(&altstream_jobs.lock);
+
+	for (i = 0; i < altstream_jobs.num_workers; i++) {
+		pthread_join(altstream_jobs.workers[i], NULL);
+	}
+	altstream_jobs.num_workers = 0;
+
+	ast_mutex_destroy(&altstream_jobs.lock);
+	ast_cond_destroy(&altstream_jobs.cond);
+}
+
+static void altstream_quality_add(struct altstream_quality *quality, const struct altstream_levels *levels,
+	size_t count, unsigned int ms)
+{
+	quality->samples += count;
+	quality->energy += levels->energy;
+	quality->sum += levels->sum;
+	quality->peak = MAX(quality->peak, levels->peak);
+	quality->clipped += levels->clipped;
+	quality->frames++;
+
+	if (levels->energy < (uint64_t) ALTSTREAM_SILENCE_LEVEL * ALTSTREAM_SILENCE_LEVEL * count) {
+		quality->silent_frames++;
+		quality->silence_ms += ms;
+		quality->longest_silence_ms = MAX(quality->longest_silence_ms, quality->silence_ms);
+		quality->noise_energy += levels->energy;
+		quality->noise_samples += count;
+	} else {
+		quality->silence_ms = 0;
+		quality->active_energy += levels->energy;
+		quality->active_samples += count;
+	}
+}
+
+/*! \brief Measure one captured frame of direction \a dir, 0 for in and 1 for out */
+static void altstream_quality_frame(struct altstream *altstream, int dir, const struct ast_frame *fr)
+{
+	struct altstream_levels levels;
+	size_t count;
+
+	for (; fr; fr = AST_LIST_NEXT(fr, frame_list)) {
+		count = fr->datalen / sizeof(int16_t);
+		if (!count) {
+			continue;
+		}
+		altstream_kernels->analyze(fr->data.ptr, count, &levels);
+		altstream_quality_add(&altstream->altstream_ds->quality[dir], &levels, count, count * 1000 / altstream->capture_rate);
+		altstream_quality_add(&altstream->interval_quality[dir], &levels, count, count * 1000 / altstream->capture_rate);
+	}
+}
+
+static double altstream_level_db(double mean_square)
+{
+	return 10.0 * log10(MAX(mean_square, 1.0) / (32768.0 * 32768.0));
+}
+
+static double altstream_quality_rms(const struct altstream_quality *quality)
+{
+	return quality->samples ? altstream_level_db((double) quality->energy / quality->samples) : altstream_level_db(0);
+}
+
+static double altstream_quality_peak(const struct altstream_quality *quality)
+{
+	return altstream_level_db((double) quality->peak * quality->peak);
+}
+
+static double altstream_quality_silence(const struct altstream_quality *quality)
+{
+	return quality->frames ? (double) quality->silent_frames / quality->frames : 0;
+}
+
+static double altstream_quality_dc(const struct altstream_quality *quality)
+{
+	return quality->samples ? (double) quality->sum / quality->samples / 32768.0 : 0;
+}
+
+static double altstream_quality_snr(const struct altstream_quality *quality)
+{
+	double signal, noise;
+
+	if (!quality->active_samples) {
+		return 0;
+	}
+	signal = (double) quality->active_energy / quality->active_samples;
+	noise = quality->noise_samples ? (double) quality->noise_energy / quality->noise_samples : 0;
+
+	return altstream_level_db(signal) - altstream_level_db(noise);
+}
+
+/*! \brief Raise AltStreamQuality for every direction heard from since the last one */
+static void altstream_quality_event(struct altstream *altstream)
+{
+	static const char *names[] = { "in", "out" };
+	uint64_t now = altstream_monotonic_ms();
+	int dir;
+
+	if (!altstream->quality_interval) {
+		return;
+	}
+	if (!altstream->quality_last) {
+		altstream->quality_last = now;
+		return;
+	}
+	if (now - altstream->quality_last < altstream->quality_interval * 1000ULL) {
+		return;
+	}
+
+	for (dir = 0; dir < 2; dir++) {
+		struct altstream_quality *quality = &altstream->interval_quality[dir];
+
+		if (!quality->samples) {
+			continue;
+		}
+
+		manager_event(EVENT_FLAG_CALL, "AltStreamQuality",
+			"Channel: %s\r\n"
+			"Direction: %s\r\n"
+			"Interval: %.1f\r\n"
+			"Rms: %.1f\r\n"
+			"Peak: %.1f\r\n"
+			"Clipped: %" PRIu64 "\r\n"
+			"Silence: %.2f\r\n"
+			"LongestSilence: %.2f\r\n"
+			"Dc: %.4f\r\n"
+			"Snr: %.1f\r\n",
+			ast_channel_name(altstream->autochan->chan), names[dir],
+			(now - altstream->quality_last) / 1000.0,
+			altstream_quality_rms(quality), altstream_quality_peak(quality), quality->clipped,
+			altstream_quality_silence(quality), quality->longest_silence_ms / 1000.0,
+			altstream_quality_dc(quality), altstream_quality_snr(quality));
+		memset(quality, 0, sizeof(*quality));
+	}
+	altstream->quality_last = now;
+}
+
+/*!
+ * \brief Tell the consumer how much silence was left out, non-zero to give up
+ *
+ * Only whole milliseconds are reported, the rest waits for the next marker.
+ */
+static int altstream_silence_marker(struct altstream *altstream)
+{
+	char marker[64];
+	uint64_t ms = altstream->silence_samples * 1000 / altstream->samp_rate;
+	int len;
+
+	if (!ms) {
+		return 0;
+	}
+	altstream->silence_samples -= ms * altstream->samp_rate / 1000;
+
+	len = snprintf(marker, sizeof(marker), "{\"event\":\"silence\",\"ms\":%" PRIu64 "}", ms);
+
+	return altstream_deliver(altstream, AST_WEBSOCKET_OPCODE_TEXT, marker, len);
+}
+
+/*! \brief Switch the stream to another codec on its next frame, non-zero to give up */
+static int altstream_codec_switch(struct altstream *altstream, enum altstream_features codec)
+{
+	struct altstream_mel *mel = NULL;
+	char info[256];
+	int len;
+
+	if (codec == (altstream->mel ? altstream->mel->format : ALTSTREAM_FEATURES_NONE)) {
+		return 0;
+	}
+
+	/* the endpoint senders borrow the front end, and the tracks, RTP and HTTP only carry PCM */
+	if (altstream->num_dests || altstream->redirect || altstream->tracks_enabled || altstream->transport->pcm_only
+		|| (codec != ALTSTREAM_FEATURES_NONE && altstream->samp_rate != ALTSTREAM_MEL_RATE)) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Cannot switch this stream to %s\n", ast_channel_name(altstream->autochan->chan),
+			altstream->direction_string, altstream_codec_name(codec));
+		return 0;
+	}
+
+	if (codec != ALTSTREAM_FEATURES_NONE && !(mel = altstream_mel_alloc(codec))) {
+		return 0;
+	}
+	altstream_mel_free(altstream->mel);
+	altstream->mel = mel;
+	ast_verb(2, "<%s> [AltStream] (%s) Switched to %s for %s\n", ast_channel_name(altstream->autochan->chan),
+		altstream->direction_string, altstream_codec_name(codec), altstream->wsserver);
+
+	/* the consumer hears about it before the first message in the new format */
+	len = snprintf(info, sizeof(info), "{\"event\":\"codec\",\"codec\":\"%s\"}", altstream_codec_name(codec));
+	if (altstream_deliver(altstream, AST_WEBSOCKET_OPCODE_TEXT, info, len)) {
+		return -1;
+	}
+	if (mel) {
+		len = altstream_features_info(altstream, info, sizeof(info));
+		return altstream_deliver(altstream, AST_WEBSOCKET_OPCODE_TEXT, info, len);
+	}
+
+	return 0;
+}
+
+/*! \brief Carry out what the server asked of the whole stream, non-zero to give up */
+static int altstream_control_apply(struct altstream *altstream)
+{
+	struct altstream_ds *altstream_ds = altstream->altstream_ds;
+	enum altstream_features codec;
+	unsigned int ptime;
+	int codec_change;
+
+	ast_mutex_lock(&altstream_ds->lock);
+	ptime = altstream_ds->control_ptime;
+	codec_change = altstream_ds->codec_change;
+	codec = altstream_ds->codec;
+	altstream_ds->control_ptime = 0;
+	altstream_ds->codec_change = 0;
+	ast_mutex_unlock(&altstream_ds->lock);
+
+	if (ptime && ptime != altstream->ptime) {
+		ast_verb(2, "<%s> [AltStream] (%s) Packet time changed from %u to %u ms for %s\n", ast_channel_name(altstream->autochan->chan),
+			altstream->direction_string, altstream->ptime, ptime, altstream->wsserver);
+		altstream->ptime = ptime;
+	}
+
+	return codec_change ? altstream_codec_switch(altstream, codec) : 0;
+}
+
+static void *altstream_thread(void *obj)
+{
+	struct altstream *altstream = obj;
+	struct ast_format *format_slin;
+	size_t frame_samples;
+	char *channel_name_cleanup;
+
+	/* Keep callid association before any log messages */
+	if (altstream->callid) {
+		ast_verb(2, "<%s> [AltStream] (%s) Keeping Call-ID Association\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		ast_callid_threadassoc_add(altstream->callid);
+	}
+
+	/* before connecting, so the endpoint senders inherit it; what launch allocated stays where it is */
+	if (altstream->cpuset && pthread_setaffinity_np(pthread_self(), sizeof(altstream->cpuset->cpus), &altstream->cpuset->cpus)) {
+		char cpus[256];
+
+		altstream_cpulist_format(&altstream->cpuset->cpus, cpus, sizeof(cpus));
+		ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Could not pin the stream to CPUs %s\n", ast_channel_name(altstream->autochan->chan),
+			altstream->direction_string, cpus);
+	}
+
+	if (altstream->num_dests ? altstream_dests_start(altstream) : altstream_connect(altstream)) {
+		ast_log(LOG_ERROR, "<%s> Could not connect to %s server: %s\n", ast_channel_name(altstream->autochan->chan), altstream->transport->name, altstream->altstream_ds->wsserver);
+
+		ast_test_suite_event_notify("ALTSTREAM_END", "Ws server: %s\r\n", altstream->wsserver);
+
+		/* kill the audiohook */
+		destroy_monitor_audiohook(altstream);
+		altstream_registry_remove(altstream);
+		altstream_ds_strings_free(altstream->altstream_ds);
+		altstream_dests_destroy(altstream);
+		altstream_recorders_close(altstream);
+		ast_autochan_destroy(altstream->autochan);
+
+		/* We specifically don't do altstream_free(altstream) here because the automatic datastore cleanup will get it */
+
+		ast_module_unref(ast_module_info->self);
+
+		return 0;
+	}
+
+	ast_verb(2, "<%s> [AltStream] (%s) Begin AltStream Recording %s\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string, altstream->name);
+
+	//fs = &altstream->altstream_ds->fs;
+
+	format_slin = ast_format_cache_get_slin_by_rate(altstream->capture_rate);
+
+	/* The audiohook must enter and exit the loop locked */
+	ast_audiohook_lock(&altstream->audiohook);
+
+	while (altstream->audiohook.status == AST_AUDIOHOOK_STATUS_RUNNING) {
+		// ast_verb(2, "<%s> [AltStream] (%s) Reading Audio Hook frame...\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+		struct ast_frame *fr;
+
+		/* the server may change the packet time on the way */
+		frame_samples = altstream->ptime * altstream->capture_rate / 1000;
+
+		if (altstream->direction == AST_AUDIOHOOK_DIRECTION_BOTH || altstream->recorders[0] || altstream->recorders[1]) {
+			struct ast_frame *read_fr = NULL;
+			struct ast_frame *write_fr = NULL;
+
+			/* the separate directions come along with the mix to be measured and recorded on their own */
+			fr = ast_audiohook_read_frame_all(&altstream->audiohook, frame_samples, format_slin, &read_fr, &write_fr);
+			if (read_fr) {
+				altstream_quality_frame(altstream, 0, read_fr);
+				altstream_record_frame(altstream, 0, read_fr);
+			}
+			if (write_fr) {
+				altstream_quality_frame(altstream, 1, write_fr);
+				altstream_record_frame(altstream, 1, write_fr);
+			}
+			if (altstream->direction != AST_AUDIOHOOK_DIRECTION_BOTH) {
+				/* only one direction is streamed, it goes out instead of the mix */
+				if (fr) {
+					ast_frame_free(fr, 0);
+				}
+				if (altstream->direction == AST_AUDIOHOOK_DIRECTION_READ) {
+					fr = read_fr;
+					read_fr = NULL;
+				} else {
+					fr = write_fr;
+					write_fr = NULL;
+				}
+			}
+			if (read_fr) {
+				ast_frame_free(read_fr, 0);
+			}
+			if (write_fr) {
+				ast_frame_free(write_fr, 0);
+			}
+		} else {
+			fr = ast_audiohook_read_frame(&altstream->audiohook, frame_samples, altstream->direction, format_slin);
+			if (fr) {
+				altstream_quality_frame(altstream, altstream->direction == AST_AUDIOHOOK_DIRECTION_WRITE, fr);
+			}
+		}
+
+		if (!fr) {
+			ast_audiohook_trigger_wait(&altstream->audiohook);
+
+			if (altstream->audiohook.status != AST_AUDIOHOOK_STATUS_RUNNING) {
+				ast_verb(2, "<%s> [AltStream] (%s) AST_AUDIOHOOK_STATUS_RUNNING = 0\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+				break;
+			}
+
+			/* nothing to send, make sure the peer is still there */
+			ast_audiohook_unlock(&altstream->audiohook);
+			if (altstream_check_connection(altstream) || altstream_control_apply(altstream)) {
+				ast_audiohook_lock(&altstream->audiohook);
+				break;
+			}
+			ast_audiohook_lock(&altstream->audiohook);
+
+			continue;
+		}
+
+		/* audiohook lock is not required for the next block.
+		 * Unlock it, but remember to lock it before looping or exiting */
+		ast_audiohook_unlock(&altstream->audiohook);
+		struct ast_frame *cur;
+
+		if (altstream->tracks_enabled) {
+			/* the mix only paces the loop, every participant goes out as its own track */
+			ast_frame_free(fr, 0);
+			fr = NULL;
+			if (altstream_tracks_service(altstream)) {
+				altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
+			}
+		}
+
+		//ast_mutex_lock(&altstream->altstream_ds->lock);
+		for (cur = fr; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			char *data = cur->data.ptr;
+			int datalen = cur->datalen;
+
+			if (altstream->paused) {
+				altstream->altstream_ds->frames_paused++;
+				continue;
+			}
+
+			// ast_verb(2, "<%s> sending audio frame to websocket...\n", ast_channel_name(altstream->autochan->chan));
+			// ast_mutex_lock(&altstream->altstream_ds->lock);
+
+			if (altstream->resampler) {
+				size_t max_out = altstream_resample_max_output(altstream->resampler, datalen / sizeof(int16_t));
+				int16_t *buf = ast_realloc(altstream->resample_buf, max_out * sizeof(int16_t));
+
+				if (!buf) {
+					continue;
+				}
+				altstream->resample_buf = buf;
+				datalen = altstream_resample(altstream->resampler, (int16_t *) data, datalen / sizeof(int16_t), buf) * sizeof(int16_t);
+				data = (char *) buf;
+			}
+
+			if (altstream->silence_keepalive) {
+				/* a muted audiohook hands out zeroed frames, as does a quiet digital source */
+				if (datalen && !altstream_kernels->energy((int16_t *) data, datalen / sizeof(int16_t))) {
+					altstream->silence_samples += datalen / sizeof(int16_t);
+					altstream->altstream_ds->frames_silent++;
+					if (altstream->silence_samples * 1000 >= (uint64_t) altstream->silence_keepalive * altstream->samp_rate
+						&& altstream_silence_marker(altstream)) {
+						altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
+						break;
+					}
+					continue;
+				}
+				/* the consumer learns about the gap before the audio after it */
+				if (altstream->silence_samples && altstream_silence_marker(altstream)) {
+					altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
+					break;
+				}
+			}
+
+			if (altstream_tenant_take(altstream->tenant, datalen / sizeof(int16_t), altstream->samp_rate)) {
+				altstream->altstream_ds->frames_throttled++;
+				continue;
+			}
+
+			if (altstream->agc || altstream->gain != 1.0f) {
+				altstream_apply_gain(altstream, (int16_t *) data, datalen / sizeof(int16_t));
+			}
+
+			if (altstream->mel) {
+				datalen = altstream_mel_process(altstream->mel, altstream_kernels, (int16_t *) data, datalen / sizeof(int16_t));
+				data = altstream->mel->out;
+				if (!datalen) {
+					continue;
+				}
+			}
+
+			if (altstream_deliver(altstream, AST_WEBSOCKET_OPCODE_BINARY, data, datalen)) {
+				altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
+				break;
+			}
+
+			altstream->altstream_ds->frames_sent++;
+			altstream->altstream_ds->bytes_sent += datalen;
+		}
+
+		//ast_mutex_unlock(&altstream->altstream_ds->lock);
+		//
+
+		/* All done! free it. */
+		if (fr) {
+			ast_frame_free(fr, 0);
+		}
+
+		fr = NULL;
+
+		altstream_quality_event(altstream);
+
+		if (altstream->audiohook.status == AST_AUDIOHOOK_STATUS_RUNNING
+			&& (altstream_check_connection(altstream) || altstream_control_apply(altstream))) {
+			altstream->audiohook.status = AST_AUDIOHOOK_STATUS_SHUTDOWN;
+		}
+
+		ast_audiohook_lock(&altstream->audiohook);
+	}
+
+	ast_audiohook_unlock(&altstream->audiohook);
+
+	/* flush and stop the endpoint senders while the channel is still around for their logs */
+	altstream_tracks_destroy(altstream);
+	altstream_redirect_destroy(altstream);
+	altstream_dests_destroy(altstream);
+	altstream_recorders_close(altstream);
+	altstream_segmenter_flush(altstream);
+
+	if (ast_test_flag(altstream, MUXFLAG_BEEP_STOP)) {
+		ast_autochan_channel_lock(altstream->autochan);
+		ast_stream_and_wait(altstream->autochan->chan, "beep", "");
+		ast_autochan_channel_unlock(altstream->autochan);
+	}
+
+	channel_name_cleanup = ast_strdupa(ast_channel_name(altstream->autochan->chan));
+
+	ast_autochan_destroy(altstream->autochan);
+
+	/* Datastore cleanup.  close the filestream and wait for ds destruction */
+	ast_mutex_lock(&altstream->altstream_ds->lock);
+	if (!altstream->altstream_ds->destruction_ok) {
+		ast_cond_wait(&altstream->altstream_ds->destruction_condition, &altstream->altstream_ds->lock);
+	}
+	ast_mutex_unlock(&altstream->altstream_ds->lock);
+
+	/* kill the audiohook */
+	destroy_monitor_audiohook(altstream);
+
+	ast_verb(2, "<%s> [AltStream] (%s) Finished processing audiohook. Frames sent = %u, dropped = %u\n", channel_name_cleanup, altstream->direction_string,
+		altstream->altstream_ds->frames_sent, altstream->altstream_ds->frames_dropped);
+	ast_verb(2, "<%s> [AltStream] (%s) Post Process\n", channel_name_cleanup, altstream->direction_string);
+
+	if (altstream->post_process) {
+		ast_verb(2, "<%s> [AltStream] (%s) Queueing [%s]\n", channel_name_cleanup, altstream->direction_string, altstream->post_process);
+		altstream_job_queue(channel_name_cleanup, altstream->post_process);
+	}
+
+	// altstream->name
+
+	ast_verb(2, "<%s> [AltStream] (%s) End AltStream Recording to: %s\n", channel_name_cleanup, altstream->direction_string, altstream->wsserver);
+	ast_test_suite_event_notify("ALTSTREAM_END", "Ws server: %s\r\n", altstream->wsserver);
+
+	/* free any altstream memory */
+	altstream_free(altstream);
+
+	ast_module_unref(ast_module_info->self);
+
+	return NULL;
+}
+
+static int setup_altstream_ds(struct altstream *altstream, struct ast_channel *chan, char **datastore_id, const char *beep_id)
+{
+	struct ast_datastore *datastore = NULL;
+	struct altstream_ds *altstream_ds;
+
+	if (!(altstream_ds = ast_calloc(1, sizeof(*altstream_ds)))) {
+		return -1;
+	}
+
+	if (ast_asprintf(datastore_id, "%p", altstream_ds) == -1) {
+		ast_log(LOG_ERROR, "Failed to allocate memory for AltStream ID.\n");
+		ast_free(altstream_ds);
+		return -1;
+	}
+
+	ast_mutex_init(&altstream_ds->lock);
+	ast_cond_init(&altstream_ds->destruction_condition, NULL);
+
+	if (!(datastore = ast_datastore_alloc(&altstream_ds_info, *datastore_id))) {
+		ast_mutex_destroy(&altstream_ds->lock);
+		ast_cond_destroy(&altstream_ds->destruction_condition);
+		ast_free(altstream_ds);
+		return -1;
+	}
+
+	if (ast_test_flag(altstream, MUXFLAG_BEEP_START)) {
+		ast_autochan_channel_lock(altstream->autochan);
+		ast_stream_and_wait(altstream->autochan->chan, "beep", "");
+		ast_autochan_channel_unlock(altstream->autochan);
+	}
+
+	altstream_ds->samp_rate = altstream->samp_rate;
+	altstream_ds->destinations = altstream->num_dests ? altstream->num_dests : 1;
+	altstream_ds->audiohook = &altstream->audiohook;
+	altstream_ds->wsserver = ast_strdup(altstream->wsserver);
+	if (!ast_strlen_zero(beep_id)) {
+		altstream_ds->beep_id = ast_strdup(beep_id);
+	}
+	datastore->data = altstream_ds;
+
+	ast_channel_lock(chan);
+	ast_channel_datastore_add(chan, datastore);
+	ast_channel_unlock(chan);
+
+	altstream->altstream_ds = altstream_ds;
+	return 0;
+}
+
+/*! \brief Evaluate \a src on \a chan, with ^{X} standing for ${X} */
+static void altstream_substitute(struct ast_channel *chan, const char *src, char *buf, size_t len)
+{
+	char *p1, *p2;
+
+	p1 = ast_strdupa(src);
+	for (p2 = p1; *p2; p2++) {
+		if (*p2 == '^' && *(p2 + 1) == '{') {
+			*p2 = '$';
+		}
+	}
+	ast_channel_lock(chan);
+	pbx_substitute_variables_helper(chan, p1, buf, len - 1);
+	ast_channel_unlock(chan);
+}
+
+static int launch_altstream_thread(struct ast_channel *chan, const char *wsserver, const struct altstream_options *o,
+	const char *post_process, const char *beep_id, char **id)
+{
+	pthread_t thread;
+	struct altstream *altstream;
+	const struct altstream_transport *pcm_only;
+	char postprocess2[1024] = "";
+	char *datastore_id = NULL;
+
+	postprocess2[0] = 0;
+	/* If a post process system command is given attach it to the structure */
+	if (!ast_strlen_zero(post_process)) {
+		altstream_substitute(chan, post_process, postprocess2, sizeof(postprocess2));
+	}
+
+	/* Pre-allocate altstream structure and spy */
+	if (!(altstream = ast_calloc(1, sizeof(*altstream)))) {
+		return -1;
+	}
+
+	/* Now that the struct has been calloced, go ahead and initialize the string fields. */
+	if (ast_string_field_init(altstream, 512)) {
+		altstream_free(altstream);
+		return -1;
+	}
+
+	/* before anything else is set up, a refused stream should cost next to nothing */
+	if (altstream_admit(chan, wsserver, !o->no_queue)) {
+		altstream_free(altstream);
+		return 1;
+	}
+	if (!(altstream->admitted = ast_strdup(wsserver))) {
+		altstream_admission_release(wsserver);
+		altstream_free(altstream);
+		return -1;
+	}
+	if (o->profile && o->profile->tenant && altstream_tenant_admit(chan, o->profile->tenant, &altstream->tenant)) {
+		altstream_free(altstream);
+		return 1;
 	}
 
 	/* Setup the actual spy before creating our thread */
@@ -812,585 +7317,3179 @@ static int launch_altstream_thread(
 		return -1;
 	}
 
-	/* Copy over flags and channel name */
-	altstream->flags = flags;
-	if (!(altstream->autochan = ast_autochan_setup(chan))) {
-		altstream_free(altstream);
-		return -1;
+	altstream->unix_fd = -1;
+	altstream->shm_fd = -1;
+	altstream->shm_event_fd = -1;
+	altstream->rtp_fd = -1;
+
+	/* Copy over flags and channel name */
+	altstream->flags = o->flags.flags;
+	if (!(altstream->autochan = ast_autochan_setup(chan))) {
+		altstream_free(altstream);
+		return -1;
+	}
+
+	/* Direction */
+	altstream->direction = o->direction;
+
+	if (o->direction == AST_AUDIOHOOK_DIRECTION_READ) {
+		altstream->direction_string = "in";
+	}
+	else if (o->direction == AST_AUDIOHOOK_DIRECTION_WRITE) {
+		altstream->direction_string = "out";
+	}
+	else {
+		altstream->direction_string = "both";
+	}
+
+	ast_verb(2, "<%s> [AltStream] (%s) Setting Direction\n", ast_channel_name(chan), altstream->direction_string);
+
+	// TODO: make this configurable
+	altstream->reconnection_attempts = o->reconn_attempts;
+	// 5 seconds
+	altstream->reconnection_timeout = o->reconn_timeout;
+
+	ast_verb(2, "<%s> [AltStream] Setting reconnection attempts to %d\n", ast_channel_name(chan), altstream->reconnection_attempts);
+	ast_verb(2, "<%s> [AltStream] Setting reconnection timeout to %d\n", ast_channel_name(chan), altstream->reconnection_timeout);
+
+	altstream->ping_interval = o->ping_interval;
+	altstream->pong_timeout = o->pong_timeout;
+	altstream->quality_interval = o->quality_interval;
+	if (o->resume_window) {
+		altstream->resume_window = o->resume_window;
+		ast_uuid_generate_str(altstream->session, sizeof(altstream->session));
+	}
+	altstream->silence_keepalive = o->silence_keepalive;
+	altstream->transcripts = o->transcripts;
+
+	altstream->gain = altstream_db_to_linear(o->gain_db);
+	altstream->agc = o->agc;
+	altstream->agc_target = 32768.0f * altstream_db_to_linear(o->agc_target_db);
+	altstream->agc_gain = 1.0f;
+	if (o->gain_db || o->agc) {
+		ast_verb(2, "<%s> [AltStream] (%s) Gain %.1f dB, automatic gain %s\n", ast_channel_name(chan), altstream->direction_string,
+			o->gain_db, o->agc ? "on" : "off");
+	}
+
+	/* Capture at the channel's own rate when the resampler can take it from there */
+	altstream->samp_rate = o->samp_rate;
+	altstream->capture_rate = o->samp_rate;
+	altstream->ptime = o->ptime;
+	ast_channel_lock(chan);
+	if (ast_channel_rawreadformat(chan)) {
+		unsigned int native_rate = ast_format_get_sample_rate(ast_channel_rawreadformat(chan));
+
+		if (altstream_rate_supported(native_rate)) {
+			altstream->capture_rate = native_rate;
+		}
+	}
+	ast_channel_unlock(chan);
+
+	if (altstream->capture_rate != altstream->samp_rate) {
+		altstream->resampler = altstream_resampler_alloc(altstream->capture_rate, altstream->samp_rate);
+		if (!altstream->resampler) {
+			altstream->capture_rate = altstream->samp_rate;
+		}
+	}
+	ast_verb(2, "<%s> [AltStream] (%s) Capturing at %u Hz, streaming at %u Hz\n", ast_channel_name(chan), altstream->direction_string,
+		altstream->capture_rate, altstream->samp_rate);
+
+	/* Local recordings, at the capture rate */
+	if (!ast_strlen_zero(o->filename_read)
+		&& !(altstream->recorders[0] = altstream_recorder_open(o->filename_read, altstream->capture_rate, ast_test_flag(altstream, MUXFLAG_APPEND)))) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Not recording the receive audio\n", ast_channel_name(chan), altstream->direction_string);
+	}
+	if (!ast_strlen_zero(o->filename_write)
+		&& !(altstream->recorders[1] = altstream_recorder_open(o->filename_write, altstream->capture_rate, ast_test_flag(altstream, MUXFLAG_APPEND)))) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Not recording the transmit audio\n", ast_channel_name(chan), altstream->direction_string);
+	}
+
+	altstream->compression_level = o->compression_level;
+	altstream->compression_no_takeover = ast_test_flag(altstream, MUXFLAG_COMPRESSION_NO_TAKEOVER) ? 1 : 0;
+
+	/* Server */
+	if (!ast_strlen_zero(wsserver)) {
+		ast_verb(2, "<%s> [AltStream] (%s) Setting wsserver: %s\n", ast_channel_name(chan), altstream->direction_string, wsserver);
+		altstream->wsserver = ast_strdup(wsserver);
+		altstream->transport = altstream_transport_find(wsserver);
+		ast_verb(2, "<%s> [AltStream] (%s) Using %s transport\n", ast_channel_name(chan), altstream->direction_string, altstream->transport->name);
+		if (altstream->resume_window && altstream->transport != &altstream_ws_transport) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Sessions can only be resumed over websockets\n",
+				ast_channel_name(chan), altstream->direction_string);
+			altstream->resume_window = 0;
+		}
+		if (altstream->silence_keepalive && (pcm_only = altstream_transport_pcm_only(wsserver))) {
+			/* markers are text, and RTP timestamps and HTTP utterances need the silence itself */
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Silence markers cannot be carried over %s, sending silence as audio\n",
+				ast_channel_name(chan), altstream->direction_string, pcm_only->name);
+			altstream->silence_keepalive = 0;
+		}
+	}
+
+	if (o->features != ALTSTREAM_FEATURES_NONE) {
+		if (altstream->transport && altstream->transport->pcm_only) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Log-mel features cannot be carried over %s, streaming PCM\n",
+				ast_channel_name(chan), altstream->direction_string, altstream->transport->name);
+		} else if (!(altstream->mel = altstream_mel_alloc(o->features))) {
+			altstream_free(altstream);
+			return -1;
+		} else {
+			ast_verb(2, "<%s> [AltStream] (%s) Streaming log-mel features as %s\n", ast_channel_name(chan), altstream->direction_string,
+				o->features == ALTSTREAM_FEATURES_F32 ? "f32" : "q12");
+		}
+	}
+
+	/* TLS */
+	altstream->has_tls = 0;
+	if (!ast_strlen_zero(o->tcert)) {
+		ast_verb(2, "<%s> [AltStream] (%s) Setting TLS Cert: %s\n", ast_channel_name(chan), altstream->direction_string, o->tcert);
+		if (!(altstream->tls_cfg = altstream_tls_cfg_alloc())) {
+			altstream_free(altstream);
+			return -1;
+		}
+		altstream->has_tls = 1;
+	}
+
+	/* Streams on the Recorder channel AltStreamBridge adds to a bridge */
+	ast_channel_lock(chan);
+	if (!ast_strlen_zero(pbx_builtin_getvar_helper(chan, ALTSTREAM_BRIDGE_VAR))) {
+		altstream->bridge_id = ast_strdup(pbx_builtin_getvar_helper(chan, ALTSTREAM_BRIDGE_VAR));
+	}
+	if (!ast_strlen_zero(pbx_builtin_getvar_helper(chan, ALTSTREAM_BRIDGE_PEER_VAR))) {
+		altstream->bridge_peer = ast_strdup(pbx_builtin_getvar_helper(chan, ALTSTREAM_BRIDGE_PEER_VAR));
+	}
+	ast_channel_unlock(chan);
+
+	if (ast_test_flag(altstream, MUXFLAG_TRACKS)) {
+		if (!altstream->bridge_id) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Tracks are only available to AltStreamBridge\n", ast_channel_name(chan), altstream->direction_string);
+		} else if (altstream->mel || (altstream->transport && altstream->transport->pcm_only)) {
+			ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Tracks cannot be combined with features, RTP or HTTP, streaming the mix\n",
+				ast_channel_name(chan), altstream->direction_string);
+		} else {
+			altstream->tracks_enabled = 1;
+			ast_verb(2, "<%s> [AltStream] (%s) Streaming the participants of bridge %s as tracks\n", ast_channel_name(chan),
+				altstream->direction_string, altstream->bridge_id);
+		}
+	}
+
+	/* Several endpoints share this capture */
+	if (!ast_strlen_zero(wsserver) && strstr(wsserver, ALTSTREAM_DEST_SEPARATOR)) {
+		if (altstream_dests_setup(altstream, wsserver)) {
+			ast_log(LOG_ERROR, "<%s> [AltStream] (%s) No usable endpoint in %s\n", ast_channel_name(chan), altstream->direction_string, wsserver);
+			ast_autochan_destroy(altstream->autochan);
+			altstream_free(altstream);
+			return -1;
+		}
+	}
+
+	if (setup_altstream_ds(altstream, chan, &datastore_id, beep_id)) {
+		ast_autochan_destroy(altstream->autochan);
+		altstream_free(altstream);
+		ast_free(datastore_id);
+		return -1;
+	}
+
+	if (altstream->recorders[0]) {
+		altstream->altstream_ds->filename_read = ast_strdup(altstream->recorders[0]->filename);
+	}
+	if (altstream->recorders[1]) {
+		altstream->altstream_ds->filename_write = ast_strdup(altstream->recorders[1]->filename);
+	}
+
+	if (altstream_registry_add(altstream, chan, datastore_id)) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] (%s) Could not index AltStream %s\n", ast_channel_name(chan), altstream->direction_string, datastore_id);
+	}
+
+	ast_verb(2, "<%s> [AltStream] (%s) Completed Setup\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
+	if (!ast_strlen_zero(o->uid_channel_var)) {
+		if (datastore_id) {
+			pbx_builtin_setvar_helper(chan, o->uid_channel_var, datastore_id);
+		}
+	}
+
+	if (id) {
+		*id = datastore_id;
+	} else {
+		ast_free(datastore_id);
+	}
+	altstream->name = ast_strdup(ast_channel_name(chan));
+
+	if (!ast_strlen_zero(postprocess2)) {
+		altstream->post_process = ast_strdup(postprocess2);
+	}
+
+	ast_set_flag(&altstream->audiohook, AST_AUDIOHOOK_TRIGGER_SYNC);
+	if ((ast_test_flag(altstream, MUXFLAG_RWSYNC))) {
+		ast_set_flag(&altstream->audiohook, AST_AUDIOHOOK_SUBSTITUTE_SILENCE);
+	}
+
+	if (o->readvol)
+		altstream->audiohook.options.read_volume = o->readvol;
+	if (o->writevol)
+		altstream->audiohook.options.write_volume = o->writevol;
+
+	if (start_altstream(chan, &altstream->audiohook)) {
+		ast_log(LOG_WARNING, "<%s> (%s) [AltStream] Unable to add spy type '%s'\n", altstream->direction_string, ast_channel_name(chan), altstream_spy_type);
+		ast_audiohook_destroy(&altstream->audiohook);
+		altstream_free(altstream);
+		return -1;
+	}
+
+	ast_verb(2, "<%s> [AltStream] (%s) Added AudioHook Spy\n", ast_channel_name(chan), altstream->direction_string);
+
+	/* reference be released at altstream destruction */
+	altstream->callid = ast_read_threadstorage_callid();
+	altstream->cpuset = altstream_cpuset_pick();
+
+	return ast_pthread_create_detached_background(&thread, NULL, altstream_thread, altstream);
+}
+
+/*! \brief Parse an AltStream option string into \a o, which then refers to its own copy of it */
+static void altstream_options_parse(struct altstream_options *o, const char *options)
+{
+	struct ast_flags *flags = &o->flags;
+	int x;
+
+	memset(o, 0, sizeof(*o));
+	o->direction = AST_AUDIOHOOK_DIRECTION_BOTH;
+	o->reconn_timeout = 5;
+	o->reconn_attempts = 5;
+	o->ping_interval = ALTSTREAM_PING_INTERVAL;
+	o->pong_timeout = ALTSTREAM_PONG_TIMEOUT;
+	o->agc_target_db = ALTSTREAM_AGC_TARGET_DB;
+	o->samp_rate = ALTSTREAM_DEFAULT_RATE;
+	o->ptime = ALTSTREAM_DEFAULT_PTIME;
+	o->features = ALTSTREAM_FEATURES_NONE;
+	o->transcripts = ALTSTREAM_TRANSCRIPTS_AMI;
+
+	if (!ast_strlen_zero(options) && (o->buf = ast_strdup(options))) {
+		char *opts[OPT_ARG_ARRAY_SIZE] = { NULL, };
+
+		ast_app_parse_options(altstream_opts, flags, opts, o->buf);
+
+		if (ast_test_flag(flags, MUXFLAG_READVOLUME)) {
+			if (ast_strlen_zero(opts[OPT_ARG_READVOLUME])) {
+				ast_log(LOG_WARNING, "No volume level was provided for the heard volume ('v') option.\n");
+			} else if ((sscanf(opts[OPT_ARG_READVOLUME], "%2d", &x) != 1) || (x < -4) || (x > 4)) {
+				ast_log(LOG_NOTICE, "Heard volume must be a number between -4 and 4, not '%s'\n", opts[OPT_ARG_READVOLUME]);
+			} else {
+				o->readvol = get_volfactor(x);
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_WRITEVOLUME)) {
+			if (ast_strlen_zero(opts[OPT_ARG_WRITEVOLUME])) {
+				ast_log(LOG_WARNING, "No volume level was provided for the spoken volume ('V') option.\n");
+			} else if ((sscanf(opts[OPT_ARG_WRITEVOLUME], "%2d", &x) != 1) || (x < -4) || (x > 4)) {
+				ast_log(LOG_NOTICE, "Spoken volume must be a number between -4 and 4, not '%s'\n", opts[OPT_ARG_WRITEVOLUME]);
+			} else {
+				o->writevol = get_volfactor(x);
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_VOLUME)) {
+			if (ast_strlen_zero(opts[OPT_ARG_VOLUME])) {
+				ast_log(LOG_WARNING, "No volume level was provided for the combined volume ('W') option.\n");
+			} else if ((sscanf(opts[OPT_ARG_VOLUME], "%2d", &x) != 1) || (x < -4) || (x > 4)) {
+				ast_log(LOG_NOTICE, "Combined volume must be a number between -4 and 4, not '%s'\n", opts[OPT_ARG_VOLUME]);
+			} else {
+				/* both directions end up in the stream, so this is a plain gain on the stream */
+				o->gain_db += 20.0f * log10f(1 << abs(x)) * (x < 0 ? -1 : 1);
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_GAIN)) {
+			float db;
+
+			if (sscanf(S_OR(opts[OPT_ARG_GAIN], ""), "%30f", &db) != 1 || db < ALTSTREAM_GAIN_MIN_DB || db > ALTSTREAM_GAIN_MAX_DB) {
+				ast_log(LOG_NOTICE, "Gain must be a number of dB between %.0f and %.0f, not '%s'\n",
+					ALTSTREAM_GAIN_MIN_DB, ALTSTREAM_GAIN_MAX_DB, S_OR(opts[OPT_ARG_GAIN], ""));
+			} else {
+				o->gain_db += db;
+			}
+		}
+		o->gain_db = MAX(ALTSTREAM_GAIN_MIN_DB, MIN(ALTSTREAM_GAIN_MAX_DB, o->gain_db));
+
+		if (ast_test_flag(flags, MUXFLAG_AGC)) {
+			o->agc = 1;
+			if (!ast_strlen_zero(opts[OPT_ARG_AGC])
+				&& (sscanf(opts[OPT_ARG_AGC], "%30f", &o->agc_target_db) != 1 || o->agc_target_db > 0 || o->agc_target_db < -60)) {
+				ast_log(LOG_NOTICE, "Automatic gain target must be between -60 and 0 dBFS, not '%s'. Using %.0f\n",
+					opts[OPT_ARG_AGC], ALTSTREAM_AGC_TARGET_DB);
+				o->agc_target_db = ALTSTREAM_AGC_TARGET_DB;
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_SAMPLE_RATE)) {
+			if (sscanf(S_OR(opts[OPT_ARG_SAMPLE_RATE], ""), "%30u", &o->samp_rate) != 1 || !altstream_rate_supported(o->samp_rate)) {
+				ast_log(LOG_WARNING, "Unsupported sample rate '%s'. Using %d\n", S_OR(opts[OPT_ARG_SAMPLE_RATE], ""), ALTSTREAM_DEFAULT_RATE);
+				o->samp_rate = ALTSTREAM_DEFAULT_RATE;
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_PTIME)) {
+			if (sscanf(S_OR(opts[OPT_ARG_PTIME], ""), "%30u", &o->ptime) != 1 || o->ptime < 10 || o->ptime > ALTSTREAM_MAX_PTIME) {
+				ast_log(LOG_WARNING, "Frame length must be between 10 and %d ms, not '%s'. Using %d\n",
+					ALTSTREAM_MAX_PTIME, S_OR(opts[OPT_ARG_PTIME], ""), ALTSTREAM_DEFAULT_PTIME);
+				o->ptime = ALTSTREAM_DEFAULT_PTIME;
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_RESUME)) {
+			o->resume_window = ALTSTREAM_RESUME_WINDOW;
+			if (!ast_strlen_zero(opts[OPT_ARG_RESUME])
+				&& (sscanf(opts[OPT_ARG_RESUME], "%30u", &o->resume_window) != 1 || !o->resume_window)) {
+				ast_log(LOG_WARNING, "Invalid resume window '%s'. Using %d ms\n", opts[OPT_ARG_RESUME], ALTSTREAM_RESUME_WINDOW);
+				o->resume_window = ALTSTREAM_RESUME_WINDOW;
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_SILENCE)) {
+			o->silence_keepalive = ALTSTREAM_SILENCE_KEEPALIVE;
+			if (!ast_strlen_zero(opts[OPT_ARG_SILENCE])
+				&& (sscanf(opts[OPT_ARG_SILENCE], "%30u", &o->silence_keepalive) != 1 || !o->silence_keepalive)) {
+				ast_log(LOG_WARNING, "Invalid silence marker interval '%s'. Using %d ms\n", opts[OPT_ARG_SILENCE], ALTSTREAM_SILENCE_KEEPALIVE);
+				o->silence_keepalive = ALTSTREAM_SILENCE_KEEPALIVE;
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_TRANSCRIPTS)) {
+			if (!strcasecmp(S_OR(opts[OPT_ARG_TRANSCRIPTS], ""), "var")) {
+				o->transcripts = ALTSTREAM_TRANSCRIPTS_VAR;
+			} else if (!strcasecmp(S_OR(opts[OPT_ARG_TRANSCRIPTS], ""), "both")) {
+				o->transcripts = ALTSTREAM_TRANSCRIPTS_AMI | ALTSTREAM_TRANSCRIPTS_VAR;
+			} else if (strcasecmp(S_OR(opts[OPT_ARG_TRANSCRIPTS], ""), "ami")) {
+				ast_log(LOG_WARNING, "Unknown transcript destination '%s'. Using ami\n", S_OR(opts[OPT_ARG_TRANSCRIPTS], ""));
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_FEATURES)) {
+			if (ast_strlen_zero(opts[OPT_ARG_FEATURES]) || !strcasecmp(opts[OPT_ARG_FEATURES], "q12")) {
+				o->features = ALTSTREAM_FEATURES_Q12;
+			} else if (!strcasecmp(opts[OPT_ARG_FEATURES], "f32")) {
+				o->features = ALTSTREAM_FEATURES_F32;
+			} else {
+				ast_log(LOG_WARNING, "Unknown feature format '%s'. Using q12\n", opts[OPT_ARG_FEATURES]);
+				o->features = ALTSTREAM_FEATURES_Q12;
+			}
+			if (o->samp_rate != ALTSTREAM_MEL_RATE && ast_test_flag(flags, MUXFLAG_SAMPLE_RATE)) {
+				ast_log(LOG_WARNING, "Log-mel features are computed at %d Hz, ignoring s(%u)\n", ALTSTREAM_MEL_RATE, o->samp_rate);
+			}
+			o->samp_rate = ALTSTREAM_MEL_RATE;
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_QUALITY_INTERVAL)) {
+			if (sscanf(S_OR(opts[OPT_ARG_QUALITY_INTERVAL], ""), "%30u", &o->quality_interval) != 1 || !o->quality_interval) {
+				ast_log(LOG_WARNING, "Invalid quality event interval '%s'. Events disabled\n", S_OR(opts[OPT_ARG_QUALITY_INTERVAL], ""));
+				o->quality_interval = 0;
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_UID)) {
+			o->uid_channel_var = opts[OPT_ARG_UID];
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_BEEP)) {
+			const char *interval_str = S_OR(opts[OPT_ARG_BEEP_INTERVAL], "15");
+
+			if (sscanf(interval_str, "%30u", &o->beep_interval) != 1) {
+				o->beep_interval = 15;
+				ast_log(LOG_WARNING, "Invalid interval '%s' for periodic beep. Using default of %u\n", interval_str, o->beep_interval);
+			}
+		}
+		if (ast_test_flag(flags, MUXFLAG_DIRECTION)) {
+			const char *direction_str = opts[OPT_ARG_DIRECTION];
+
+			if (!strcmp(direction_str, "in")) {
+				o->direction = AST_AUDIOHOOK_DIRECTION_READ;
+			} else if (!strcmp(direction_str, "out")) {
+				o->direction = AST_AUDIOHOOK_DIRECTION_WRITE;
+			} else if (!strcmp(direction_str, "both")) {
+				o->direction = AST_AUDIOHOOK_DIRECTION_BOTH;
+			} else {
+				o->direction = AST_AUDIOHOOK_DIRECTION_BOTH;
+
+				ast_log(LOG_WARNING, "Invalid direction '%s' given. Using default of 'both'\n", opts[OPT_ARG_DIRECTION]);
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_TLS)) {
+			o->tcert = S_OR(opts[OPT_ARG_TLS], "");
+			ast_verb(2, "Parsing TLS result tcert: %s\n", o->tcert);
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_RECONNECTION_TIMEOUT)) {
+			o->reconn_timeout = atoi( S_OR(opts[OPT_ARG_RECONNECTION_TIMEOUT], "15") );
+			ast_verb(2, "Reconnection timeout set to: %d\n", o->reconn_timeout);
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_RECONNECTION_ATTEMPTS)) {
+			o->reconn_attempts = atoi( S_OR(opts[OPT_ARG_RECONNECTION_ATTEMPTS], "15") );
+			ast_verb(2, "Reconnection attempts set to: %d\n", o->reconn_attempts);
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_READ)) {
+			o->filename_read = opts[OPT_ARG_READNAME];
+			if (ast_strlen_zero(o->filename_read)) {
+				ast_log(LOG_WARNING, "No file given for the r option, not recording the receive audio\n");
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_WRITE)) {
+			o->filename_write = opts[OPT_ARG_WRITENAME];
+			if (ast_strlen_zero(o->filename_write)) {
+				ast_log(LOG_WARNING, "No file given for the t option, not recording the transmit audio\n");
+			}
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_PING_INTERVAL)) {
+			if (sscanf(S_OR(opts[OPT_ARG_PING_INTERVAL], ""), "%30d", &o->ping_interval) != 1 || o->ping_interval < 0) {
+				ast_log(LOG_WARNING, "Invalid keepalive interval '%s'. Using default of %d\n", S_OR(opts[OPT_ARG_PING_INTERVAL], ""), ALTSTREAM_PING_INTERVAL);
+				o->ping_interval = ALTSTREAM_PING_INTERVAL;
+			}
+			ast_verb(2, "Keepalive interval set to: %d\n", o->ping_interval);
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_PONG_TIMEOUT)) {
+			if (sscanf(S_OR(opts[OPT_ARG_PONG_TIMEOUT], ""), "%30d", &o->pong_timeout) != 1 || o->pong_timeout < 1) {
+				ast_log(LOG_WARNING, "Invalid keepalive timeout '%s'. Using default of %d\n", S_OR(opts[OPT_ARG_PONG_TIMEOUT], ""), ALTSTREAM_PONG_TIMEOUT);
+				o->pong_timeout = ALTSTREAM_PONG_TIMEOUT;
+			}
+			ast_verb(2, "Keepalive timeout set to: %d\n", o->pong_timeout);
+		}
+
+		if (ast_test_flag(flags, MUXFLAG_COMPRESSION)) {
+#ifdef HAVE_ZLIB
+			if (sscanf(S_OR(opts[OPT_ARG_COMPRESSION], ""), "%30d", &o->compression_level) != 1 || o->compression_level < 1 || o->compression_level > 9) {
+				ast_log(LOG_WARNING, "Compression level must be a number between 1 and 9, not '%s'. Using 1\n", S_OR(opts[OPT_ARG_COMPRESSION], ""));
+				o->compression_level = 1;
+			}
+			ast_verb(2, "Compression level set to: %d\n", o->compression_level);
+#else
+			ast_log(LOG_WARNING, "AltStream was built without zlib, ignoring the compression option\n");
+#endif
+		}
+	}
+}
+
+static void altstream_options_destroy(struct altstream_options *o)
+{
+	ast_free(o->buf);
+	o->buf = NULL;
+	ao2_cleanup(o->profile);
+	o->profile = NULL;
+}
+
+AO2_STRING_FIELD_HASH_FN(altstream_profile, name)
+AO2_STRING_FIELD_CMP_FN(altstream_profile, name)
+
+/*! \brief Container of every profile, swapped as a whole on reload */
+static AO2_GLOBAL_OBJ_STATIC(altstream_profiles);
+
+/*! \brief Profile settings that map straight onto an AltStream option */
+static const struct {
+	const char *name;
+	char option;
+} altstream_profile_settings[] = {
+	{ "direction", 'D' },
+	{ "rate", 's' },
+	{ "ptime", 'f' },
+	{ "gain", 'G' },
+	{ "tls", 'T' },
+	{ "reconnect_timeout", 'R' },
+	{ "reconnect_attempts", 'n' },
+	{ "ping_interval", 'k' },
+	{ "pong_timeout", 'K' },
+	{ "compression", 'z' },
+	{ "quality_interval", 'q' },
+	{ "silence_interval", 'd' },
+	{ "transcripts", 'h' },
+};
+
+static void altstream_profile_destroy(void *obj)
+{
+	struct altstream_profile *profile = obj;
+
+	altstream_options_destroy(&profile->o);
+	ast_free(profile->wsserver);
+	ast_free(profile->options);
+	ast_free(profile->command);
+	ast_free(profile->tenant);
+}
+
+/*! \brief Compile one altstream.conf category into a profile */
+static struct altstream_profile *altstream_profile_alloc(const char *name, struct ast_variable *var)
+{
+	struct altstream_profile *profile;
+	struct ast_str *settings;
+	const char *wsserver = NULL;
+	const char *options = "";
+	const char *command = NULL;
+	const char *tenant = NULL;
+	int i;
+
+	if (!(settings = ast_str_create(128))) {
+		return NULL;
+	}
+
+	for (; var; var = var->next) {
+		if (!strcasecmp(var->name, "server")) {
+			wsserver = var->value;
+		} else if (!strcasecmp(var->name, "options")) {
+			options = var->value;
+		} else if (!strcasecmp(var->name, "command")) {
+			command = var->value;
+		} else if (!strcasecmp(var->name, "tenant")) {
+			tenant = var->value;
+		} else if (!strcasecmp(var->name, "type")) {
+			continue;
+		} else if (!strcasecmp(var->name, "codec")) {
+			if (!strcasecmp(var->value, "mel") || !strcasecmp(var->value, "mel-q12")) {
+				ast_str_append(&settings, 0, "M(q12)");
+			} else if (!strcasecmp(var->value, "mel-f32")) {
+				ast_str_append(&settings, 0, "M(f32)");
+			} else if (strcasecmp(var->value, "slin")) {
+				ast_log(LOG_WARNING, "[AltStream] Unknown codec '%s' in profile '%s' at line %d of %s, using slin\n",
+					var->value, name, var->lineno, ALTSTREAM_CONFIG);
+			}
+		} else if (!strcasecmp(var->name, "agc")) {
+			if (ast_true(var->value)) {
+				ast_str_append(&settings, 0, "A");
+			} else if (!ast_false(var->value)) {
+				ast_str_append(&settings, 0, "A(%s)", var->value);
+			}
+		} else {
+			for (i = 0; i < ARRAY_LEN(altstream_profile_settings); i++) {
+				if (!strcasecmp(var->name, altstream_profile_settings[i].name)) {
+					ast_str_append(&settings, 0, "%c(%s)", altstream_profile_settings[i].option, var->value);
+					break;
+				}
+			}
+			if (i == ARRAY_LEN(altstream_profile_settings)) {
+				ast_log(LOG_WARNING, "[AltStream] Unknown setting '%s' in profile '%s' at line %d of %s\n",
+					var->name, name, var->lineno, ALTSTREAM_CONFIG);
+			}
+		}
+	}
+
+	if (ast_strlen_zero(wsserver)) {
+		ast_log(LOG_WARNING, "[AltStream] Profile '%s' has no server, skipping it\n", name);
+		ast_free(settings);
+		return NULL;
+	}
+
+	if (!(profile = ao2_alloc_options(sizeof(*profile) + strlen(name) + 1, altstream_profile_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		ast_free(settings);
+		return NULL;
+	}
+	strcpy(profile->name, name); /* SAFE */
+
+	/* the named settings come last so they win over the same option in options= */
+	if (!(profile->wsserver = ast_strdup(wsserver))
+		|| ast_asprintf(&profile->options, "%s%s", options, ast_str_buffer(settings)) < 0
+		|| (command && !(profile->command = ast_strdup(command)))
+		|| (!ast_strlen_zero(tenant) && !(profile->tenant = ast_strdup(tenant)))) {
+		ast_free(settings);
+		ao2_ref(profile, -1);
+		return NULL;
+	}
+	ast_free(settings);
+
+	altstream_options_parse(&profile->o, profile->options);
+
+	return profile;
+}
+
+/*! \brief Parse a CPU list like 0-3,8 into \a cpus, non-zero when it is not one */
+static int altstream_cpulist_parse(const char *list, cpu_set_t *cpus)
+{
+	char *ranges = ast_strdupa(list);
+	char *range;
+
+	CPU_ZERO(cpus);
+	while ((range = strsep(&ranges, ","))) {
+		unsigned int first;
+		unsigned int last;
+		int n = sscanf(range, "%30u-%30u", &first, &last);
+
+		if (n < 1) {
+			return -1;
+		} else if (n == 1) {
+			last = first;
+		}
+		if (first > last || last >= CPU_SETSIZE) {
+			return -1;
+		}
+		for (; first <= last; first++) {
+			CPU_SET(first, cpus);
+		}
+	}
+
+	return CPU_COUNT(cpus) ? 0 : -1;
+}
+
+/*! \brief Learn the node of every CPU from sysfs into \a placement and \a nodes, returns one past the last node */
+static int altstream_numa_load(struct altstream_placement *placement, cpu_set_t *nodes, int max)
+{
+	struct dirent *entry;
+	DIR *dir;
+	int num_nodes = 0;
+
+	memset(placement->cpu_node, -1, sizeof(placement->cpu_node));
+	if (!(dir = opendir(ALTSTREAM_NUMA_SYSFS))) {
+		return 0;
+	}
+
+	while ((entry = readdir(dir))) {
+		char path[PATH_MAX];
+		char list[1024] = "";
+		unsigned int node;
+		FILE *file;
+		int cpu;
+
+		if (sscanf(entry->d_name, "node%30u", &node) != 1 || node >= max) {
+			continue;
+		}
+		snprintf(path, sizeof(path), "%s/%s/cpulist", ALTSTREAM_NUMA_SYSFS, entry->d_name);
+		if (!(file = fopen(path, "r"))) {
+			continue;
+		}
+		if (!fgets(list, sizeof(list), file)) {
+			list[0] = '\0';
+		}
+		fclose(file);
+
+		/* nodes with memory only have no CPUs */
+		if (altstream_cpulist_parse(ast_strip(list), &nodes[node])) {
+			continue;
+		}
+		for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+			if (CPU_ISSET(cpu, &nodes[node])) {
+				placement->cpu_node[cpu] = node;
+			}
+		}
+		num_nodes = MAX(num_nodes, node + 1);
+	}
+	closedir(dir);
+
+	return num_nodes;
+}
+
+static void altstream_cpuset_add(struct altstream_placement *placement, const cpu_set_t *cpus)
+{
+	struct altstream_cpuset *cpuset;
+	int cpu;
+
+	if (placement->num_cpusets == ALTSTREAM_MAX_CPUSETS) {
+		ast_log(LOG_WARNING, "[AltStream] Only %d cpusets are used from %s\n", ALTSTREAM_MAX_CPUSETS, ALTSTREAM_CONFIG);
+		return;
+	}
+	if (!(cpuset = ao2_alloc_options(sizeof(*cpuset), NULL, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return;
+	}
+
+	cpuset->cpus = *cpus;
+	cpuset->node = -1;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, cpus)) {
+			continue;
+		}
+		if (cpuset->node >= 0 && cpuset->node != placement->cpu_node[cpu]) {
+			cpuset->node = -1;
+			break;
+		}
+		cpuset->node = placement->cpu_node[cpu];
+	}
+	placement->cpusets[placement->num_cpusets++] = cpuset;
+}
+
+static void altstream_placement_destroy(void *obj)
+{
+	struct altstream_placement *placement = obj;
+	int i;
+
+	for (i = 0; i < placement->num_cpusets; i++) {
+		ao2_ref(placement->cpusets[i], -1);
+	}
+}
+
+/*! \brief Build the stream thread placement from the [general] category of \a cfg, which may be NULL */
+static struct altstream_placement *altstream_placement_load(struct ast_config *cfg)
+{
+	struct altstream_placement *placement;
+	struct ast_variable *var;
+	cpu_set_t nodes[ALTSTREAM_MAX_CPUSETS];
+	int num_nodes;
+	int i;
+
+	if (!(placement = ao2_alloc_options(sizeof(*placement), altstream_placement_destroy, AO2_ALLOC_OPT_LOCK_NOLOCK))) {
+		return NULL;
+	}
+
+	memset(nodes, 0, sizeof(nodes));
+	num_nodes = altstream_numa_load(placement, nodes, ARRAY_LEN(nodes));
+
+	for (var = cfg ? ast_variable_browse(cfg, ALTSTREAM_GENERAL) : NULL; var; var = var->next) {
+		cpu_set_t cpus;
+
+		if (!strcasecmp(var->name, "numa")) {
+			placement->numa = ast_true(var->value);
+		} else if (!strcasecmp(var->name, "cpuset")) {
+			if (altstream_cpulist_parse(var->value, &cpus)) {
+				ast_log(LOG_WARNING, "[AltStream] Invalid cpuset '%s' at line %d of %s\n", var->value, var->lineno, ALTSTREAM_CONFIG);
+				continue;
+			}
+			altstream_cpuset_add(placement, &cpus);
+		} else if (!altstream_admission_setting(var->name) && strcasecmp(var->name, "server_redirects")) {
+			ast_log(LOG_WARNING, "[AltStream] Unknown setting '%s' at line %d of %s\n", var->name, var->lineno, ALTSTREAM_CONFIG);
+		}
+	}
+
+	/* without cpusets of its own every node with CPUs is one */
+	if (placement->numa && !placement->num_cpusets) {
+		for (i = 0; i < num_nodes; i++) {
+			if (CPU_COUNT(&nodes[i])) {
+				altstream_cpuset_add(placement, &nodes[i]);
+			}
+		}
+		if (placement->num_cpusets < 2) {
+			ast_log(LOG_NOTICE, "[AltStream] Found no NUMA nodes to place streams on, leaving them alone\n");
+			altstream_placement_destroy(placement);
+			placement->num_cpusets = 0;
+		}
+	}
+
+	return placement;
+}
+
+/*!
+ * \brief Compile every profile in altstream.conf and swap them in
+ * \note Streams already running keep the options they started with, their cpuset and their tenant.
+ */
+static int altstream_config_load(int reload)
+{
+	struct ast_flags config_flags = { reload ? CONFIG_FLAG_FILEUNCHANGED : 0 };
+	struct ao2_container *profiles;
+	struct altstream_placement *placement;
+	struct ast_config *cfg;
+	const char *category = NULL;
+
+	cfg = ast_config_load(ALTSTREAM_CONFIG, config_flags);
+	if (cfg == CONFIG_STATUS_FILEUNCHANGED) {
+		return 0;
+	} else if (cfg == CONFIG_STATUS_FILEINVALID) {
+		ast_log(LOG_ERROR, "[AltStream] %s is invalid, keeping the current profiles and cpusets\n", ALTSTREAM_CONFIG);
+		return -1;
+	}
+
+	profiles = ao2_container_alloc_hash(AO2_ALLOC_OPT_LOCK_NOLOCK, AO2_CONTAINER_ALLOC_OPT_DUPS_REJECT,
+		ALTSTREAM_PROFILE_BUCKETS, altstream_profile_hash_fn, NULL, altstream_profile_cmp_fn);
+	if (!profiles) {
+		if (cfg) {
+			ast_config_destroy(cfg);
+		}
+		return -1;
+	}
+
+	/* a missing file just means no profiles */
+	ao2_callback(altstream_tenants, OBJ_NODATA, altstream_tenant_mark_stale, NULL);
+	while (cfg && (category = ast_category_browse(cfg, category))) {
+		struct altstream_profile *profile;
+
+		if (!strcasecmp(category, ALTSTREAM_GENERAL)) {
+			continue;
+		}
+		if (!strcasecmp(S_OR(ast_variable_retrieve(cfg, category, "type"), ""), "tenant")) {
+			altstream_tenant_load(category, ast_variable_browse(cfg, category));
+			continue;
+		}
+		if (!(profile = altstream_profile_alloc(category, ast_variable_browse(cfg, category)))) {
+			continue;
+		}
+		if (!ao2_link(profiles, profile)) {
+			ast_log(LOG_WARNING, "[AltStream] Profile '%s' is defined more than once, using the first one\n", category);
+		}
+		ao2_ref(profile, -1);
+	}
+
+	altstream_admission_load(cfg);
+	altstream_server_redirects = cfg ? ast_true(ast_variable_retrieve(cfg, ALTSTREAM_GENERAL, "server_redirects")) : 0;
+	ao2_callback(altstream_tenants, OBJ_NODATA | OBJ_MULTIPLE | OBJ_UNLINK, altstream_tenant_is_stale, NULL);
+
+	/* streams already running keep their cpuset until they end */
+	if ((placement = altstream_placement_load(cfg))) {
+		if (placement->num_cpusets) {
+			ast_verb(2, "[AltStream] Placing streams on %d cpusets%s\n", placement->num_cpusets,
+				placement->numa ? " by NUMA node" : "");
+		}
+		ao2_global_obj_replace_unref(altstream_placement, placement);
+		ao2_ref(placement, -1);
+	}
+	if (cfg) {
+		ast_config_destroy(cfg);
+	}
+
+	ast_verb(2, "[AltStream] Loaded %d stream profiles\n", ao2_container_count(profiles));
+	ao2_global_obj_replace_unref(altstream_profiles, profiles);
+	ao2_ref(profiles, -1);
+
+	return 0;
+}
+
+/*!
+ * \brief Parse the options for a stream to \a wsserver into \a o
+ *
+ * A \a wsserver of profile=name streams to the server of that profile, with its options
+ * and \a options added on top. Release \a o with altstream_options_destroy() either way.
+ *
+ * \return the endpoint to stream to, valid until \a o is destroyed
+ * \retval NULL the profile does not exist
+ */
+static const char *altstream_options_resolve(struct altstream_options *o, const char *wsserver, const char *options)
+{
+	struct ao2_container *profiles;
+	struct altstream_profile *profile = NULL;
+	const char *name;
+
+	if (ast_strlen_zero(wsserver) || strncasecmp(wsserver, ALTSTREAM_PROFILE_PREFIX, strlen(ALTSTREAM_PROFILE_PREFIX))) {
+		altstream_options_parse(o, options);
+		return wsserver;
+	}
+
+	name = wsserver + strlen(ALTSTREAM_PROFILE_PREFIX);
+	if ((profiles = ao2_global_obj_ref(altstream_profiles))) {
+		profile = ao2_find(profiles, name, OBJ_SEARCH_KEY);
+		ao2_ref(profiles, -1);
+	}
+	if (!profile) {
+		ast_log(LOG_WARNING, "[AltStream] No profile named '%s' in %s\n", name, ALTSTREAM_CONFIG);
+		altstream_options_parse(o, NULL);
+		return NULL;
+	}
+
+	if (ast_strlen_zero(options)) {
+		/* nothing to add, so the options compiled at load do as they are */
+		*o = profile->o;
+		o->buf = NULL;
+	} else {
+		char *merged = ast_alloca(strlen(profile->options) + strlen(options) + 1);
+
+		strcpy(merged, profile->options); /* SAFE */
+		strcat(merged, options); /* SAFE */
+		altstream_options_parse(o, merged);
+	}
+	o->profile = profile;
+
+	return profile->wsserver;
+}
+
+/*!
+ * \brief Start streaming \a chan with parsed options
+ * \retval 0 started, and *id set to its AltStream ID when \a id is given
+ * \retval -1 bad arguments
+ * \retval 1 the stream could not be set up
+ * \retval 2 refused by the caps in altstream.conf
+ */
+static int altstream_start(struct ast_channel *chan, const char *wsserver, const struct altstream_options *o,
+	const char *post_process, char **id)
+{
+	char beep_id[64] = "";
+	int res;
+
+	if (ast_strlen_zero(wsserver)) {
+		ast_log(LOG_WARNING, "AltStream requires an argument (wsserver)\n");
+		return -1;
+	}
+
+	if (ast_strlen_zero(post_process) && o->profile) {
+		post_process = o->profile->command;
+	}
+
+	if (ast_test_flag(&o->flags, MUXFLAG_BEEP) && ast_beep_start(chan, o->beep_interval, beep_id, sizeof(beep_id))) {
+		ast_log(LOG_WARNING, "Unable to enable periodic beep, please ensure func_periodic_hook is loaded.\n");
+		return -1;
+	}
+
+	pbx_builtin_setvar_helper(chan, "ALTSTREAM_WSSERVER", wsserver);
+
+	/* If launch_monitor_thread works, the module reference must not be released until it is finished. */
+	ast_module_ref(ast_module_info->self);
+
+	if ((res = launch_altstream_thread(chan, wsserver, o, post_process, beep_id, id))) {
+		/* Failed */
+		ast_module_unref(ast_module_info->self);
+		if (!ast_strlen_zero(beep_id)) {
+			ast_beep_stop(chan, beep_id);
+		}
+		return res > 0 ? 2 : 1;
+	}
+
+	return 0;
+}
+
+static int altstream_exec(struct ast_channel *chan, const char *data)
+{
+	struct altstream_options o;
+	const char *wsserver;
+	char *parse;
+	int res;
+	AST_DECLARE_APP_ARGS(args, 
+		AST_APP_ARG(wsserver);
+		AST_APP_ARG(options);
+		AST_APP_ARG(post_process);
+	);
+
+	ast_log(LOG_NOTICE, "AltStream created with args %s\n", data);
+	if (ast_strlen_zero(data)) {
+		ast_log(LOG_WARNING, "AltStream requires an argument wsserver\n");
+		return -1;
+	}
+
+	parse = ast_strdupa(data);
+
+	AST_STANDARD_APP_ARGS(args, parse);
+
+	wsserver = altstream_options_resolve(&o, args.wsserver, args.options);
+	res = wsserver ? altstream_start(chan, wsserver, &o, args.post_process, NULL) : -1;
+	altstream_options_destroy(&o);
+	pbx_builtin_setvar_helper(chan, "ALTSTREAM_STATUS", !res ? "STARTED" : res == 2 ? "REFUSED" : "FAILED");
+
+	/* a stream that could not be set up does not end the call */
+	return res < 0 ? -1 : 0;
+}
+
+static int stop_altstream_full(struct ast_channel *chan, const char *data)
+{
+	struct ast_datastore *datastore = NULL;
+	char *parse = "";
+	struct altstream_ds *altstream_ds;
+	const char *beep_id = NULL;
+
+	AST_DECLARE_APP_ARGS(args, AST_APP_ARG(altstreamid););
+
+	if (!ast_strlen_zero(data)) {
+		parse = ast_strdupa(data);
+	}
+
+	AST_STANDARD_APP_ARGS(args, parse);
+
+	ast_channel_lock(chan);
+
+	datastore = ast_channel_datastore_find(chan, &altstream_ds_info, S_OR(args.altstreamid, NULL));
+	if (!datastore) {
+		ast_channel_unlock(chan);
+		return -1;
+	}
+	altstream_ds = datastore->data;
+
+	ast_mutex_lock(&altstream_ds->lock);
+
+	/* The altstream thread may be waiting on the audiohook trigger.
+	 * In order to exit from the altstream loop before waiting on channel
+	 * destruction, poke the audiohook trigger. */
+	if (altstream_ds->audiohook) {
+		if (altstream_ds->audiohook->status != AST_AUDIOHOOK_STATUS_DONE) {
+			ast_audiohook_update_status(altstream_ds->audiohook, AST_AUDIOHOOK_STATUS_SHUTDOWN);
+		}
+		ast_audiohook_lock(altstream_ds->audiohook);
+		ast_cond_signal(&altstream_ds->audiohook->trigger);
+		ast_audiohook_unlock(altstream_ds->audiohook);
+		altstream_ds->audiohook = NULL;
+	}
+
+	if (!ast_strlen_zero(altstream_ds->beep_id)) {
+		beep_id = ast_strdupa(altstream_ds->beep_id);
+	}
+
+	ast_mutex_unlock(&altstream_ds->lock);
+
+	/* Remove the datastore so the monitor thread can exit */
+	if (!ast_channel_datastore_remove(chan, datastore)) {
+		ast_datastore_free(datastore);
+	}
+
+	ast_channel_unlock(chan);
+
+	if (!ast_strlen_zero(beep_id)) {
+		ast_beep_stop(chan, beep_id);
+	}
+
+	return 0;
+}
+
+/*! \brief Stop a stream found by its ID alone */
+static int stop_altstream_by_id(const char *id)
+{
+	struct altstream_entry *entry;
+	struct ast_channel *chan;
+	int res;
+
+	if (!(entry = altstream_registry_find(id))) {
+		return -1;
+	}
+	chan = ast_channel_get_by_uniqueid(entry->uniqueid);
+	ao2_ref(entry, -1);
+	if (!chan) {
+		return -1;
+	}
+
+	res = stop_altstream_full(chan, id);
+	ast_channel_unref(chan);
+
+	return res;
+}
+
+/*! \brief Mute or unmute a stream found by its ID alone */
+static int mute_altstream_by_id(const char *id, enum ast_audiohook_flags flag, int clear)
+{
+	struct altstream_entry *entry;
+	int res = -1;
+
+	if (!(entry = altstream_registry_find(id))) {
+		return -1;
+	}
+
+	ao2_lock(entry);
+	if (entry->ds) {
+		ast_mutex_lock(&entry->ds->lock);
+		if (entry->ds->audiohook) {
+			ast_audiohook_lock(entry->ds->audiohook);
+			if (clear) {
+				ast_clear_flag(entry->ds->audiohook, flag);
+			} else {
+				ast_set_flag(entry->ds->audiohook, flag);
+			}
+			ast_audiohook_unlock(entry->ds->audiohook);
+			res = 0;
+		}
+		ast_mutex_unlock(&entry->ds->lock);
+	}
+	ao2_unlock(entry);
+	ao2_ref(entry, -1);
+
+	return res;
+}
+
+/*!
+ * \brief Ask a live stream to move to other endpoints without a gap in the audio
+ * \retval 0 the stream picks the redirect up with its next message
+ * \retval -1 no such stream, or no endpoint given
+ * \retval 1 the stream is already being redirected
+ */
+static int redirect_altstream_by_id(const char *id, const char *wsserver)
+{
+	struct altstream_options o;
+	struct altstream_entry *entry;
+	const char *target;
+	int res = -1;
+
+	/* a profile only lends its server here, the stream keeps its options */
+	if (ast_strlen_zero(target = altstream_options_resolve(&o, wsserver, NULL))) {
+		altstream_options_destroy(&o);
+		return -1;
+	}
+
+	if (!(entry = altstream_registry_find(id))) {
+		altstream_options_destroy(&o);
+		return -1;
+	}
+
+	ao2_lock(entry);
+	if (entry->ds) {
+		res = altstream_ds_redirect(entry->ds, target);
+	}
+	ao2_unlock(entry);
+	ao2_ref(entry, -1);
+	altstream_options_destroy(&o);
+
+	return res;
+}
+
+static int stop_altstream_exec(struct ast_channel *chan, const char *data)
+{
+	stop_altstream_full(chan, data);
+	return 0;
+}
+
+static char *handle_cli_altstream(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ast_channel *chan;
+
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream {start|stop|list}";
+			e->usage =
+				"Usage: altstream start <chan_name> [args]\n"
+				"         The optional arguments are passed to the AltStream application.\n"
+				"       altstream stop <chan_name> [args]\n"
+				"         The optional arguments are passed to the StopAltStream application.\n"
+				"       altstream list <chan_name>\n";
+			return NULL;
+		case CLI_GENERATE:
+			return ast_complete_channels(a->line, a->word, a->pos, a->n, 2);
+	}
+
+	if (a->argc < 3) {
+		return CLI_SHOWUSAGE;
+	}
+
+	if (!(chan = ast_channel_get_by_name_prefix(a->argv[2], strlen(a->argv[2])))) {
+		ast_cli(a->fd, "No channel matching '%s' found.\n", a->argv[2]);
+		/* Technically this is a failure, but we don't want 2 errors printing out */
+		return CLI_SUCCESS;
+	}
+
+	if (!strcasecmp(a->argv[1], "start")) {
+		altstream_exec(chan, (a->argc >= 4) ? a->argv[3] : "");
+	} else if (!strcasecmp(a->argv[1], "stop")) {
+		stop_altstream_exec(chan, (a->argc >= 4) ? a->argv[3] : "");
+	} else if (!strcasecmp(a->argv[1], "list")) {
+		struct ao2_iterator *iter;
+		struct altstream_entry *entry;
+
+		ast_cli(a->fd, "AltStream ID\tWs Server\tReceive File\tTransmit File\n");
+		ast_cli(a->fd,
+						"=========================================================================\n");
+		iter = ao2_find(altstream_streams_by_channel, ast_channel_uniqueid(chan), OBJ_SEARCH_KEY | OBJ_MULTIPLE);
+		while (iter && (entry = ao2_iterator_next(iter))) {
+			ao2_lock(entry);
+			if (entry->ds) {
+				ast_cli(a->fd, "%s\t%s\t%s\t%s\n", entry->id, entry->wsserver,
+								S_OR(entry->ds->filename_read, ""), S_OR(entry->ds->filename_write, ""));
+			}
+			ao2_unlock(entry);
+			ao2_ref(entry, -1);
+		}
+		if (iter) {
+			ao2_iterator_destroy(iter);
+		}
+	} else {
+		chan = ast_channel_unref(chan);
+		return CLI_SHOWUSAGE;
+	}
+
+	chan = ast_channel_unref(chan);
+
+	return CLI_SUCCESS;
+}
+
+/*! \brief A Recorder channel AltStreamBridge added to a bridge */
+struct altstream_bridge_fork {
+	/*! our side of the Recorder pair, the other one is in the bridge */
+	struct ast_channel *chan;
+	char *bridge_id;
+	AST_LIST_ENTRY(altstream_bridge_fork) list;
+};
+
+static AST_LIST_HEAD_STATIC(altstream_bridge_forks, altstream_bridge_fork);
+
+/*! \brief Read the Recorder channel so its audiohook sees the mix, until it is hung up */
+static void *altstream_bridge_thread(void *obj)
+{
+	struct altstream_bridge_fork *fork = obj;
+
+	while (ast_waitfor(fork->chan, 1000) >= 0) {
+		struct ast_frame *f = ast_read(fork->chan);
+
+		if (!f) {
+			break;
+		}
+		ast_frfree(f);
+	}
+
+	AST_LIST_LOCK(&altstream_bridge_forks);
+	AST_LIST_REMOVE(&altstream_bridge_forks, fork, list);
+	AST_LIST_UNLOCK(&altstream_bridge_forks);
+
+	ast_verb(2, "<%s> [AltStream] Bridge %s fork finished\n", ast_channel_name(fork->chan), fork->bridge_id);
+	ast_hangup(fork->chan);
+	ast_free(fork->bridge_id);
+	ast_free(fork);
+
+	ast_module_unref(ast_module_info->self);
+
+	return NULL;
+}
+
+static int altstream_bridge_start(struct ast_bridge *bridge, const char *wsserver, const char *options)
+{
+	struct altstream_bridge_fork *fork;
+	struct altstream_options o;
+	struct ast_format_cap *cap;
+	struct ast_unreal_pvt *pvt;
+	struct ast_channel *chan;
+	char peer[AST_MAX_UNIQUEID] = "";
+	pthread_t thread;
+	int res;
+
+	if (!(wsserver = altstream_options_resolve(&o, wsserver, options))) {
+		altstream_options_destroy(&o);
+		return -1;
+	}
+
+	if (!(cap = ast_format_cap_alloc(AST_FORMAT_CAP_FLAG_DEFAULT))) {
+		altstream_options_destroy(&o);
+		return -1;
+	}
+	ast_format_cap_append(cap, ast_format_slin16, 0);
+	chan = ast_request("Recorder", cap, NULL, NULL, "AltStream", NULL);
+	ao2_ref(cap, -1);
+	if (!chan) {
+		ast_log(LOG_WARNING, "[AltStream] Unable to create a Recorder channel for bridge %s\n", bridge->uniqueid);
+		altstream_options_destroy(&o);
+		return -1;
+	}
+
+	/* the half of the pair that joins the bridge, tracks leave it out */
+	ast_channel_lock(chan);
+	if ((pvt = ast_channel_tech_pvt(chan))) {
+		ao2_lock(pvt);
+		if (pvt->chan) {
+			ast_copy_string(peer, ast_channel_uniqueid(pvt->chan), sizeof(peer));
+		}
+		ao2_unlock(pvt);
+	}
+	ast_channel_unlock(chan);
+
+	ast_set_read_format(chan, ast_format_slin16);
+	pbx_builtin_setvar_helper(chan, ALTSTREAM_BRIDGE_VAR, bridge->uniqueid);
+	pbx_builtin_setvar_helper(chan, ALTSTREAM_BRIDGE_PEER_VAR, peer);
+	if (ast_unreal_channel_push_to_bridge(chan, bridge, AST_BRIDGE_CHANNEL_FLAG_IMMOVABLE | AST_BRIDGE_CHANNEL_FLAG_LONELY)) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] Unable to join bridge %s\n", ast_channel_name(chan), bridge->uniqueid);
+		altstream_options_destroy(&o);
+		ast_hangup(chan);
+		return -1;
+	}
+
+	/* the mix arrives as audio read by our side, whatever direction was asked for */
+	o.direction = AST_AUDIOHOOK_DIRECTION_READ;
+	res = altstream_start(chan, wsserver, &o, NULL, NULL);
+	altstream_options_destroy(&o);
+	if (res) {
+		ast_hangup(chan);
+		return -1;
+	}
+
+	if (!(fork = ast_calloc(1, sizeof(*fork))) || !(fork->bridge_id = ast_strdup(bridge->uniqueid))) {
+		ast_free(fork);
+		ast_hangup(chan);
+		return -1;
+	}
+	fork->chan = chan;
+
+	AST_LIST_LOCK(&altstream_bridge_forks);
+	AST_LIST_INSERT_TAIL(&altstream_bridge_forks, fork, list);
+	AST_LIST_UNLOCK(&altstream_bridge_forks);
+
+	ast_module_ref(ast_module_info->self);
+	if (ast_pthread_create_detached_background(&thread, NULL, altstream_bridge_thread, fork)) {
+		AST_LIST_LOCK(&altstream_bridge_forks);
+		AST_LIST_REMOVE(&altstream_bridge_forks, fork, list);
+		AST_LIST_UNLOCK(&altstream_bridge_forks);
+		ast_module_unref(ast_module_info->self);
+		ast_hangup(chan);
+		ast_free(fork->bridge_id);
+		ast_free(fork);
+		return -1;
+	}
+
+	ast_verb(2, "<%s> [AltStream] Streaming bridge %s\n", ast_channel_name(chan), bridge->uniqueid);
+
+	return 0;
+}
+
+/*! \brief Hang up every fork of a bridge, their threads clean up */
+static int altstream_bridge_stop(const char *bridge_id)
+{
+	struct altstream_bridge_fork *fork;
+	int found = 0;
+
+	AST_LIST_LOCK(&altstream_bridge_forks);
+	AST_LIST_TRAVERSE(&altstream_bridge_forks, fork, list) {
+		if (!strcmp(fork->bridge_id, bridge_id)) {
+			ast_softhangup(fork->chan, AST_SOFTHANGUP_EXPLICIT);
+			found++;
+		}
+	}
+	AST_LIST_UNLOCK(&altstream_bridge_forks);
+
+	return found ? 0 : -1;
+}
+
+/*! \brief The bridge given by id, or the one \a chan is in */
+static struct ast_bridge *altstream_find_bridge(struct ast_channel *chan, const char *bridge_id)
+{
+	struct ast_bridge *bridge;
+
+	if (!ast_strlen_zero(bridge_id)) {
+		return ast_bridge_find_by_id(bridge_id);
+	}
+
+	ast_channel_lock(chan);
+	bridge = ast_channel_get_bridge(chan);
+	ast_channel_unlock(chan);
+
+	return bridge;
+}
+
+static int altstream_bridge_exec(struct ast_channel *chan, const char *data)
+{
+	struct ast_bridge *bridge;
+	char *parse;
+	int res;
+	AST_DECLARE_APP_ARGS(args,
+		AST_APP_ARG(bridge);
+		AST_APP_ARG(wsserver);
+		AST_APP_ARG(options);
+	);
+
+	parse = ast_strdupa(S_OR(data, ""));
+	AST_STANDARD_APP_ARGS(args, parse);
+
+	if (ast_strlen_zero(args.wsserver)) {
+		ast_log(LOG_WARNING, "%s requires an argument wsserver\n", bridge_app);
+		return -1;
+	}
+
+	if (!(bridge = altstream_find_bridge(chan, args.bridge))) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] No bridge %s to stream\n", ast_channel_name(chan), S_OR(args.bridge, "for this channel"));
+		return -1;
+	}
+
+	res = altstream_bridge_start(bridge, args.wsserver, S_OR(args.options, ""));
+	ao2_ref(bridge, -1);
+
+	return res;
+}
+
+static int stop_altstream_bridge_exec(struct ast_channel *chan, const char *data)
+{
+	struct ast_bridge *bridge;
+	char *bridge_id;
+
+	if (!(bridge = altstream_find_bridge(chan, data))) {
+		ast_log(LOG_WARNING, "<%s> [AltStream] No bridge %s to stop streaming\n", ast_channel_name(chan), S_OR(data, "for this channel"));
+		return 0;
+	}
+	bridge_id = ast_strdupa(bridge->uniqueid);
+	ao2_ref(bridge, -1);
+
+	altstream_bridge_stop(bridge_id);
+
+	return 0;
+}
+
+static int manager_altstream_bridge(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *bridge_id = astman_get_header(m, "BridgeUniqueid");
+	const char *wsserver = astman_get_header(m, "WsServer");
+	const char *options = astman_get_header(m, "Options");
+	struct ast_bridge *bridge;
+	int res;
+
+	if (ast_strlen_zero(bridge_id)) {
+		astman_send_error(s, m, "No bridge specified");
+		return AMI_SUCCESS;
+	}
+
+	if (ast_strlen_zero(wsserver)) {
+		astman_send_error(s, m, "No WsServer specified");
+		return AMI_SUCCESS;
+	}
+
+	if (!(bridge = ast_bridge_find_by_id(bridge_id))) {
+		astman_send_error(s, m, "No such bridge");
+		return AMI_SUCCESS;
+	}
+
+	res = altstream_bridge_start(bridge, wsserver, S_OR(options, ""));
+	ao2_ref(bridge, -1);
+	if (res) {
+		astman_send_error(s, m, "Could not start streaming bridge");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	astman_append(s, "\r\n");
+
+	return AMI_SUCCESS;
+}
+
+static int manager_stop_altstream_bridge(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *bridge_id = astman_get_header(m, "BridgeUniqueid");
+
+	if (ast_strlen_zero(bridge_id)) {
+		astman_send_error(s, m, "No bridge specified");
+		return AMI_SUCCESS;
+	}
+
+	if (altstream_bridge_stop(bridge_id)) {
+		astman_send_error(s, m, "Bridge is not being streamed");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	astman_append(s, "\r\n");
+
+	return AMI_SUCCESS;
+}
+
+static int manager_redirect_altstream(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *altstream_id = astman_get_header(m, "AltStreamID");
+	const char *wsserver = astman_get_header(m, "WsServer");
+	int res;
+
+	if (ast_strlen_zero(altstream_id)) {
+		astman_send_error(s, m, "No AltStreamID specified");
+		return AMI_SUCCESS;
+	}
+
+	if (ast_strlen_zero(wsserver)) {
+		astman_send_error(s, m, "No WsServer specified");
+		return AMI_SUCCESS;
+	}
+
+	res = redirect_altstream_by_id(altstream_id, wsserver);
+	if (res) {
+		astman_send_error(s, m, res > 0 ? "AltStream is already being redirected" : "Could not redirect AltStream");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	astman_append(s, "\r\n");
+
+	return AMI_SUCCESS;
+}
+
+static int manager_altstream_usage(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	struct ao2_iterator iter;
+	struct altstream_usage *usage;
+	struct altstream_tenant *tenant;
+	struct altstream_placement *placement;
+	int index = 0;
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	ast_mutex_lock(&altstream_admission.lock);
+	astman_append(s,
+		"Streams: %d\r\n"
+		"MaxStreams: %d\r\n"
+		"MaxStreamsPerServer: %d\r\n"
+		"Buffered: %d\r\n"
+		"MaxBuffered: %d\r\n"
+		"OverBudget: %d\r\n"
+		"Waiting: %d\r\n"
+		"Admitted: %" PRIu64 "\r\n"
+		"Refused: %" PRIu64 "\r\n",
+		altstream_admission.streams, altstream_admission.max_streams, altstream_admission.max_streams_per_server,
+		altstream_admission.buffered, altstream_admission.max_buffered, altstream_admission.over_budget,
+		altstream_admission.waiting, altstream_admission.admitted, altstream_admission.refused);
+	iter = ao2_iterator_init(altstream_admission.servers, 0);
+	for (; (usage = ao2_iterator_next(&iter)); ao2_ref(usage, -1)) {
+		astman_append(s, "Server%d: %s\r\nServerStreams%d: %d\r\n", index, usage->server, index, usage->streams);
+		index++;
+	}
+	ao2_iterator_destroy(&iter);
+	ast_mutex_unlock(&altstream_admission.lock);
+	astman_append(s, "Servers: %d\r\n", index);
+
+	index = 0;
+	iter = ao2_iterator_init(altstream_tenants, 0);
+	for (; (tenant = ao2_iterator_next(&iter)); ao2_ref(tenant, -1)) {
+		ao2_lock(tenant);
+		astman_append(s,
+			"Tenant%d: %s\r\n"
+			"TenantStreams%d: %d\r\n"
+			"TenantMaxStreams%d: %d\r\n"
+			"TenantRate%d: %.2f\r\n"
+			"TenantStarted%d: %" PRIu64 "\r\n"
+			"TenantRefused%d: %" PRIu64 "\r\n"
+			"TenantSent%d: %.1f\r\n"
+			"TenantThrottled%d: %.1f\r\n",
+			index, tenant->name, index, tenant->streams, index, tenant->max_streams, index, tenant->rate,
+			index, tenant->started, index, tenant->refused, index, tenant->sent_us / 1000000.0,
+			index, tenant->throttled_us / 1000000.0);
+		ao2_unlock(tenant);
+		index++;
+	}
+	ao2_iterator_destroy(&iter);
+	astman_append(s, "Tenants: %d\r\n", index);
+
+	index = 0;
+	if ((placement = ao2_global_obj_ref(altstream_placement))) {
+		for (; index < placement->num_cpusets; index++) {
+			struct altstream_cpuset *cpuset = placement->cpusets[index];
+			char cpus[256];
+
+			altstream_cpulist_format(&cpuset->cpus, cpus, sizeof(cpus));
+			astman_append(s,
+				"Cpuset%d: %s\r\n"
+				"CpusetNode%d: %d\r\n"
+				"CpusetStreams%d: %d\r\n"
+				"CpusetStarted%d: %d\r\n",
+				index, cpus, index, cpuset->node, index, cpuset->streams, index, cpuset->started);
+		}
+		ao2_ref(placement, -1);
+	}
+
+	astman_append(s, "Cpusets: %d\r\n\r\n", index);
+
+	return AMI_SUCCESS;
+}
+
+/*! \brief  Mute / unmute  a MixMonitor channel */
+static int manager_mute_altstream(struct mansession *s, const struct message *m)
+{
+	struct ast_channel *c;
+	const char *name = astman_get_header(m, "Channel");
+	const char *id = astman_get_header(m, "ActionID");
+	const char *state = astman_get_header(m, "State");
+	const char *direction = astman_get_header(m, "Direction");
+	const char *altstream_id = astman_get_header(m, "AltStreamID");
+	int clearmute = 1;
+	enum ast_audiohook_flags flag;
+
+	if (ast_strlen_zero(direction)) {
+		astman_send_error(s, m, "No direction specified. Must be read, write or both");
+		return AMI_SUCCESS;
+	}
+
+	if (!strcasecmp(direction, "read")) {
+		flag = AST_AUDIOHOOK_MUTE_READ;
+	} else if (!strcasecmp(direction, "write")) {
+		flag = AST_AUDIOHOOK_MUTE_WRITE;
+	} else if (!strcasecmp(direction, "both")) {
+		flag = AST_AUDIOHOOK_MUTE_READ | AST_AUDIOHOOK_MUTE_WRITE;
+	} else {
+		astman_send_error(s, m, "Invalid direction specified. Must be read, write or both");
+		return AMI_SUCCESS;
+	}
+
+	if (ast_strlen_zero(name) && ast_strlen_zero(altstream_id)) {
+		astman_send_error(s, m, "No channel specified");
+		return AMI_SUCCESS;
+	}
+
+	if (ast_strlen_zero(state)) {
+		astman_send_error(s, m, "No state specified");
+		return AMI_SUCCESS;
+	}
+
+	clearmute = ast_false(state);
+
+	if (!ast_strlen_zero(altstream_id)) {
+		if (mute_altstream_by_id(altstream_id, flag, clearmute)) {
+			astman_send_error(s, m, "No such AltStream");
+			return AMI_SUCCESS;
+		}
+
+		astman_append(s, "Response: Success\r\n");
+
+		if (!ast_strlen_zero(id)) {
+			astman_append(s, "ActionID: %s\r\n", id);
+		}
+
+		astman_append(s, "\r\n");
+
+		return AMI_SUCCESS;
+	}
+
+	c = ast_channel_get_by_name(name);
+	if (!c) {
+		astman_send_error(s, m, "No such channel");
+		return AMI_SUCCESS;
+	}
+
+	if (ast_audiohook_set_mute(c, altstream_spy_type, flag, clearmute)) {
+		ast_channel_unref(c);
+		astman_send_error(s, m, "Cannot set mute flag");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	astman_append(s, "\r\n");
+
+	ast_channel_unref(c);
+
+	return AMI_SUCCESS;
+}
+
+static int manager_altstream(struct mansession *s, const struct message *m)
+{
+	struct ast_channel *c;
+	const char *name = astman_get_header(m, "Channel");
+	const char *id = astman_get_header(m, "ActionID");
+	const char *wsserver = astman_get_header(m, "WsServer");
+	const char *options = astman_get_header(m, "Options");
+	//const char *command = astman_get_header(m, "Command");
+	struct altstream_options o;
+	char *altstream_id = NULL;
+	int res;
+
+	if (ast_strlen_zero(name)) {
+		astman_send_error(s, m, "No channel specified");
+		return AMI_SUCCESS;
+	}
+
+	c = ast_channel_get_by_name(name);
+	if (!c) {
+		astman_send_error(s, m, "No such channel");
+		return AMI_SUCCESS;
+	}
+
+	if (!(wsserver = altstream_options_resolve(&o, wsserver, options))) {
+		altstream_options_destroy(&o);
+		ast_channel_unref(c);
+		astman_send_error(s, m, "No such profile");
+		return AMI_SUCCESS;
+	}
+	res = altstream_start(c, wsserver, &o, NULL, &altstream_id);
+	altstream_options_destroy(&o);
+
+	if (res) {
+		ast_free(altstream_id);
+		ast_channel_unref(c);
+		astman_send_error(s, m, res == 2 ? "AltStream limit reached" : "Could not start monitoring channel");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	if (!ast_strlen_zero(altstream_id)) {
+		astman_append(s, "AltStreamID: %s\r\n", altstream_id);
+	}
+
+	astman_append(s, "\r\n");
+
+	ast_free(altstream_id);
+	ast_channel_unref(c);
+
+	return AMI_SUCCESS;
+}
+
+/*! \brief Start one channel of an AltStreamBulk action and add its lines to the response */
+static int altstream_bulk_start(struct mansession *s, struct ast_channel *chan, int index, const char *wsserver,
+	const struct altstream_options *shared, const char *command)
+{
+	struct altstream_options o = *shared;
+	char filename_read[PATH_MAX];
+	char filename_write[PATH_MAX];
+	char *altstream_id = NULL;
+	int res;
+
+	/* the files are named per channel, like the command */
+	if (o.filename_read && strstr(o.filename_read, "^{")) {
+		altstream_substitute(chan, o.filename_read, filename_read, sizeof(filename_read));
+		o.filename_read = filename_read;
+	}
+	if (o.filename_write && strstr(o.filename_write, "^{")) {
+		altstream_substitute(chan, o.filename_write, filename_write, sizeof(filename_write));
+		o.filename_write = filename_write;
+	}
+
+	/* one full cap must not hold up the manager for every channel */
+	o.no_queue = 1;
+	res = altstream_start(chan, wsserver, &o, command, &altstream_id);
+
+	astman_append(s, "Channel%d: %s\r\n", index, ast_channel_name(chan));
+	if (res) {
+		astman_append(s, "Error%d: %s\r\n", index, res == 2 ? "AltStream limit reached" : "Could not start monitoring channel");
+	} else {
+		astman_append(s, "AltStreamID%d: %s\r\n", index, S_OR(altstream_id, ""));
+	}
+	ast_free(altstream_id);
+
+	return res ? -1 : 0;
+}
+
+static int manager_altstream_bulk(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *channels = astman_get_header(m, "Channels");
+	const char *pattern = astman_get_header(m, "ChannelPattern");
+	const char *wsserver = astman_get_header(m, "WsServer");
+	const char *options = astman_get_header(m, "Options");
+	const char *command = astman_get_header(m, "Command");
+	struct altstream_options o;
+	struct ast_channel *c;
+	int started = 0;
+	int failed = 0;
+	regex_t regex;
+
+	if (ast_strlen_zero(channels) && ast_strlen_zero(pattern)) {
+		astman_send_error(s, m, "No channels specified");
+		return AMI_SUCCESS;
+	}
+
+	if (ast_strlen_zero(wsserver)) {
+		astman_send_error(s, m, "No WsServer specified");
+		return AMI_SUCCESS;
+	}
+
+	if (!ast_strlen_zero(pattern) && regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB)) {
+		astman_send_error(s, m, "Invalid ChannelPattern");
+		return AMI_SUCCESS;
+	}
+
+	/* the same options for every channel, parsed once */
+	if (!(wsserver = altstream_options_resolve(&o, wsserver, options))) {
+		altstream_options_destroy(&o);
+		if (!ast_strlen_zero(pattern)) {
+			regfree(&regex);
+		}
+		astman_send_error(s, m, "No such profile");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	if (!ast_strlen_zero(channels)) {
+		char *list = ast_strdupa(channels);
+		char *name;
+
+		while ((name = strsep(&list, ","))) {
+			name = ast_strip(name);
+			if (ast_strlen_zero(name)) {
+				continue;
+			}
+			if (!(c = ast_channel_get_by_name(name))) {
+				failed++;
+				astman_append(s, "Channel%d: %s\r\nError%d: No such channel\r\n", started + failed, name, started + failed);
+				continue;
+			}
+			if (altstream_bulk_start(s, c, started + failed + 1, wsserver, &o, command)) {
+				failed++;
+			} else {
+				started++;
+			}
+			ast_channel_unref(c);
+		}
+	}
+
+	if (!ast_strlen_zero(pattern)) {
+		struct ast_channel_iterator *iter;
+
+		if ((iter = ast_channel_iterator_all_new())) {
+			for (; (c = ast_channel_iterator_next(iter)); ast_channel_unref(c)) {
+				if (regexec(&regex, ast_channel_name(c), 0, NULL, 0)) {
+					continue;
+				}
+				if (altstream_bulk_start(s, c, started + failed + 1, wsserver, &o, command)) {
+					failed++;
+				} else {
+					started++;
+				}
+			}
+			ast_channel_iterator_destroy(iter);
+		}
+		regfree(&regex);
+	}
+
+	altstream_options_destroy(&o);
+
+	astman_append(s, "Started: %d\r\n", started);
+	astman_append(s, "Failed: %d\r\n", failed);
+	astman_append(s, "\r\n");
+
+	return AMI_SUCCESS;
+}
+
+static int manager_stop_altstream(struct mansession *s, const struct message *m)
+{
+	struct ast_channel *c;
+	const char *name = astman_get_header(m, "Channel");
+	const char *id = astman_get_header(m, "ActionID");
+	const char *altstream_id = astman_get_header(m, "AltStreamID");
+	int res;
+
+	if (ast_strlen_zero(name)) {
+		if (ast_strlen_zero(altstream_id)) {
+			astman_send_error(s, m, "No channel specified");
+			return AMI_SUCCESS;
+		}
+
+		if (stop_altstream_by_id(altstream_id)) {
+			astman_send_error(s, m, "Could not stop monitoring channel");
+			return AMI_SUCCESS;
+		}
+
+		astman_append(s, "Response: Success\r\n");
+
+		if (!ast_strlen_zero(id)) {
+			astman_append(s, "ActionID: %s\r\n", id);
+		}
+
+		astman_append(s, "\r\n");
+
+		return AMI_SUCCESS;
+	}
+
+	c = ast_channel_get_by_name(name);
+	if (!c) {
+		astman_send_error(s, m, "No such channel");
+		return AMI_SUCCESS;
+	}
+
+	res = stop_altstream_full(c, altstream_id);
+	if (res) {
+		ast_channel_unref(c);
+		astman_send_error(s, m, "Could not stop monitoring channel");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	astman_append(s, "\r\n");
+
+	ast_channel_unref(c);
+
+	return AMI_SUCCESS;
+}
+
+/*! \brief Stop every stream \a iter returns, listing the ones stopped */
+static void altstream_bulk_stop_entries(struct mansession *s, struct ao2_iterator *iter, int *stopped)
+{
+	struct altstream_entry *entry;
+
+	if (!iter) {
+		return;
+	}
+	while ((entry = ao2_iterator_next(iter))) {
+		if (!stop_altstream_by_id(entry->id)) {
+			++*stopped;
+			astman_append(s, "AltStreamID%d: %s\r\n", *stopped, entry->id);
+		}
+		ao2_ref(entry, -1);
+	}
+	ao2_iterator_destroy(iter);
+}
+
+static int manager_stop_altstream_bulk(struct mansession *s, const struct message *m)
+{
+	const char *id = astman_get_header(m, "ActionID");
+	const char *ids = astman_get_header(m, "AltStreamIDs");
+	const char *channels = astman_get_header(m, "Channels");
+	const char *pattern = astman_get_header(m, "ChannelPattern");
+	const char *wsserver = astman_get_header(m, "WsServer");
+	int stopped = 0;
+	regex_t regex;
+
+	if (ast_strlen_zero(ids) && ast_strlen_zero(channels) && ast_strlen_zero(pattern) && ast_strlen_zero(wsserver)) {
+		astman_send_error(s, m, "No AltStreamIDs, Channels, ChannelPattern or WsServer specified");
+		return AMI_SUCCESS;
+	}
+
+	if (!ast_strlen_zero(pattern) && regcomp(&regex, pattern, REG_EXTENDED | REG_NOSUB)) {
+		astman_send_error(s, m, "Invalid ChannelPattern");
+		return AMI_SUCCESS;
+	}
+
+	astman_append(s, "Response: Success\r\n");
+
+	if (!ast_strlen_zero(id)) {
+		astman_append(s, "ActionID: %s\r\n", id);
+	}
+
+	if (!ast_strlen_zero(ids)) {
+		char *list = ast_strdupa(ids);
+		char *altstream_id;
+
+		while ((altstream_id = strsep(&list, ","))) {
+			altstream_id = ast_strip(altstream_id);
+			if (!ast_strlen_zero(altstream_id) && !stop_altstream_by_id(altstream_id)) {
+				stopped++;
+				astman_append(s, "AltStreamID%d: %s\r\n", stopped, altstream_id);
+			}
+		}
+	}
+
+	if (!ast_strlen_zero(channels)) {
+		char *list = ast_strdupa(channels);
+		char *name;
+
+		while ((name = strsep(&list, ","))) {
+			struct ast_channel *c;
+
+			name = ast_strip(name);
+			if (ast_strlen_zero(name) || !(c = ast_channel_get_by_name(name))) {
+				continue;
+			}
+			altstream_bulk_stop_entries(s, ao2_find(altstream_streams_by_channel, ast_channel_uniqueid(c), OBJ_SEARCH_KEY | OBJ_MULTIPLE), &stopped);
+			ast_channel_unref(c);
+		}
+	}
+
+	if (!ast_strlen_zero(pattern)) {
+		struct ao2_iterator iter = ao2_iterator_init(altstream_streams, 0);
+		struct altstream_entry *entry;
+
+		/* the index knows every streamed channel, no need to look through the others */
+		while ((entry = ao2_iterator_next(&iter))) {
+			if (!regexec(&regex, entry->channel, 0, NULL, 0) && !stop_altstream_by_id(entry->id)) {
+				stopped++;
+				astman_append(s, "AltStreamID%d: %s\r\n", stopped, entry->id);
+			}
+			ao2_ref(entry, -1);
+		}
+		ao2_iterator_destroy(&iter);
+		regfree(&regex);
+	}
+
+	if (!ast_strlen_zero(wsserver)) {
+		altstream_bulk_stop_entries(s, ao2_find(altstream_streams_by_server, wsserver, OBJ_SEARCH_KEY | OBJ_MULTIPLE), &stopped);
+	}
+
+	astman_append(s, "Stopped: %d\r\n", stopped);
+	astman_append(s, "\r\n");
+
+	return AMI_SUCCESS;
+}
+
+/*! \brief Read a level key such as rms_in or snr_out, returns -1 if \a key is not one */
+static int altstream_quality_read(struct altstream_ds *ds_data, const char *key, char *buf, size_t len)
+{
+	const struct altstream_quality *quality;
+	const char *suffix = strrchr(key, '_');
+	size_t base;
+
+	if (!suffix) {
+		return -1;
+	}
+	if (!strcasecmp(suffix, "_in")) {
+		quality = &ds_data->quality[0];
+	} else if (!strcasecmp(suffix, "_out")) {
+		quality = &ds_data->quality[1];
+	} else {
+		return -1;
+	}
+	base = suffix - key;
+
+	if (base == 3 && !strncasecmp(key, "rms", base)) {
+		snprintf(buf, len, "%.1f", altstream_quality_rms(quality));
+	} else if (base == 4 && !strncasecmp(key, "peak", base)) {
+		snprintf(buf, len, "%.1f", altstream_quality_peak(quality));
+	} else if (base == 7 && !strncasecmp(key, "clipped", base)) {
+		snprintf(buf, len, "%" PRIu64, quality->clipped);
+	} else if (base == 7 && !strncasecmp(key, "silence", base)) {
+		snprintf(buf, len, "%.2f", altstream_quality_silence(quality));
+	} else if (base == 15 && !strncasecmp(key, "longest_silence", base)) {
+		snprintf(buf, len, "%.2f", quality->longest_silence_ms / 1000.0);
+	} else if (base == 2 && !strncasecmp(key, "dc", base)) {
+		snprintf(buf, len, "%.4f", altstream_quality_dc(quality));
+	} else if (base == 3 && !strncasecmp(key, "snr", base)) {
+		snprintf(buf, len, "%.1f", altstream_quality_snr(quality));
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+static int func_altstream_read(struct ast_channel *chan, const char *cmd, char *data, char *buf, size_t len)
+{
+	struct altstream_entry *entry;
+	struct altstream_ds *ds_data;
+	int res = 0;
+	AST_DECLARE_APP_ARGS(args, AST_APP_ARG(id); AST_APP_ARG(key););
+
+	AST_STANDARD_APP_ARGS(args, data);
+
+	if (ast_strlen_zero(args.id) || ast_strlen_zero(args.key)) {
+		ast_log(LOG_WARNING, "Not enough arguments provided to %s. An ID and key must be provided\n", cmd);
+		return -1;
+	}
+
+	if (!(entry = altstream_registry_find(args.id))) {
+		ast_log(LOG_WARNING, "Could not find AltStream with ID %s\n", args.id);
+		return -1;
+	}
+
+	/* the entry lock keeps the statistics around while they are read */
+	ao2_lock(entry);
+	if (!(ds_data = entry->ds)) {
+		ao2_unlock(entry);
+		ao2_ref(entry, -1);
+		ast_log(LOG_WARNING, "Could not find AltStream with ID %s\n", args.id);
+		return -1;
+	}
+
+	if (!strcasecmp(args.key, "filename")) {
+		/* a redirect replaces it under the statistics lock */
+		ast_mutex_lock(&ds_data->lock);
+		ast_copy_string(buf, S_OR(ds_data->wsserver, ""), len);
+		ast_mutex_unlock(&ds_data->lock);
+	} else if (!strcasecmp(args.key, "frames_sent")) {
+		snprintf(buf, len, "%u", ds_data->frames_sent);
+	} else if (!strcasecmp(args.key, "frames_dropped")) {
+		snprintf(buf, len, "%u", ds_data->frames_dropped);
+	} else if (!strcasecmp(args.key, "bytes_sent")) {
+		snprintf(buf, len, "%" PRIu64, ds_data->bytes_sent);
+	} else if (!strcasecmp(args.key, "rtt")) {
+		snprintf(buf, len, "%.3f", ds_data->rtt / 1000.0);
+	} else if (!strcasecmp(args.key, "srtt")) {
+		snprintf(buf, len, "%.3f", ds_data->srtt / 1000.0);
+	} else if (!strcasecmp(args.key, "pong_timeouts")) {
+		snprintf(buf, len, "%u", ds_data->pong_timeouts);
+	} else if (!strcasecmp(args.key, "compression_ratio")) {
+		snprintf(buf, len, "%.2f", ds_data->compress_out ? (double) ds_data->compress_in / ds_data->compress_out : 1.0);
+	} else if (!strcasecmp(args.key, "compression_cpu")) {
+		snprintf(buf, len, "%.3f", ds_data->compress_cpu_us / 1000.0);
+	} else if (!strcasecmp(args.key, "destinations")) {
+		snprintf(buf, len, "%u", ds_data->destinations);
+	} else if (!strcasecmp(args.key, "destinations_failed")) {
+		snprintf(buf, len, "%u", ds_data->destinations_failed);
+	} else if (!strcasecmp(args.key, "recorded_bytes")) {
+		snprintf(buf, len, "%" PRIu64, ds_data->recorded_bytes);
+	} else if (!strcasecmp(args.key, "record_dropped_bytes")) {
+		snprintf(buf, len, "%" PRIu64, ds_data->record_dropped_bytes);
+	} else if (!strcasecmp(args.key, "resent")) {
+		snprintf(buf, len, "%" PRIu64, ds_data->resent);
+	} else if (!strcasecmp(args.key, "resume_dropped")) {
+		snprintf(buf, len, "%" PRIu64, ds_data->resume_dropped);
+	} else if (!strcasecmp(args.key, "frames_paused")) {
+		snprintf(buf, len, "%u", ds_data->frames_paused);
+	} else if (!strcasecmp(args.key, "frames_silent")) {
+		snprintf(buf, len, "%u", ds_data->frames_silent);
+	} else if (!strcasecmp(args.key, "frames_throttled")) {
+		snprintf(buf, len, "%u", ds_data->frames_throttled);
+	} else if (!strcasecmp(args.key, "segments")) {
+		snprintf(buf, len, "%u", ds_data->segments);
+	} else if (!strcasecmp(args.key, "segments_dropped")) {
+		snprintf(buf, len, "%u", ds_data->segments_dropped);
+	} else if (!altstream_quality_read(ds_data, args.key, buf, len)) {
+		/* handled */
+	} else {
+		ast_log(LOG_WARNING, "Unrecognized %s option %s\n", cmd, args.key);
+		res = -1;
+	}
+	ao2_unlock(entry);
+	ao2_ref(entry, -1);
+
+	return res;
+}
+
+static struct ast_custom_function altstream_function = {
+	.name = "ALTSTREAM",
+	.read = func_altstream_read,
+};
+
+/*! \brief Compare masking by \a kernels with the scalar one around the vector widths, 0 when they agree */
+static int altstream_check_mask(const struct altstream_kernels *kernels)
+{
+	static const size_t sizes[] = { 0, 1, 3, 4, 15, 16, 17, 31, 32, 33, 63, 64, 65, 320, 1920 };
+	unsigned char src[1923];
+	unsigned char expected[1923];
+	unsigned char dst[1923];
+	size_t i, offset;
+
+	for (i = 0; i < sizeof(src); i++) {
+		src[i] = ast_random();
+	}
+
+	for (i = 0; i < ARRAY_LEN(sizes); i++) {
+		/* payloads start 2 to 14 bytes into a frame, so unaligned buffers are the rule */
+		for (offset = 0; offset < 4; offset++) {
+			uint32_t mask = ast_random();
+
+			altstream_mask_scalar(expected, src + offset, sizes[i], mask);
+			memset(dst, 0, sizeof(dst));
+			kernels->mask(dst + offset, src + offset, sizes[i], mask);
+			if (memcmp(dst + offset, expected, sizes[i])) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+/*! \brief Call \a fn \a iterations times, returns nanoseconds per call */
+static double altstream_benchmark_time(void (*fn)(const struct altstream_kernels *kernels, int n, void *data),
+	const struct altstream_kernels *kernels, int iterations, void *data)
+{
+	struct timeval start = ast_tvnow();
+	int n;
+
+	for (n = 0; n < iterations; n++) {
+		fn(kernels, n, data);
+	}
+
+	return ast_tvdiff_us(ast_tvnow(), start) * 1000.0 / iterations;
+}
+
+struct altstream_benchmark_gain_data {
+	int16_t samples[960];
+	size_t count;
+};
+
+static void altstream_benchmark_gain_run(const struct altstream_kernels *kernels, int n, void *data)
+{
+	struct altstream_benchmark_gain_data *bench = data;
+
+	struct altstream_levels levels;
+
+	kernels->gain(bench->samples, bench->count, ALTSTREAM_GAIN_UNITY + (n & 1 ? 1 : -1));
+	kernels->energy(bench->samples, bench->count);
+	kernels->analyze(bench->samples, bench->count, &levels);
+}
+
+static int altstream_levels_differ(const struct altstream_kernels *kernels, const int16_t *samples, size_t count,
+	const struct altstream_levels *expected)
+{
+	struct altstream_levels levels;
+
+	kernels->analyze(samples, count, &levels);
+
+	return levels.energy != expected->energy || levels.sum != expected->sum
+		|| levels.peak != expected->peak || levels.clipped != expected->clipped;
+}
+
+/*! \brief Compare the gain, energy and level kernels of \a kernels with the scalar ones, 0 when they agree */
+static int altstream_check_gain(const struct altstream_kernels *kernels)
+{
+	static const size_t sizes[] = { 0, 1, 7, 8, 9, 15, 16, 17, 33, 160, 320, 960 };
+	static const int16_t gains[] = { 0, ALTSTREAM_GAIN_UNITY / 3, ALTSTREAM_GAIN_UNITY, 3 * ALTSTREAM_GAIN_UNITY, INT16_MAX };
+	int16_t source[960];
+	int16_t expected[960];
+	int16_t samples[960];
+	int i, g;
+
+	for (i = 0; i < ARRAY_LEN(source); i++) {
+		source[i] = ast_random();
+	}
+	/* both ends of the range, for the peak and clip counts and the widest squares */
+	source[0] = INT16_MIN;
+	source[7] = INT16_MIN;
+	source[100] = INT16_MAX;
+
+	for (i = 0; i < ARRAY_LEN(sizes); i++) {
+		struct altstream_levels expected_levels;
+
+		if (kernels->energy(source, sizes[i]) != altstream_energy_scalar(source, sizes[i])) {
+			return -1;
+		}
+		altstream_analyze_scalar(source, sizes[i], &expected_levels);
+		if (altstream_levels_differ(kernels, source, sizes[i], &expected_levels)) {
+			return -1;
+		}
+		for (g = 0; g < ARRAY_LEN(gains); g++) {
+			memcpy(expected, source, sizeof(source));
+			memcpy(samples, source, sizeof(source));
+			altstream_gain_scalar(expected, sizes[i], gains[g]);
+			kernels->gain(samples, sizes[i], gains[g]);
+			if (memcmp(samples, expected, sizeof(samples))) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+static void altstream_benchmark_gain(int fd)
+{
+	static const size_t sizes[] = { 160, 320, 960 };
+	struct altstream_benchmark_gain_data bench;
+	int16_t source[960];
+	int iterations = 200000;
+	int i, k;
+
+	for (i = 0; i < ARRAY_LEN(source); i++) {
+		source[i] = ast_random();
+	}
+
+	ast_cli(fd, "Gain, energy and level analysis per frame, %d frames per run\n", iterations);
+	ast_cli(fd, "%-8s %8s %12s %8s\n", "Kernel", "Samples", "ns/frame", "Speedup");
+	for (i = 0; i < ARRAY_LEN(sizes); i++) {
+		double scalar_ns = 0;
+
+		for (k = 0; k < ARRAY_LEN(altstream_kernel_sets); k++) {
+			const struct altstream_kernels *kernels = &altstream_kernel_sets[k];
+			double ns;
+
+			if (!kernels->supported()) {
+				continue;
+			}
+
+			if (altstream_check_gain(kernels)) {
+				ast_cli(fd, "%-8s %8zu produced wrong output\n", kernels->name, sizes[i]);
+				continue;
+			}
+
+			memcpy(bench.samples, source, sizeof(source));
+			bench.count = sizes[i];
+			ns = altstream_benchmark_time(altstream_benchmark_gain_run, kernels, iterations, &bench);
+			if (!scalar_ns) {
+				scalar_ns = ns;
+			}
+			ast_cli(fd, "%-8s %8zu %12.1f %7.2fx\n", kernels->name, sizes[i], ns, ns > 0 ? scalar_ns / ns : 0);
+		}
+	}
+	ast_cli(fd, "Active kernels: %s\n", altstream_kernels->name);
+}
+
+static void altstream_benchmark_mask(int fd)
+{
+	static const size_t sizes[] = { 320, 640, 1920 };
+	unsigned char src[1920];
+	unsigned char dst[1920];
+	uint32_t mask = 0x5a3c96e1;
+	int iterations = 200000;
+	int i, k, n;
+
+	for (i = 0; i < sizeof(src); i++) {
+		src[i] = ast_random();
+	}
+
+	ast_cli(fd, "Websocket masking, %d messages per run\n", iterations);
+	ast_cli(fd, "%-8s %8s %12s %12s %8s\n", "Kernel", "Bytes", "ns/message", "MB/s", "Speedup");
+	for (i = 0; i < ARRAY_LEN(sizes); i++) {
+		double scalar_ns = 0;
+
+		for (k = 0; k < ARRAY_LEN(altstream_kernel_sets); k++) {
+			const struct altstream_kernels *kernel = &altstream_kernel_sets[k];
+			struct timeval start;
+			double ns;
+
+			if (!kernel->supported()) {
+				continue;
+			}
+
+			if (altstream_check_mask(kernel)) {
+				ast_cli(fd, "%-8s %8zu produced wrong output\n", kernel->name, sizes[i]);
+				continue;
+			}
+
+			start = ast_tvnow();
+			for (n = 0; n < iterations; n++) {
+				kernel->mask(dst, src, sizes[i], mask ^ n);
+			}
+			ns = ast_tvdiff_us(ast_tvnow(), start) * 1000.0 / iterations;
+			if (!scalar_ns) {
+				scalar_ns = ns;
+			}
+
+			ast_cli(fd, "%-8s %8zu %12.1f %12.1f %7.2fx\n", kernel->name, sizes[i], ns,
+				ns > 0 ? sizes[i] * 1000.0 / ns : 0, ns > 0 ? scalar_ns / ns : 0);
+		}
+	}
+	ast_cli(fd, "Active kernels: %s\n", altstream_kernels->name);
+}
+
+static void altstream_benchmark_tone(int16_t *samples, size_t count, double freq, unsigned int rate)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		samples[i] = 16000.0 * sin(2.0 * M_PI * freq * i / rate);
 	}
+}
 
-	/* Direction */
-	altstream->direction = direction;
+/*! \brief Level of \a samples relative to the test tone, skipping the filter warm up */
+static double altstream_benchmark_level(const int16_t *samples, size_t count, unsigned int rate)
+{
+	size_t skip = rate / 10;
+	double sum = 0;
+	size_t i;
 
-	if (direction == AST_AUDIOHOOK_DIRECTION_READ) {
-		altstream->direction_string = "in";
+	if (count <= skip) {
+		return -INFINITY;
 	}
-	else if (direction == AST_AUDIOHOOK_DIRECTION_WRITE) {
-		altstream->direction_string = "out";
+	for (i = skip; i < count; i++) {
+		sum += (double) samples[i] * samples[i];
 	}
-	else {
-		altstream->direction_string = "both";
+
+	return 10.0 * log10(MAX(sum / (count - skip), 1e-3) / (16000.0 * 16000.0 / 2.0));
+}
+
+/*! \brief Push one second of \a in through the core translator, returns the samples produced */
+static size_t altstream_benchmark_translate(struct ast_trans_pvt *path, struct ast_format *format,
+	int16_t *in, unsigned int in_rate, int16_t *out, size_t out_len)
+{
+	size_t frame = SAMPLES_PER_FRAME * in_rate / ALTSTREAM_DEFAULT_RATE;
+	size_t produced = 0;
+	size_t i;
+
+	for (i = 0; i + frame <= in_rate; i += frame) {
+		struct ast_frame f = {
+			.frametype = AST_FRAME_VOICE,
+			.subclass.format = format,
+			.data.ptr = in + i,
+			.datalen = frame * sizeof(int16_t),
+			.samples = frame,
+			.src = "altstream",
+		};
+		struct ast_frame *res = ast_translate(path, &f, 0);
+		struct ast_frame *cur;
+
+		for (cur = res; cur; cur = AST_LIST_NEXT(cur, frame_list)) {
+			size_t count = MIN(cur->datalen / sizeof(int16_t), out_len - produced);
+
+			memcpy(out + produced, cur->data.ptr, count * sizeof(int16_t));
+			produced += count;
+		}
+		if (res) {
+			ast_frfree(res);
+		}
 	}
 
-	ast_verb(2, "<%s> [AltStream] (%s) Setting Direction\n", ast_channel_name(chan), altstream->direction_string);
+	return produced;
+}
 
-	// TODO: make this configurable
-	altstream->reconnection_attempts = reconn_attempts;
-	// 5 seconds
-	altstream->reconnection_timeout = reconn_timeout;
+/*! \brief Push one second of \a in through the AltStream resampler, returns the samples produced */
+static size_t altstream_benchmark_resample_second(struct altstream_resampler *rs, const struct altstream_kernels *kernels,
+	const int16_t *in, int16_t *out)
+{
+	size_t frame = SAMPLES_PER_FRAME * rs->in_rate / ALTSTREAM_DEFAULT_RATE;
+	size_t produced = 0;
+	size_t i;
 
-	ast_verb(2, "<%s> [AltStream] Setting reconnection attempts to %d\n", ast_channel_name(chan), altstream->reconnection_attempts);
-	ast_verb(2, "<%s> [AltStream] Setting reconnection timeout to %d\n", ast_channel_name(chan), altstream->reconnection_timeout);
+	for (i = 0; i + frame <= rs->in_rate; i += frame) {
+		produced += altstream_resample_with(rs, kernels, in + i, frame, out + produced);
+	}
 
-	/* Server */
-	if (!ast_strlen_zero(wsserver)) {
-		ast_verb(2, "<%s> [AltStream] (%s) Setting wsserver: %s\n", ast_channel_name(chan), altstream->direction_string, wsserver);
-		altstream->wsserver = ast_strdup(wsserver);
+	return produced;
+}
+
+/*!
+ * \brief Convert a second of tone with \a kernels and with the scalar kernels, 0 when they agree
+ *
+ * \a level is set to the level of the converted tone relative to the input, in dB.
+ */
+static int altstream_check_resample(const struct altstream_kernels *kernels, unsigned int in_rate, unsigned int out_rate,
+	double freq, double *level)
+{
+	int16_t *in = ast_malloc(in_rate * sizeof(int16_t));
+	int16_t *out = ast_malloc((out_rate + 2) * sizeof(int16_t));
+	int16_t *expected = ast_malloc((out_rate + 2) * sizeof(int16_t));
+	struct altstream_resampler *rs = NULL;
+	size_t expected_len;
+	size_t produced;
+	int res = -1;
+
+	if (!in || !out || !expected) {
+		goto done;
 	}
+	altstream_benchmark_tone(in, in_rate, freq, in_rate);
 
-	/* TLS */
-	altstream->has_tls = 0;
-	if (!ast_strlen_zero(tcert)) {
-		ast_verb(2, "<%s> [AltStream] (%s) Setting TLS Cert: %s\n", ast_channel_name(chan), altstream->direction_string, tcert);
-		struct ast_tls_config  *ast_tls_config;
-		altstream->tls_cfg = ast_calloc(1, sizeof(*ast_tls_config));
-		altstream->has_tls = 1;
-		ast_set_flag(&altstream->tls_cfg->flags, AST_SSL_DONT_VERIFY_SERVER);
+	if (!(rs = altstream_resampler_alloc(in_rate, out_rate))) {
+		goto done;
+	}
+	expected_len = altstream_benchmark_resample_second(rs, &altstream_kernel_sets[0], in, expected);
+	altstream_resampler_free(rs);
+	if (!(rs = altstream_resampler_alloc(in_rate, out_rate))) {
+		goto done;
 	}
+	produced = altstream_benchmark_resample_second(rs, kernels, in, out);
 
-	if (setup_altstream_ds(altstream, chan, &datastore_id, beep_id)) {
-		ast_autochan_destroy(altstream->autochan);
-		altstream_free(altstream);
-		ast_free(datastore_id);
-		return -1;
+	*level = altstream_benchmark_level(out, produced, out_rate);
+	if (produced == expected_len && !memcmp(out, expected, produced * sizeof(int16_t))) {
+		res = 0;
 	}
 
-	ast_verb(2, "<%s> [AltStream] (%s) Completed Setup\n", ast_channel_name(altstream->autochan->chan), altstream->direction_string);
-	if (!ast_strlen_zero(uid_channel_var)) {
-		if (datastore_id) {
-			pbx_builtin_setvar_helper(chan, uid_channel_var, datastore_id);
+done:
+	altstream_resampler_free(rs);
+	ast_free(in);
+	ast_free(out);
+	ast_free(expected);
+
+	return res;
+}
+
+static void altstream_benchmark_resample_row(int fd, const char *name, double ns, double pass_db, double stop_db, int downsampling)
+{
+	if (downsampling) {
+		ast_cli(fd, "  %-8s %12.1f %10.0f %9.2f %9.1f\n", name, ns, ns > 0 ? 20000000.0 / ns : 0, pass_db, stop_db);
+	} else {
+		ast_cli(fd, "  %-8s %12.1f %10.0f %9.2f %9s\n", name, ns, ns > 0 ? 20000000.0 / ns : 0, pass_db, "-");
+	}
+}
+
+static void altstream_benchmark_resample(int fd)
+{
+	static const unsigned int pairs[][2] = {
+		{ 8000, 16000 }, { 16000, 8000 }, { 48000, 8000 }, { 48000, 16000 }, { 8000, 48000 },
+	};
+	int16_t *pass = ast_malloc(48000 * sizeof(int16_t));
+	int16_t *stop = ast_malloc(48000 * sizeof(int16_t));
+	int16_t *out = ast_malloc(48002 * sizeof(int16_t));
+	int16_t *expected = ast_malloc(48002 * sizeof(int16_t));
+	int seconds = 20;
+	int i, k, n;
+
+	if (!pass || !stop || !out || !expected) {
+		goto done;
+	}
+
+	ast_cli(fd, "Rate conversion of 20 ms frames, %d seconds of audio per run\n", seconds);
+	ast_cli(fd, "Passband is a 1 kHz tone, stopband a tone between the output and input Nyquist frequencies\n");
+	for (i = 0; i < ARRAY_LEN(pairs); i++) {
+		unsigned int in_rate = pairs[i][0];
+		unsigned int out_rate = pairs[i][1];
+		int downsampling = out_rate < in_rate;
+		double stop_freq = (out_rate + in_rate) / 4.0;
+		struct ast_format *in_format = ast_format_cache_get_slin_by_rate(in_rate);
+		struct ast_format *out_format = ast_format_cache_get_slin_by_rate(out_rate);
+		struct ast_trans_pvt *path;
+		size_t expected_len = 0;
+		double pass_db, stop_db = 0, ns;
+		struct timeval start;
+		size_t produced;
+
+		altstream_benchmark_tone(pass, in_rate, 1000.0, in_rate);
+		altstream_benchmark_tone(stop, in_rate, stop_freq, in_rate);
+
+		ast_cli(fd, "%u -> %u Hz\n", in_rate, out_rate);
+		ast_cli(fd, "  %-8s %12s %10s %9s %9s\n", "Engine", "ns/frame", "Streams", "Pass dB", "Stop dB");
+		for (k = 0; k < ARRAY_LEN(altstream_kernel_sets); k++) {
+			const struct altstream_kernels *kernels = &altstream_kernel_sets[k];
+			struct altstream_resampler *rs;
+
+			if (!kernels->supported() || !(rs = altstream_resampler_alloc(in_rate, out_rate))) {
+				continue;
+			}
+
+			produced = altstream_benchmark_resample_second(rs, kernels, pass, out);
+			if (!expected_len) {
+				memcpy(expected, out, produced * sizeof(int16_t));
+				expected_len = produced;
+			} else if (produced != expected_len || memcmp(out, expected, produced * sizeof(int16_t))) {
+				ast_cli(fd, "  %-8s produced wrong output\n", kernels->name);
+				altstream_resampler_free(rs);
+				continue;
+			}
+			pass_db = altstream_benchmark_level(out, produced, out_rate);
+
+			if (downsampling) {
+				altstream_resampler_free(rs);
+				if (!(rs = altstream_resampler_alloc(in_rate, out_rate))) {
+					continue;
+				}
+				produced = altstream_benchmark_resample_second(rs, kernels, stop, out);
+				stop_db = altstream_benchmark_level(out, produced, out_rate);
+			}
+
+			start = ast_tvnow();
+			for (n = 0; n < seconds; n++) {
+				altstream_benchmark_resample_second(rs, kernels, pass, out);
+			}
+			ns = ast_tvdiff_us(ast_tvnow(), start) * 1000.0 / (seconds * 50);
+			altstream_resampler_free(rs);
+
+			altstream_benchmark_resample_row(fd, kernels->name, ns, pass_db, stop_db, downsampling);
+		}
+
+		path = ast_translator_build_path(out_format, in_format);
+		if (!path) {
+			ast_cli(fd, "  %-8s no translation path\n", "core");
+			continue;
+		}
+		produced = altstream_benchmark_translate(path, in_format, pass, in_rate, out, 48002);
+		pass_db = altstream_benchmark_level(out, produced, out_rate);
+		if (downsampling) {
+			ast_translator_free_path(path);
+			if (!(path = ast_translator_build_path(out_format, in_format))) {
+				continue;
+			}
+			produced = altstream_benchmark_translate(path, in_format, stop, in_rate, out, 48002);
+			stop_db = altstream_benchmark_level(out, produced, out_rate);
+		}
+
+		start = ast_tvnow();
+		for (n = 0; n < seconds; n++) {
+			altstream_benchmark_translate(path, in_format, pass, in_rate, out, 48002);
 		}
+		ns = ast_tvdiff_us(ast_tvnow(), start) * 1000.0 / (seconds * 50);
+		ast_translator_free_path(path);
+
+		altstream_benchmark_resample_row(fd, "core", ns, pass_db, stop_db, downsampling);
 	}
+	ast_cli(fd, "Active kernels: %s\n", altstream_kernels->name);
 
-	ast_free(datastore_id);
-	altstream->name = ast_strdup(ast_channel_name(chan));
+done:
+	ast_free(pass);
+	ast_free(stop);
+	ast_free(out);
+	ast_free(expected);
+}
 
-	if (!ast_strlen_zero(postprocess2)) {
-		altstream->post_process = ast_strdup(postprocess2);
+/*! \brief Log10 mel bins of \a mel's current window by a direct DFT in double precision */
+static void altstream_mel_reference(const struct altstream_mel *mel, double *bins)
+{
+	double power[ALTSTREAM_MEL_SPECTRUM];
+	unsigned int i, k, n;
+
+	for (k = 0; k < ALTSTREAM_MEL_SPECTRUM; k++) {
+		double re = 0, im = 0;
+
+		for (n = 0; n < ALTSTREAM_MEL_N_FFT; n++) {
+			double x = mel->samples[n] * (0.5 - 0.5 * cos(2.0 * M_PI * n / ALTSTREAM_MEL_N_FFT));
+			double angle = -2.0 * M_PI * ((k * n) % ALTSTREAM_MEL_N_FFT) / ALTSTREAM_MEL_N_FFT;
+
+			re += x * cos(angle);
+			im += x * sin(angle);
+		}
+		power[k] = re * re + im * im;
 	}
+	for (i = 0; i < ALTSTREAM_MEL_BINS; i++) {
+		const float *filter = altstream_mel_tables.filters + altstream_mel_tables.filter_offset[i];
+		double sum = 0;
 
-	ast_set_flag(&altstream->audiohook, AST_AUDIOHOOK_TRIGGER_SYNC);
-	if ((ast_test_flag(altstream, MUXFLAG_RWSYNC))) {
-		ast_set_flag(&altstream->audiohook, AST_AUDIOHOOK_SUBSTITUTE_SILENCE);
+		for (k = 0; k < altstream_mel_tables.filter_len[i]; k++) {
+			sum += filter[k] * power[altstream_mel_tables.filter_start[i] + k];
+		}
+		bins[i] = log10(MAX(sum, 1e-10));
 	}
+}
 
-	if (readvol)
-		altstream->audiohook.options.read_volume = readvol;
-	if (writevol)
-		altstream->audiohook.options.write_volume = writevol;
+/*! \brief Fill \a mel's window with a chirp over noise, scaled like Whisper's input */
+static void altstream_mel_test_signal(struct altstream_mel *mel)
+{
+	int i;
 
-	if (start_altstream(chan, &altstream->audiohook)) {
-		ast_log(LOG_WARNING, "<%s> (%s) [AltStream] Unable to add spy type '%s'\n", altstream->direction_string, ast_channel_name(chan), altstream_spy_type);
-		ast_audiohook_destroy(&altstream->audiohook);
-		altstream_free(altstream);
-		return -1;
+	for (i = 0; i < ALTSTREAM_MEL_N_FFT; i++) {
+		mel->samples[i] = 0.5 * sin(2.0 * M_PI * (100.0 + 10.0 * i) * i / ALTSTREAM_MEL_RATE)
+			+ (ast_random() % 2001 - 1000) / 100000.0;
 	}
+}
 
-	ast_verb(2, "<%s> [AltStream] (%s) Added AudioHook Spy\n", ast_channel_name(chan), altstream->direction_string);
+/*! \brief Compute a log-mel frame with \a kernels and with the scalar kernels, 0 when they are bit identical */
+static int altstream_check_mel(const struct altstream_kernels *kernels)
+{
+	struct altstream_mel *mel = altstream_mel_alloc(ALTSTREAM_FEATURES_F32);
+	float expected[ALTSTREAM_MEL_BINS];
+	float bins[ALTSTREAM_MEL_BINS];
+	int res;
 
-	/* reference be released at altstream destruction */
-	altstream->callid = ast_read_threadstorage_callid();
+	if (!mel) {
+		return -1;
+	}
 
-	return ast_pthread_create_detached_background(&thread, NULL, altstream_thread, altstream);
+	altstream_mel_test_signal(mel);
+	altstream_mel_frame(mel, &altstream_kernel_sets[0], expected);
+	altstream_mel_frame(mel, kernels, bins);
+	res = memcmp(bins, expected, sizeof(bins)) ? -1 : 0;
+	altstream_mel_free(mel);
+
+	return res;
 }
 
-static int altstream_exec(struct ast_channel *chan, const char *data)
+/*!
+ * \brief Compute a log-mel frame with \a kernels and by a double precision DFT, 0 when they agree
+ *
+ * \a max_error is set to the largest difference over the bins, in log10 units.
+ */
+static int altstream_check_mel_reference(const struct altstream_kernels *kernels, double *max_error)
 {
-	int x, readvol = 0, writevol = 0;
-	char *uid_channel_var = NULL;
-	char beep_id[64] = "";
-	unsigned int direction = 2;
-
-	struct ast_flags flags = { 0 };
-	char *parse;
-	char *tcert = NULL;
-	int reconn_timeout = 5;
-	int reconn_attempts = 5;
-	AST_DECLARE_APP_ARGS(args, 
-		AST_APP_ARG(wsserver);
-		AST_APP_ARG(options);
-		AST_APP_ARG(post_process);
-	);
+	struct altstream_mel *mel = altstream_mel_alloc(ALTSTREAM_FEATURES_F32);
+	float bins[ALTSTREAM_MEL_BINS];
+	double reference[ALTSTREAM_MEL_BINS];
+	int i;
 
-	ast_log(LOG_NOTICE, "AltStream created with args %s\n", data);
-	if (ast_strlen_zero(data)) {
-		ast_log(LOG_WARNING, "AltStream requires an argument wsserver\n");
+	*max_error = INFINITY;
+	if (!mel) {
 		return -1;
 	}
 
-	parse = ast_strdupa(data);
+	altstream_mel_test_signal(mel);
+	altstream_mel_frame(mel, kernels, bins);
+	altstream_mel_reference(mel, reference);
+	*max_error = 0;
+	for (i = 0; i < ALTSTREAM_MEL_BINS; i++) {
+		*max_error = MAX(*max_error, fabs(bins[i] - reference[i]));
+	}
+	altstream_mel_free(mel);
 
-	AST_STANDARD_APP_ARGS(args, parse);
+	return *max_error > ALTSTREAM_MEL_TOLERANCE;
+}
 
-	if (args.options) {
-		char *opts[OPT_ARG_ARRAY_SIZE] = { NULL, };
+static void altstream_benchmark_mel(int fd)
+{
+	struct altstream_mel *mel = altstream_mel_alloc(ALTSTREAM_FEATURES_F32);
+	float bins[ALTSTREAM_MEL_BINS];
+	double max_error;
+	double scalar_ns = 0;
+	int iterations = 20000;
+	int k, n;
+
+	if (!mel) {
+		return;
+	}
 
-		ast_app_parse_options(altstream_opts, &flags, opts, args.options);
+	altstream_mel_test_signal(mel);
+	altstream_check_mel_reference(&altstream_kernel_sets[0], &max_error);
 
-		if (ast_test_flag(&flags, MUXFLAG_READVOLUME)) {
-			if (ast_strlen_zero(opts[OPT_ARG_READVOLUME])) {
-				ast_log(LOG_WARNING, "No volume level was provided for the heard volume ('v') option.\n");
-			} else if ((sscanf(opts[OPT_ARG_READVOLUME], "%2d", &x) != 1) || (x < -4) || (x > 4)) {
-				ast_log(LOG_NOTICE, "Heard volume must be a number between -4 and 4, not '%s'\n", opts[OPT_ARG_READVOLUME]);
-			} else {
-				readvol = get_volfactor(x);
-			}
-		}
+	ast_cli(fd, "Log-mel frame of %d samples into %d bins, %d frames per run\n",
+		ALTSTREAM_MEL_N_FFT, ALTSTREAM_MEL_BINS, iterations);
+	ast_cli(fd, "Largest difference from a double precision DFT: %.2e (log10 units)\n", max_error);
+	ast_cli(fd, "%-8s %12s %10s %8s %s\n", "Kernel", "ns/frame", "CPU %", "Speedup", "Output");
+	for (k = 0; k < ARRAY_LEN(altstream_kernel_sets); k++) {
+		const struct altstream_kernels *kernels = &altstream_kernel_sets[k];
+		struct timeval start;
+		double ns;
 
-		if (ast_test_flag(&flags, MUXFLAG_WRITEVOLUME)) {
-			if (ast_strlen_zero(opts[OPT_ARG_WRITEVOLUME])) {
-				ast_log(LOG_WARNING, "No volume level was provided for the spoken volume ('V') option.\n");
-			} else if ((sscanf(opts[OPT_ARG_WRITEVOLUME], "%2d", &x) != 1) || (x < -4) || (x > 4)) {
-				ast_log(LOG_NOTICE, "Spoken volume must be a number between -4 and 4, not '%s'\n", opts[OPT_ARG_WRITEVOLUME]);
-			} else {
-				writevol = get_volfactor(x);
-			}
+		if (!kernels->supported()) {
+			continue;
 		}
 
-		if (ast_test_flag(&flags, MUXFLAG_VOLUME)) {
-			if (ast_strlen_zero(opts[OPT_ARG_VOLUME])) {
-				ast_log(LOG_WARNING, "No volume level was provided for the combined volume ('W') option.\n");
-			} else if ((sscanf(opts[OPT_ARG_VOLUME], "%2d", &x) != 1) || (x < -4) || (x > 4)) {
-				ast_log(LOG_NOTICE, "Combined volume must be a number between -4 and 4, not '%s'\n", opts[OPT_ARG_VOLUME]);
-			} else {
-				readvol = writevol = get_volfactor(x);
-			}
+		start = ast_tvnow();
+		for (n = 0; n < iterations; n++) {
+			altstream_mel_frame(mel, kernels, bins);
 		}
-
-		if (ast_test_flag(&flags, MUXFLAG_UID)) {
-			uid_channel_var = opts[OPT_ARG_UID];
+		ns = ast_tvdiff_us(ast_tvnow(), start) * 1000.0 / iterations;
+		if (!scalar_ns) {
+			scalar_ns = ns;
 		}
 
-		if (ast_test_flag(&flags, MUXFLAG_BEEP)) {
-			const char *interval_str = S_OR(opts[OPT_ARG_BEEP_INTERVAL], "15");
-			unsigned int interval = 15;
+		/* 100 frames a second per stream */
+		ast_cli(fd, "%-8s %12.1f %9.3f%% %7.2fx %s\n", kernels->name, ns, ns * 100 / 1e7,
+			ns > 0 ? scalar_ns / ns : 0, altstream_check_mel(kernels) ? "differs" : "bit identical");
+	}
+	ast_cli(fd, "Active kernels: %s\n", altstream_kernels->name);
 
-			if (sscanf(interval_str, "%30u", &interval) != 1) {
-				ast_log(LOG_WARNING, "Invalid interval '%s' for periodic beep. Using default of %u\n", interval_str, interval);
-			}
+	altstream_mel_free(mel);
+}
 
-			if (ast_beep_start(chan, interval, beep_id, sizeof(beep_id))) {
-				ast_log(LOG_WARNING, "Unable to enable periodic beep, please ensure func_periodic_hook is loaded.\n");
-				return -1;
-			}
-		}
-		if (ast_test_flag(&flags, MUXFLAG_DIRECTION)) {
-			const char *direction_str = opts[OPT_ARG_DIRECTION];
+static char *handle_cli_altstream_benchmark(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream benchmark {mask|gain|resample|mel}";
+			e->usage =
+				"Usage: altstream benchmark {mask|gain|resample|mel}\n"
+				"       Time every implementation of the websocket masking, the\n"
+				"       gain and energy kernels, the resampler or the log-mel front\n"
+				"       end this CPU supports.\n"
+				"       The resampler is also compared against the core translator\n"
+				"       for throughput, passband level and alias rejection, and the\n"
+				"       log-mel front end against a double precision reference.\n";
+			return NULL;
+		case CLI_GENERATE:
+			return NULL;
+	}
 
-			if (!strcmp(direction_str, "in")) {
-				direction = AST_AUDIOHOOK_DIRECTION_READ;
-			} else if (!strcmp(direction_str, "out")) {
-				direction = AST_AUDIOHOOK_DIRECTION_WRITE;
-			} else if (!strcmp(direction_str, "both")) {
-				direction = AST_AUDIOHOOK_DIRECTION_BOTH;
-			} else {
-				direction = AST_AUDIOHOOK_DIRECTION_BOTH;
+	if (a->argc < 3) {
+		return CLI_SHOWUSAGE;
+	}
 
-				ast_log(LOG_WARNING, "Invalid direction '%s' given. Using default of 'both'\n", opts[OPT_ARG_DIRECTION]);
-			}
-		}
+	if (!strcasecmp(a->argv[2], "mask")) {
+		altstream_benchmark_mask(a->fd);
+	} else if (!strcasecmp(a->argv[2], "gain")) {
+		altstream_benchmark_gain(a->fd);
+	} else if (!strcasecmp(a->argv[2], "resample")) {
+		altstream_benchmark_resample(a->fd);
+	} else if (!strcasecmp(a->argv[2], "mel")) {
+		altstream_benchmark_mel(a->fd);
+	} else {
+		return CLI_SHOWUSAGE;
+	}
 
-		if (ast_test_flag(&flags, MUXFLAG_TLS)) {
-			tcert = ast_strdup ( S_OR(opts[OPT_ARG_TLS], "") );
-			ast_verb(2, "Parsing TLS result tcert: %s\n", tcert);
-		}
+	return CLI_SUCCESS;
+}
 
-		if (ast_test_flag(&flags, MUXFLAG_RECONNECTION_TIMEOUT)) {
-			reconn_timeout = atoi( S_OR(opts[OPT_ARG_RECONNECTION_TIMEOUT], "15") );
-			ast_verb(2, "Reconnection timeout set to: %d\n", reconn_timeout);
-		}
+#ifdef TEST_FRAMEWORK
+/*! \brief Run \a check on every kernel set the CPU supports, it explains its own failures */
+static enum ast_test_result_state altstream_test_kernels(struct ast_test *test,
+	int (*check)(struct ast_test *test, const struct altstream_kernels *kernels))
+{
+	enum ast_test_result_state res = AST_TEST_PASS;
+	int k;
+
+	for (k = 0; k < ARRAY_LEN(altstream_kernel_sets); k++) {
+		const struct altstream_kernels *kernels = &altstream_kernel_sets[k];
 
-		if (ast_test_flag(&flags, MUXFLAG_RECONNECTION_ATTEMPTS)) {
-			reconn_attempts = atoi( S_OR(opts[OPT_ARG_RECONNECTION_ATTEMPTS], "15") );
-			ast_verb(2, "Reconnection attempts set to: %d\n", reconn_attempts);
+		if (!kernels->supported()) {
+			ast_test_status_update(test, "Skipping %s, not supported by this CPU\n", kernels->name);
+			continue;
+		}
+		if (check(test, kernels)) {
+			res = AST_TEST_FAIL;
 		}
 	}
 
-	/* If there are no file writing arguments/options for the mix monitor, send a warning message and return -1 */
+	return res;
+}
 
-	if (ast_strlen_zero(args.wsserver)) {
-		ast_log(LOG_WARNING, "AltStream requires an argument (wsserver)\n");
+static int altstream_test_check_mask(struct ast_test *test, const struct altstream_kernels *kernels)
+{
+	if (altstream_check_mask(kernels)) {
+		ast_test_status_update(test, "%s masking differs from the scalar kernel\n", kernels->name);
 		return -1;
 	}
 
-	pbx_builtin_setvar_helper(chan, "ALTSTREAM_WSSERVER", args.wsserver);
+	return 0;
+}
 
-	/* If launch_monitor_thread works, the module reference must not be released until it is finished. */
-	ast_module_ref(ast_module_info->self);
+AST_TEST_DEFINE(altstream_test_mask)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "mask";
+		info->category = "/apps/app_altstream/kernels/";
+		info->summary = "Websocket masking kernels";
+		info->description =
+			"Every masking kernel the CPU supports gives the same bytes as the\n"
+			"scalar one, for lengths and alignments around the vector widths.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
 
-	if (launch_altstream_thread(
-		chan,
-		args.wsserver,
-		flags.flags,
-		direction,
-		tcert,
-		reconn_timeout,
-		reconn_attempts,
-		readvol,
-		writevol,
-		args.post_process, 
-		uid_channel_var, 
-		beep_id)
-	) {
+	return altstream_test_kernels(test, altstream_test_check_mask);
+}
 
-		/* Failed */
-		ast_module_unref(ast_module_info->self);
+static int altstream_test_check_gain(struct ast_test *test, const struct altstream_kernels *kernels)
+{
+	if (altstream_check_gain(kernels)) {
+		ast_test_status_update(test, "%s gain, energy or levels differ from the scalar kernels\n", kernels->name);
+		return -1;
 	}
 
 	return 0;
 }
 
-static int stop_altstream_full(struct ast_channel *chan, const char *data)
+AST_TEST_DEFINE(altstream_test_gain)
 {
-	struct ast_datastore *datastore = NULL;
-	char *parse = "";
-	struct altstream_ds *altstream_ds;
-	const char *beep_id = NULL;
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "gain";
+		info->category = "/apps/app_altstream/kernels/";
+		info->summary = "Gain, energy and level kernels";
+		info->description =
+			"Every gain, energy and level analysis kernel the CPU supports gives\n"
+			"the same results as the scalar one, saturation and full scale\n"
+			"samples included.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
+	}
 
-	AST_DECLARE_APP_ARGS(args, AST_APP_ARG(altstreamid););
+	return altstream_test_kernels(test, altstream_test_check_gain);
+}
 
-	if (!ast_strlen_zero(data)) {
-		parse = ast_strdupa(data);
+static int altstream_test_check_resample(struct ast_test *test, const struct altstream_kernels *kernels)
+{
+	static const unsigned int pairs[][2] = {
+		{ 8000, 16000 }, { 16000, 8000 }, { 48000, 8000 }, { 48000, 16000 }, { 8000, 48000 }, { 24000, 16000 },
+	};
+	int res = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(pairs); i++) {
+		unsigned int in_rate = pairs[i][0];
+		unsigned int out_rate = pairs[i][1];
+		double pass_db = 0;
+		double stop_db = -INFINITY;
+
+		if (altstream_check_resample(kernels, in_rate, out_rate, 1000.0, &pass_db)
+			|| (out_rate < in_rate && altstream_check_resample(kernels, in_rate, out_rate, (in_rate + out_rate) / 4.0, &stop_db))) {
+			ast_test_status_update(test, "%s resampling %u -> %u Hz differs from the scalar kernel\n",
+				kernels->name, in_rate, out_rate);
+			res = -1;
+			continue;
+		}
+		if (fabs(pass_db) > 0.5 || stop_db > -60.0) {
+			ast_test_status_update(test, "%s resampling %u -> %u Hz: passband %.2f dB, stopband %.1f dB\n",
+				kernels->name, in_rate, out_rate, pass_db, stop_db);
+			res = -1;
+		}
 	}
 
-	AST_STANDARD_APP_ARGS(args, parse);
-
-	ast_channel_lock(chan);
+	return res;
+}
 
-	datastore = ast_channel_datastore_find(chan, &altstream_ds_info, S_OR(args.altstreamid, NULL));
-	if (!datastore) {
-		ast_channel_unlock(chan);
-		return -1;
+AST_TEST_DEFINE(altstream_test_resample)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "resample";
+		info->category = "/apps/app_altstream/kernels/";
+		info->summary = "Polyphase resampler";
+		info->description =
+			"Every resampler kernel the CPU supports gives the same samples as the\n"
+			"scalar one, a 1 kHz tone keeps its level within 0.5 dB and a tone\n"
+			"between the output and input Nyquist frequencies is attenuated by at\n"
+			"least 60 dB when downsampling.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
 	}
-	altstream_ds = datastore->data;
 
-	ast_mutex_lock(&altstream_ds->lock);
+	return altstream_test_kernels(test, altstream_test_check_resample);
+}
 
-	/* The altstream thread may be waiting on the audiohook trigger.
-	 * In order to exit from the altstream loop before waiting on channel
-	 * destruction, poke the audiohook trigger. */
-	if (altstream_ds->audiohook) {
-		if (altstream_ds->audiohook->status != AST_AUDIOHOOK_STATUS_DONE) {
-			ast_audiohook_update_status(altstream_ds->audiohook, AST_AUDIOHOOK_STATUS_SHUTDOWN);
-		}
-		ast_audiohook_lock(altstream_ds->audiohook);
-		ast_cond_signal(&altstream_ds->audiohook->trigger);
-		ast_audiohook_unlock(altstream_ds->audiohook);
-		altstream_ds->audiohook = NULL;
+static int altstream_test_check_mel(struct ast_test *test, const struct altstream_kernels *kernels)
+{
+	if (altstream_check_mel(kernels)) {
+		ast_test_status_update(test, "%s log-mel bins differ from the scalar kernels\n", kernels->name);
+		return -1;
 	}
 
-	if (!ast_strlen_zero(altstream_ds->beep_id)) {
-		beep_id = ast_strdupa(altstream_ds->beep_id);
+	return 0;
+}
+
+AST_TEST_DEFINE(altstream_test_mel)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "mel";
+		info->category = "/apps/app_altstream/kernels/";
+		info->summary = "Log-mel feature kernels";
+		info->description =
+			"Every FFT kernel the CPU supports gives a log-mel frame of a chirp\n"
+			"over noise bit identical to the scalar one.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
 	}
 
-	ast_mutex_unlock(&altstream_ds->lock);
+	return altstream_test_kernels(test, altstream_test_check_mel);
+}
 
-	/* Remove the datastore so the monitor thread can exit */
-	if (!ast_channel_datastore_remove(chan, datastore)) {
-		ast_datastore_free(datastore);
+static int altstream_test_check_mel_reference(struct ast_test *test, const struct altstream_kernels *kernels)
+{
+	double max_error;
+
+	if (altstream_check_mel_reference(kernels, &max_error)) {
+		ast_test_status_update(test, "%s log-mel bins are off by %.2e from the reference\n", kernels->name, max_error);
+		return -1;
 	}
 
-	ast_channel_unlock(chan);
+	return 0;
+}
 
-	if (!ast_strlen_zero(beep_id)) {
-		ast_beep_stop(chan, beep_id);
+AST_TEST_DEFINE(altstream_test_mel_reference)
+{
+	switch (cmd) {
+	case TEST_INIT:
+		info->name = "mel_reference";
+		info->category = "/apps/app_altstream/kernels/";
+		info->summary = "Log-mel features against a direct DFT";
+		info->description =
+			"Every FFT kernel the CPU supports gives a log-mel frame of a chirp\n"
+			"over noise within ALTSTREAM_MEL_TOLERANCE of a double precision DFT.";
+		return AST_TEST_NOT_RUN;
+	case TEST_EXECUTE:
+		break;
 	}
 
-	return 0;
+	return altstream_test_kernels(test, altstream_test_check_mel_reference);
 }
+#endif
 
-static int stop_altstream_exec(struct ast_channel *chan, const char *data)
+static int altstream_cli_show_entry(void *obj, void *arg, int flags)
 {
-	stop_altstream_full(chan, data);
+	struct altstream_entry *entry = obj;
+	int fd = *(int *) arg;
+
+	ao2_lock(entry);
+	if (entry->ds) {
+		ast_cli(fd, "%-18s %-32s %8" PRId64 " %10u %10u %s\n", entry->id, entry->channel,
+			ast_tvdiff_ms(ast_tvnow(), entry->started) / 1000, entry->ds->frames_sent, entry->ds->frames_dropped, entry->wsserver);
+	}
+	ao2_unlock(entry);
+
 	return 0;
 }
 
-static char *handle_cli_altstream(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+static char *handle_cli_altstream_show(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct ast_channel *chan;
-	struct ast_datastore *datastore = NULL;
-	struct altstream_ds *altstream_ds = NULL;
+	struct ao2_iterator *iter;
+	struct altstream_entry *entry;
+	int fd;
 
 	switch (cmd) {
 		case CLI_INIT:
-			e->command = "altstream {start|stop|list}";
+			e->command = "altstream show {all|server}";
 			e->usage =
-				"Usage: altstream start <chan_name> [args]\n"
-				"         The optional arguments are passed to the AltStream application.\n"
-				"       altstream stop <chan_name> [args]\n"
-				"         The optional arguments are passed to the StopAltStream application.\n"
-				"       altstream list <chan_name>\n";
+				"Usage: altstream show all\n"
+				"       altstream show server <wsserver>\n"
+				"       List every live AltStream, or those streaming to one server,\n"
+				"       without looking through the channels.\n";
 			return NULL;
 		case CLI_GENERATE:
-			return ast_complete_channels(a->line, a->word, a->pos, a->n, 2);
+			return NULL;
 	}
 
-	if (a->argc < 3) {
+	if (!strcasecmp(a->argv[2], "all") ? a->argc != 3 : a->argc != 4) {
 		return CLI_SHOWUSAGE;
 	}
 
-	if (!(chan = ast_channel_get_by_name_prefix(a->argv[2], strlen(a->argv[2])))) {
-		ast_cli(a->fd, "No channel matching '%s' found.\n", a->argv[2]);
-		/* Technically this is a failure, but we don't want 2 errors printing out */
+	fd = a->fd;
+	ast_cli(fd, "%-18s %-32s %8s %10s %10s %s\n", "AltStream ID", "Channel", "Seconds", "Sent", "Dropped", "Ws Server");
+	if (a->argc == 3) {
+		ao2_callback(altstream_streams, OBJ_NODATA, altstream_cli_show_entry, &fd);
+		ast_cli(a->fd, "%d AltStreams\n", ao2_container_count(altstream_streams));
 		return CLI_SUCCESS;
 	}
 
-	if (!strcasecmp(a->argv[1], "start")) {
-		altstream_exec(chan, (a->argc >= 4) ? a->argv[3] : "");
-	} else if (!strcasecmp(a->argv[1], "stop")) {
-		stop_altstream_exec(chan, (a->argc >= 4) ? a->argv[3] : "");
-	} else if (!strcasecmp(a->argv[1], "list")) {
-		ast_cli(a->fd, "AltStream ID\tWs Server\tReceive File\tTransmit File\n");
-		ast_cli(a->fd,
-						"=========================================================================\n");
-		ast_channel_lock(chan);
-		AST_LIST_TRAVERSE(ast_channel_datastores(chan), datastore, entry) {
-			if (datastore->info == &altstream_ds_info) {
-				char *wsserver = "";
-				char *filename_read = "";
-				char *filename_write = "";
-
-				altstream_ds = datastore->data;
-				if (altstream_ds->wsserver) {
-					wsserver = altstream_ds->wsserver;
-				}
-				ast_cli(a->fd, "%p\t%s\t%s\t%s\n", altstream_ds, wsserver,
-								filename_read, filename_write);
-			}
-		}
-		ast_channel_unlock(chan);
-	} else {
-		chan = ast_channel_unref(chan);
-		return CLI_SHOWUSAGE;
+	iter = ao2_find(altstream_streams_by_server, a->argv[3], OBJ_SEARCH_KEY | OBJ_MULTIPLE);
+	while (iter && (entry = ao2_iterator_next(iter))) {
+		altstream_cli_show_entry(entry, &fd, 0);
+		ao2_ref(entry, -1);
+	}
+	if (iter) {
+		ao2_iterator_destroy(iter);
 	}
-
-	chan = ast_channel_unref(chan);
 
 	return CLI_SUCCESS;
 }
 
-/*! \brief  Mute / unmute  a MixMonitor channel */
-static int manager_mute_altstream(struct mansession *s, const struct message *m)
+static int altstream_cli_show_profile(void *obj, void *arg, int flags)
 {
-	struct ast_channel *c;
-	const char *name = astman_get_header(m, "Channel");
-	const char *id = astman_get_header(m, "ActionID");
-	const char *state = astman_get_header(m, "State");
-	const char *direction = astman_get_header(m, "Direction");
-	int clearmute = 1;
-	enum ast_audiohook_flags flag;
-
-	if (ast_strlen_zero(direction)) {
-		astman_send_error(s, m, "No direction specified. Must be read, write or both");
-		return AMI_SUCCESS;
-	}
-
-	if (!strcasecmp(direction, "read")) {
-		flag = AST_AUDIOHOOK_MUTE_READ;
-	} else if (!strcasecmp(direction, "write")) {
-		flag = AST_AUDIOHOOK_MUTE_WRITE;
-	} else if (!strcasecmp(direction, "both")) {
-		flag = AST_AUDIOHOOK_MUTE_READ | AST_AUDIOHOOK_MUTE_WRITE;
-	} else {
-		astman_send_error(s, m, "Invalid direction specified. Must be read, write or both");
-		return AMI_SUCCESS;
-	}
+	struct altstream_profile *profile = obj;
+	int fd = *(int *) arg;
 
-	if (ast_strlen_zero(name)) {
-		astman_send_error(s, m, "No channel specified");
-		return AMI_SUCCESS;
-	}
+	ast_cli(fd, "%-20s %-40s %s\n", profile->name, profile->wsserver, profile->options);
 
-	if (ast_strlen_zero(state)) {
-		astman_send_error(s, m, "No state specified");
-		return AMI_SUCCESS;
-	}
+	return 0;
+}
 
-	clearmute = ast_false(state);
+static char *handle_cli_altstream_profiles(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	struct ao2_container *profiles;
+	int fd;
 
-	c = ast_channel_get_by_name(name);
-	if (!c) {
-		astman_send_error(s, m, "No such channel");
-		return AMI_SUCCESS;
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream profiles";
+			e->usage =
+				"Usage: altstream profiles\n"
+				"       List the stream profiles loaded from altstream.conf with\n"
+				"       their server and the options they compile to.\n";
+			return NULL;
+		case CLI_GENERATE:
+			return NULL;
 	}
 
-	if (ast_audiohook_set_mute(c, altstream_spy_type, flag, clearmute)) {
-		ast_channel_unref(c);
-		astman_send_error(s, m, "Cannot set mute flag");
-		return AMI_SUCCESS;
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
 	}
 
-	astman_append(s, "Response: Success\r\n");
-
-	if (!ast_strlen_zero(id)) {
-		astman_append(s, "ActionID: %s\r\n", id);
+	fd = a->fd;
+	ast_cli(fd, "%-20s %-40s %s\n", "Profile", "Ws Server", "Options");
+	if ((profiles = ao2_global_obj_ref(altstream_profiles))) {
+		ao2_callback(profiles, OBJ_NODATA, altstream_cli_show_profile, &fd);
+		ast_cli(fd, "%d profiles\n", ao2_container_count(profiles));
+		ao2_ref(profiles, -1);
 	}
 
-	astman_append(s, "\r\n");
-
-	ast_channel_unref(c);
-
-	return AMI_SUCCESS;
+	return CLI_SUCCESS;
 }
 
-static int manager_altstream(struct mansession *s, const struct message *m)
+static char *handle_cli_altstream_cpusets(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct ast_channel *c;
-	const char *name = astman_get_header(m, "Channel");
-	const char *id = astman_get_header(m, "ActionID");
-	const char *wsserver = astman_get_header(m, "WsServer");
-	const char *options = astman_get_header(m, "Options");
-	//const char *command = astman_get_header(m, "Command");
-	char *opts[OPT_ARG_ARRAY_SIZE] = { NULL, };
-	struct ast_flags flags = { 0 };
-	char *uid_channel_var = NULL;
-	const char *altstream_id = NULL;
-	int res;
-	char args[PATH_MAX];
-
-	if (ast_strlen_zero(name)) {
-		astman_send_error(s, m, "No channel specified");
-		return AMI_SUCCESS;
-	}
-
-	c = ast_channel_get_by_name(name);
-	if (!c) {
-		astman_send_error(s, m, "No such channel");
-		return AMI_SUCCESS;
-	}
+	struct altstream_placement *placement;
+	int i;
 
-	if (!ast_strlen_zero(options)) {
-		ast_app_parse_options(altstream_opts, &flags, opts, ast_strdupa(options));
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream cpusets";
+			e->usage =
+				"Usage: altstream cpusets\n"
+				"       List the CPU sets stream threads are pinned to, with their\n"
+				"       NUMA node and how many streams run on each.\n";
+			return NULL;
+		case CLI_GENERATE:
+			return NULL;
 	}
 
-	snprintf(args, sizeof(args), "%s,%s", wsserver, options);
-
-	res = altstream_exec(c, args);
-
-	if (ast_test_flag(&flags, MUXFLAG_UID)) {
-		uid_channel_var = opts[OPT_ARG_UID];
-		ast_channel_lock(c);
-		altstream_id = pbx_builtin_getvar_helper(c, uid_channel_var);
-		altstream_id = ast_strdupa(S_OR(altstream_id, ""));
-		ast_channel_unlock(c);
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
 	}
 
-	if (res) {
-		ast_channel_unref(c);
-		astman_send_error(s, m, "Could not start monitoring channel");
-		return AMI_SUCCESS;
+	if (!(placement = ao2_global_obj_ref(altstream_placement)) || !placement->num_cpusets) {
+		ast_cli(a->fd, "Stream threads are not pinned\n");
+		ao2_cleanup(placement);
+		return CLI_SUCCESS;
 	}
 
-	astman_append(s, "Response: Success\r\n");
-
-	if (!ast_strlen_zero(id)) {
-		astman_append(s, "ActionID: %s\r\n", id);
-	}
+	ast_cli(a->fd, "%-6s %-4s %-8s %-8s %s\n", "Cpuset", "Node", "Streams", "Started", "CPUs");
+	for (i = 0; i < placement->num_cpusets; i++) {
+		struct altstream_cpuset *cpuset = placement->cpusets[i];
+		char cpus[256];
+		char node[12] = "-";
 
-	if (!ast_strlen_zero(altstream_id)) {
-		astman_append(s, "AltStreamID: %s\r\n", altstream_id);
+		altstream_cpulist_format(&cpuset->cpus, cpus, sizeof(cpus));
+		if (cpuset->node >= 0) {
+			snprintf(node, sizeof(node), "%d", cpuset->node);
+		}
+		ast_cli(a->fd, "%-6d %-4s %-8d %-8d %s\n", i, node, cpuset->streams, cpuset->started, cpus);
 	}
+	ast_cli(a->fd, "%d cpusets, NUMA placement %s\n", placement->num_cpusets, placement->numa ? "on" : "off");
+	ao2_ref(placement, -1);
 
-	astman_append(s, "\r\n");
-
-	ast_channel_unref(c);
-
-	return AMI_SUCCESS;
+	return CLI_SUCCESS;
 }
 
-static int manager_stop_altstream(struct mansession *s, const struct message *m)
+static char *handle_cli_altstream_redirect(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct ast_channel *c;
-	const char *name = astman_get_header(m, "Channel");
-	const char *id = astman_get_header(m, "ActionID");
-	const char *altstream_id = astman_get_header(m, "AltStreamID");
 	int res;
 
-	if (ast_strlen_zero(name)) {
-		astman_send_error(s, m, "No channel specified");
-		return AMI_SUCCESS;
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream redirect";
+			e->usage =
+				"Usage: altstream redirect <altstream id> <wsserver>\n"
+				"       Move a live AltStream to other endpoints. The new connection\n"
+				"       is opened in the background and caught up with the audio sent\n"
+				"       since the redirect was asked for before the old one is closed.\n";
+			return NULL;
+		case CLI_GENERATE:
+			return NULL;
 	}
 
-	c = ast_channel_get_by_name(name);
-	if (!c) {
-		astman_send_error(s, m, "No such channel");
-		return AMI_SUCCESS;
+	if (a->argc != 4) {
+		return CLI_SHOWUSAGE;
 	}
 
-	res = stop_altstream_full(c, altstream_id);
-	if (res) {
-		ast_channel_unref(c);
-		astman_send_error(s, m, "Could not stop monitoring channel");
-		return AMI_SUCCESS;
+	res = redirect_altstream_by_id(a->argv[2], a->argv[3]);
+	if (res > 0) {
+		ast_cli(a->fd, "AltStream %s is already being redirected.\n", a->argv[2]);
+	} else if (res) {
+		ast_cli(a->fd, "No AltStream with ID '%s' found.\n", a->argv[2]);
+	} else {
+		ast_cli(a->fd, "Redirecting AltStream %s to %s.\n", a->argv[2], a->argv[3]);
 	}
 
-	astman_append(s, "Response: Success\r\n");
+	return CLI_SUCCESS;
+}
 
-	if (!ast_strlen_zero(id)) {
-		astman_append(s, "ActionID: %s\r\n", id);
+static char *handle_cli_altstream_jobs(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
+{
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream jobs";
+			e->usage =
+				"Usage: altstream jobs\n"
+				"       Show the post process queue: commands waiting and running,\n"
+				"       how many ran, failed or were dropped, and how long they\n"
+				"       waited in the queue and took to run.\n";
+			return NULL;
+		case CLI_GENERATE:
+			return NULL;
 	}
 
-	astman_append(s, "\r\n");
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
+	}
 
-	ast_channel_unref(c);
+	ast_mutex_lock(&altstream_jobs.lock);
+	ast_cli(a->fd, "Workers:   %d, at most %d started per second\n", altstream_jobs.num_workers, ALTSTREAM_JOB_RATE);
+	ast_cli(a->fd, "Queue:     %u waiting (max %u of %d), %u running\n", altstream_jobs.depth, altstream_jobs.max_depth,
+		ALTSTREAM_JOB_QUEUE, altstream_jobs.running);
+	ast_cli(a->fd, "Commands:  %" PRIu64 " queued, %" PRIu64 " run, %" PRIu64 " failed, %" PRIu64 " dropped\n",
+		altstream_jobs.queued, altstream_jobs.run, altstream_jobs.failed, altstream_jobs.dropped);
+	ast_cli(a->fd, "Wait:      %.1f ms average, %.1f ms max\n",
+		altstream_jobs.run ? altstream_jobs.wait_us / 1000.0 / altstream_jobs.run : 0.0, altstream_jobs.max_wait_us / 1000.0);
+	ast_cli(a->fd, "Run time:  %.1f ms average, %.1f ms max\n",
+		altstream_jobs.run ? altstream_jobs.run_us / 1000.0 / altstream_jobs.run : 0.0, altstream_jobs.max_run_us / 1000.0);
+	ast_mutex_unlock(&altstream_jobs.lock);
 
-	return AMI_SUCCESS;
+	return CLI_SUCCESS;
 }
 
-static int func_altstream_read(struct ast_channel *chan, const char *cmd, char *data, char *buf, size_t len)
+static char *handle_cli_altstream_uploads(struct ast_cli_entry *e, int cmd, struct ast_cli_args *a)
 {
-	struct ast_datastore *datastore;
-	struct altstream_ds *ds_data;
-	AST_DECLARE_APP_ARGS(args, AST_APP_ARG(id); AST_APP_ARG(key););
-
-	AST_STANDARD_APP_ARGS(args, data);
-
-	if (ast_strlen_zero(args.id) || ast_strlen_zero(args.key)) {
-		ast_log(LOG_WARNING, "Not enough arguments provided to %s. An ID and key must be provided\n", cmd);
-		return -1;
+	switch (cmd) {
+		case CLI_INIT:
+			e->command = "altstream uploads";
+			e->usage =
+				"Usage: altstream uploads\n"
+				"       Show the utterances of http:// endpoints waiting for and being\n"
+				"       posted, how many were posted, failed or dropped, and how long\n"
+				"       they waited in the queue and took to transcribe.\n";
+			return NULL;
+		case CLI_GENERATE:
+			return NULL;
 	}
 
-	ast_channel_lock(chan);
-	datastore = ast_channel_datastore_find(chan, &altstream_ds_info, args.id);
-	ast_channel_unlock(chan);
-
-	if (!datastore) {
-		ast_log(LOG_WARNING, "Could not find AltStream with ID %s\n", args.id);
-		return -1;
+	if (a->argc != 2) {
+		return CLI_SHOWUSAGE;
 	}
 
-	ds_data = datastore->data;
+	ast_mutex_lock(&altstream_uploads.lock);
+	ast_cli(a->fd, "Workers:    %d\n", altstream_uploads.num_workers);
+	ast_cli(a->fd, "Queue:      %u waiting (max %u of %d), %u posting\n", altstream_uploads.depth, altstream_uploads.max_depth,
+		ALTSTREAM_HTTP_QUEUE, altstream_uploads.running);
+	ast_cli(a->fd, "Utterances: %" PRIu64 " queued, %" PRIu64 " posted, %" PRIu64 " failed, %" PRIu64 " dropped, %.1f s of audio\n",
+		altstream_uploads.queued, altstream_uploads.posted, altstream_uploads.failed, altstream_uploads.dropped,
+		altstream_uploads.audio_ms / 1000.0);
+	ast_cli(a->fd, "Wait:       %.1f ms average, %.1f ms max\n",
+		altstream_uploads.posted ? altstream_uploads.wait_us / 1000.0 / altstream_uploads.posted : 0.0, altstream_uploads.max_wait_us / 1000.0);
+	ast_cli(a->fd, "Post time:  %.1f ms average, %.1f ms max\n",
+		altstream_uploads.posted ? altstream_uploads.run_us / 1000.0 / altstream_uploads.posted : 0.0, altstream_uploads.max_run_us / 1000.0);
+	ast_mutex_unlock(&altstream_uploads.lock);
 
-	if (!strcasecmp(args.key, "filename")) {
-		ast_copy_string(buf, ds_data->wsserver, len);
-	} else {
-		ast_log(LOG_WARNING, "Unrecognized %s option %s\n", cmd, args.key);
-		return -1;
-	}
-	return 0;
+	return CLI_SUCCESS;
 }
 
-static struct ast_custom_function altstream_function = {
-	.name = "ALTSTREAM",
-	.read = func_altstream_read,
-};
-
 static struct ast_cli_entry cli_altstream[] = {
-	AST_CLI_DEFINE(handle_cli_altstream, "Execute a AltStream command")
+	AST_CLI_DEFINE(handle_cli_altstream, "Execute a AltStream command"),
+	AST_CLI_DEFINE(handle_cli_altstream_benchmark, "Benchmark AltStream processing kernels"),
+	AST_CLI_DEFINE(handle_cli_altstream_cpusets, "Show where AltStream threads run"),
+	AST_CLI_DEFINE(handle_cli_altstream_jobs, "Show the AltStream post process queue"),
+	AST_CLI_DEFINE(handle_cli_altstream_profiles, "List AltStream profiles"),
+	AST_CLI_DEFINE(handle_cli_altstream_redirect, "Move a live AltStream to other endpoints"),
+	AST_CLI_DEFINE(handle_cli_altstream_show, "List live AltStreams"),
+	AST_CLI_DEFINE(handle_cli_altstream_uploads, "Show the AltStream utterance uploads"),
 };
 
 static int set_altstream_methods(void)
 {
+	int i;
+
+	for (i = 0; i < ARRAY_LEN(altstream_kernel_sets); i++) {
+		if (altstream_kernel_sets[i].supported()) {
+			altstream_kernels = &altstream_kernel_sets[i];
+		}
+	}
+	ast_verb(2, "[AltStream] Using %s kernels\n", altstream_kernels->name);
+
 	return 0;
 }
 
@@ -1406,27 +10505,79 @@ static int unload_module(void)
 	ast_cli_unregister_multiple(cli_altstream, ARRAY_LEN(cli_altstream));
 	res = ast_unregister_application(stop_app);
 	res |= ast_unregister_application(app);
+	res |= ast_unregister_application(bridge_app);
+	res |= ast_unregister_application(stop_bridge_app);
 	res |= ast_manager_unregister("AltStreamMute");
 	res |= ast_manager_unregister("AltStream");
 	res |= ast_manager_unregister("StopAltStream");
+	res |= ast_manager_unregister("AltStreamBridge");
+	res |= ast_manager_unregister("StopAltStreamBridge");
+	res |= ast_manager_unregister("AltStreamBulk");
+	res |= ast_manager_unregister("StopAltStreamBulk");
+	res |= ast_manager_unregister("AltStreamRedirect");
+	res |= ast_manager_unregister("AltStreamUsage");
 	res |= ast_custom_function_unregister(&altstream_function);
 	res |= clear_altstream_methods();
+	AST_TEST_UNREGISTER(altstream_test_mask);
+	AST_TEST_UNREGISTER(altstream_test_gain);
+	AST_TEST_UNREGISTER(altstream_test_resample);
+	AST_TEST_UNREGISTER(altstream_test_mel);
+	AST_TEST_UNREGISTER(altstream_test_mel_reference);
+	altstream_jobs_stop();
+	altstream_uploads_stop();
+	altstream_registry_cleanup();
+	ao2_global_obj_release(altstream_profiles);
+	ao2_global_obj_release(altstream_placement);
+	altstream_admission_cleanup();
 
 	return res;
 }
 
+static int reload_module(void)
+{
+	return altstream_config_load(1) ? AST_MODULE_LOAD_DECLINE : AST_MODULE_LOAD_SUCCESS;
+}
+
 static int load_module(void)
 {
 	int res;
 
+	if (altstream_registry_init() || altstream_admission_init()) {
+		altstream_registry_cleanup();
+		altstream_admission_cleanup();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
+	if (altstream_config_load(0)) {
+		altstream_registry_cleanup();
+		altstream_admission_cleanup();
+		return AST_MODULE_LOAD_DECLINE;
+	}
+
 	ast_cli_register_multiple(cli_altstream, ARRAY_LEN(cli_altstream));
 	res = ast_register_application_xml(app, altstream_exec);
 	res |= ast_register_application_xml(stop_app, stop_altstream_exec);
+	res |= ast_register_application_xml(bridge_app, altstream_bridge_exec);
+	res |= ast_register_application_xml(stop_bridge_app, stop_altstream_bridge_exec);
 	res |= ast_manager_register_xml("AltStreamMute", EVENT_FLAG_SYSTEM | EVENT_FLAG_CALL, manager_mute_altstream);
 	res |= ast_manager_register_xml("AltStream", EVENT_FLAG_SYSTEM, manager_altstream);
 	res |= ast_manager_register_xml("StopAltStream", EVENT_FLAG_SYSTEM | EVENT_FLAG_CALL, manager_stop_altstream);
+	res |= ast_manager_register_xml("AltStreamBridge", EVENT_FLAG_SYSTEM, manager_altstream_bridge);
+	res |= ast_manager_register_xml("StopAltStreamBridge", EVENT_FLAG_SYSTEM | EVENT_FLAG_CALL, manager_stop_altstream_bridge);
+	res |= ast_manager_register_xml("AltStreamBulk", EVENT_FLAG_SYSTEM, manager_altstream_bulk);
+	res |= ast_manager_register_xml("StopAltStreamBulk", EVENT_FLAG_SYSTEM | EVENT_FLAG_CALL, manager_stop_altstream_bulk);
+	res |= ast_manager_register_xml("AltStreamRedirect", EVENT_FLAG_SYSTEM, manager_redirect_altstream);
+	res |= ast_manager_register_xml("AltStreamUsage", EVENT_FLAG_SYSTEM | EVENT_FLAG_REPORTING, manager_altstream_usage);
 	res |= ast_custom_function_register(&altstream_function);
 	res |= set_altstream_methods();
+	altstream_mel_init();
+	altstream_jobs_start();
+	altstream_uploads_start();
+	AST_TEST_REGISTER(altstream_test_mask);
+	AST_TEST_REGISTER(altstream_test_gain);
+	AST_TEST_REGISTER(altstream_test_resample);
+	AST_TEST_REGISTER(altstream_test_mel);
+	AST_TEST_REGISTER(altstream_test_mel_reference);
 
 	return res;
 }
@@ -1438,5 +10589,6 @@ AST_MODULE_INFO(
 	.support_level = AST_MODULE_SUPPORT_CORE,
 	.load = load_module,
 	.unload = unload_module,
-	.optional_modules = "func_periodic_hook",
+	.reload = reload_module,
+	.optional_modules = "func_periodic_hook,res_curl",
 );